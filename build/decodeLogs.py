@@ -0,0 +1,135 @@
+#!/usr/bin/env python3
+
+# Reconstructs the text of binary logs (`iop::BinaryLog`, enabled by defining
+# IOP_BINARY_LOG). Constant strings are sent as their offset to an anchor, so
+# the ELF of the exact firmware that logged is needed:
+#
+#   pio device monitor --raw | build/decodeLogs.py .pio/build/<env>/firmware.elf
+#   build/decodeLogs.py .pio/build/<env>/firmware.elf capture.bin
+
+from __future__ import print_function
+import sys
+
+ANCHOR = b"IOP_BINARY_LOG_ANCHOR\0"
+VERSION = 1
+PIECE_LEVEL = 0xF
+LEVELS = ["TRACE", "DEBUG", "INFO", "WARN", "ERROR", "CRIT", "NO_LOG"]
+INTERNED, STRING, UNSIGNED, SIGNED = range(4)
+
+def cobsDecode(frame):
+    out = bytearray()
+    index = 0
+    while index < len(frame):
+        code = frame[index]
+        if code == 0 or index + code > len(frame):
+            raise ValueError("Invalid COBS frame")
+        out += frame[index + 1:index + code]
+        index += code
+        if index < len(frame):
+            out.append(0)
+    return bytes(out)
+
+def unzigzag(value):
+    return (value >> 1) ^ -(value & 1)
+
+class Reader:
+    def __init__(self, data):
+        self.data = data
+        self.index = 0
+
+    def done(self):
+        return self.index >= len(self.data)
+
+    def byte(self):
+        value = self.data[self.index]
+        self.index += 1
+        return value
+
+    def varint(self):
+        value = 0
+        shift = 0
+        while True:
+            byte = self.byte()
+            value |= (byte & 0x7F) << shift
+            shift += 7
+            if byte < 0x80:
+                return value
+
+class Decoder:
+    def __init__(self, elf):
+        self.elf = elf
+        # The first one, debug sections come after the code
+        self.anchor = elf.find(ANCHOR)
+        if self.anchor < 0:
+            raise Exception("Anchor not found, was the firmware built with IOP_BINARY_LOG?")
+
+    def interned(self, offset):
+        start = self.anchor + unzigzag(offset)
+        if start < 0 or start >= len(self.elf):
+            return "<unknown string " + str(unzigzag(offset)) + ">"
+        end = self.elf.find(b"\0", start)
+        return self.elf[start:end].decode("utf-8", "replace")
+
+    def argument(self, reader):
+        tag = reader.byte()
+        if tag == INTERNED:
+            return self.interned(reader.varint())
+        if tag == STRING:
+            length = reader.varint()
+            text = reader.data[reader.index:reader.index + length]
+            reader.index += length
+            return text.decode("utf-8", "replace")
+        if tag == UNSIGNED:
+            return str(reader.varint())
+        if tag == SIGNED:
+            return str(unzigzag(reader.varint()))
+        raise ValueError("Unknown tag " + str(tag))
+
+    def frame(self, frame):
+        reader = Reader(cobsDecode(frame))
+        header = reader.byte()
+        if header >> 4 != VERSION:
+            raise ValueError("Unknown version " + str(header >> 4))
+        level = header & 0xF
+
+        text = ""
+        if level != PIECE_LEVEL:
+            text = "[" + LEVELS[level] + "] " + self.interned(reader.varint()) + ": "
+        while not reader.done():
+            text += self.argument(reader)
+        # Pieces carry their own line endings
+        return text + ("\n" if level != PIECE_LEVEL else "")
+
+def decode(decoder, stream, out):
+    pending = b""
+    while True:
+        chunk = stream.read(1)
+        if not chunk:
+            break
+        pending += chunk
+        if chunk != b"\0":
+            continue
+
+        frame = pending[:-1]
+        pending = b""
+        if len(frame) == 0:
+            continue
+        try:
+            out.write(decoder.frame(frame))
+        except (ValueError, IndexError):
+            # Not a frame (ex: boot messages, SDK debug output)
+            out.write(frame.decode("utf-8", "replace"))
+        out.flush()
+
+if __name__ == "__main__":
+    if len(sys.argv) < 2:
+        print("Usage: decodeLogs.py <firmware.elf> [capture]", file=sys.stderr)
+        sys.exit(1)
+
+    with open(sys.argv[1], "rb") as elf:
+        decoder = Decoder(elf.read())
+    if len(sys.argv) > 2:
+        with open(sys.argv[2], "rb") as capture:
+            decode(decoder, capture, sys.stdout)
+    else:
+        decode(decoder, sys.stdin.buffer, sys.stdout)
@@ -6,11 +6,12 @@ import subprocess
 import inspect, os.path
 from os.path import join, realpath
 
-from preBuildCertificates import preBuildCertificates
+from preBuildCertificates import preBuildCertificates, preBuildPins
 from preBuildExampleFile import preBuildExampleFile
 
 filename = inspect.getframeinfo(inspect.currentframe()).filename
 dir_path = os.path.dirname(os.path.abspath(filename))
 
 preBuildExampleFile()
-preBuildCertificates(env)
\ No newline at end of file
+preBuildCertificates(env)
+preBuildPins(env)
\ No newline at end of file
@@ -8,6 +8,7 @@ import re
 import string
 import sys
 import hashlib
+import tempfile
 from shutil import which
 
 # Based on https://github.com/arduino/esp8266/blob/master/libraries/ESP8266WiFi/examples/BearSSL_CertStore/certs-from-mozilla.py
@@ -24,6 +25,9 @@ except Exception:
 
 from subprocess import Popen, PIPE, call
 
+# Mozilla's roots, once downloaded. The pinned chain is verified against them
+bundlePems = []
+
 def preBuildCertificates(env):
     filename = inspect.getframeinfo(inspect.currentframe()).filename
     dir_path = path.dirname(path.abspath(filename))
@@ -71,7 +75,8 @@ def preBuildCertificates(env):
             print("Connection failed, unable to get certificates and no cached version is available")
             return
     csvData = response.read()
-    csvHash = hashlib.sha256(csvData).hexdigest()
+    # The format version is part of the hash, so older headers are regenerated
+    csvHash = hashlib.sha256(csvData + b"sorted-index-v2").hexdigest()
 
     if sys.version_info[0] > 2:
         csvData = csvData.decode('utf-8')
@@ -84,6 +89,7 @@ def preBuildCertificates(env):
                 pems.append(item)
     del names[0]
     del pems[0]
+    bundlePems[:] = [pem.replace("'", "") for pem in pems]
 
     try:
         with open(dir_path + "/../include/generated/certificates.hpp") as generated:
@@ -109,83 +115,168 @@ def preBuildCertificates(env):
     f.write("// This file is computer generated at build time (`build/preBuildCertificates.py` called by PlatformIO)\n\n")
     f.write("// SHA256: " + str(csvHash) + "\n\n")
 
-    certFiles = []
-    totalbytes = 0
-    idx = 0
-    addflag = False
-
     # Process the text PEM using openssl into DER files
-    sizes=[]
+    entries = []
     for i in range(0, len(pems)):
-        certName = "ca_%03d" % (idx);
+        certName = "ca_%03d" % (i);
         thisPem = pems[i].replace("'", "")
 
         with open(certName + '.pem', "w", encoding="utf8") as pemfile:
             pemfile.write(thisPem)
 
-        f.write(("// " + re.sub(f'[^{re.escape(string.printable)}]', '', names[i]) + "\n"))
-
         with Popen(['openssl','x509','-inform','PEM','-outform','DER','-out', certName + '.der'], shell = False, stdin = PIPE) as ssl:
             ssl.stdin.write(thisPem.encode('utf-8'))
             ssl.stdin.close()
             ssl.wait()
 
         if path.exists(certName + '.der'):
-            certFiles.append(certName)
-
             with open(certName + '.der','rb') as der:
                 bytestr = der.read();
-                sizes.append(len(bytestr))
                 cert = Certificate.load(bytestr)
                 idxHash = hashlib.sha256(cert.issuer.dump()).digest()
-
-                f.write("static const uint8_t cert_" + str(idx) + "[] PROGMEM = {")
-                for j in range(0, len(bytestr)):
-                    totalbytes+=1
-                    f.write(hex(bytestr[j]))
-                    if j<len(bytestr)-1:
-                        f.write(", ")
-                f.write("};\n")
-
-                f.write("static const uint8_t idx_" + str(idx) + "[] PROGMEM = {")
-                for j in range(0, len(idxHash)):
-                    totalbytes+=1
-                    f.write(hex(idxHash[j]))
-                    if j<len(idxHash)-1:
-                        f.write(", ")
-                f.write("};\n\n")
-
-            idx = idx + 1
+                entries.append((idxHash, names[i], bytestr))
             unlink(certName + '.der')
         unlink(certName + '.pem')
 
+    # Sorted by hash, so `CertList::find` can binary search. Stable, so equal
+    # hashes keep Mozilla's order
+    entries.sort(key=lambda entry: entry[0])
+
+    for idx, (idxHash, name, bytestr) in enumerate(entries):
+        f.write(("// " + re.sub(f'[^{re.escape(string.printable)}]', '', name) + "\n"))
+        f.write("static const uint8_t cert_" + str(idx) + "[] PROGMEM = {")
+        f.write(", ".join(hex(byte) for byte in bytestr))
+        f.write("};\n")
+
+        f.write("static const uint8_t idx_" + str(idx) + "[] PROGMEM = {")
+        f.write(", ".join(hex(byte) for byte in idxHash))
+        f.write("};\n\n")
+
+    idx = len(entries)
     f.write("static const uint16_t numberOfCertificates PROGMEM = " + str(idx) + ";\n\n")
 
     f.write("static const uint16_t certSizes[] PROGMEM = {")
-    for i in range(0, idx):
-        f.write(str(sizes[i]))
-        if i<idx-1:
-            f.write(", ")
+    f.write(", ".join(str(len(entry[2])) for entry in entries))
     f.write("};\n\n")
 
     f.write("static const uint8_t* const certificates[] PROGMEM = {")
-    for i in range(0, idx):
-        f.write("cert_" + str(i))
-        if i<idx-1:
-            f.write(", ")
+    f.write(", ".join("cert_" + str(i) for i in range(0, idx)))
     f.write("};\n\n")
 
     f.write("static const uint8_t* const indexes[] PROGMEM = {")
-    for i in range(0, idx):
-        f.write("idx_" + str(i))
-        if i<idx-1:
-            f.write(", ")
+    f.write(", ".join("idx_" + str(i) for i in range(0, idx)))
+    f.write("};\n\n")
+
+    # First certificate whose hash starts with each byte, the last is the count
+    buckets = []
+    for byte in range(0, 256):
+        buckets.append(next((i for i, entry in enumerate(entries) if entry[0][0] >= byte), idx))
+    buckets.append(idx)
+    f.write("static const uint16_t buckets[] PROGMEM = {")
+    f.write(", ".join(str(bucket) for bucket in buckets))
     f.write("};\n\n")
-    f.write("static const iop::CertList certList(certificates, indexes, certSizes, numberOfCertificates);\n")
+    f.write("static const iop::CertList certList(certificates, indexes, certSizes, buckets, numberOfCertificates);\n")
     f.write("} // namespace generated\n")
     f.write("\n#endif" + "\n")
 
     f.close()
 
+def writePins(dir_path, host, ders):
+    f = open(dir_path + "/../include/generated/pins.hpp", "w", encoding="utf8")
+    f.write("#ifndef IOP_PINS_H\n")
+    f.write("#define IOP_PINS_H\n\n")
+    f.write("#include <stdint.h>\n\n")
+    f.write("namespace generated {\n\n")
+    f.write("// This file is computer generated at build time (`build/preBuildCertificates.py` called by PlatformIO)\n\n")
+    f.write("// Host: " + host + "\n\n")
+    for idx, der in enumerate(ders):
+        f.write("// Certificate SHA256: " + hashlib.sha256(der).hexdigest() + "\n")
+        f.write("static const uint8_t pin_" + str(idx) + "[] PROGMEM = {")
+        f.write(", ".join(hex(byte) for byte in der))
+        f.write("};\n")
+    # None disables pinning, only the certificate chain is validated
+    f.write("static const uint8_t numberOfPins = " + str(len(ders)) + ";\n")
+    f.write("static const uint16_t pinSizes[] PROGMEM = {")
+    f.write(", ".join(str(len(der)) for der in ders) if len(ders) > 0 else "0")
+    f.write("};\n")
+    f.write("static const uint8_t* const pins[] PROGMEM = {")
+    f.write(", ".join("pin_" + str(i) for i in range(0, len(ders))) if len(ders) > 0 else "nullptr")
+    f.write("};\n")
+    f.write("} // namespace generated\n")
+    f.write("\n#endif" + "\n")
+    f.close()
+
+# Pins the issuers of the monitor server's certificate (`config::uri()`), so
+# handshakes don't look the chain up in the whole bundle. Its own key isn't
+# pinned, it changes every time the certificate is renewed. The chain is only
+# trusted if it's valid for the host, according to Mozilla's roots
+def preBuildPins(env):
+    filename = inspect.getframeinfo(inspect.currentframe()).filename
+    dir_path = path.dirname(path.abspath(filename))
+
+    try: mkdir(dir_path + "/../include/generated/")
+    except FileExistsError: pass
+
+    config = dir_path + "/../include/configuration.hpp"
+    if not path.isfile(config):
+        config = dir_path + "/../include/configuration.hpp.example"
+    with open(config, encoding="utf8") as configuration:
+        found = re.search(r'"https://([^:/"]+)(?::([0-9]+))?', configuration.read())
+    if found is None:
+        print("Monitor server doesn't use https, nothing to pin")
+        writePins(dir_path, "", [])
+        return
+    host = found.group(1) + ":" + (found.group(2) or "443")
+
+    try:
+        with open(dir_path + "/../include/generated/pins.hpp", encoding="utf8") as generated:
+            cached = "// Host: " + host + "\n" in generated.read()
+    except FileNotFoundError:
+        cached = False
+
+    if which('openssl') is None and not path.isfile('./openssl') and not path.isfile('./openssl.exe'):
+        raise Exception("You need to have openssl in PATH, installable from https://www.openssl.org/")
+
+    # Without a fresh download openssl's own roots are used
+    command = ['openssl', 's_client', '-connect', host, '-servername', found.group(1), '-showcerts',
+               '-verify_return_error', '-verify_hostname', found.group(1)]
+    bundle = None
+    if len(bundlePems) > 0:
+        bundle = tempfile.NamedTemporaryFile("w", suffix = ".pem", delete = False, encoding = "utf8")
+        bundle.write("\n".join(bundlePems))
+        bundle.close()
+        command += ['-CAfile', bundle.name]
+
+    ders = None
+    try:
+        with Popen(command, shell = False, stdin = PIPE, stdout = PIPE, stderr = PIPE) as client:
+            output = client.communicate(input = b"", timeout = 30)[0].decode("utf-8", "replace")
+        if client.returncode != 0 or "Verify return code: 0 (ok)" not in output:
+            raise Exception("certificate chain is invalid for the host")
+
+        # The server's certificate comes first, followed by its issuers
+        ders = []
+        for pem in re.findall(r'-----BEGIN CERTIFICATE-----.+?-----END CERTIFICATE-----', output, re.DOTALL)[1:]:
+            with Popen(['openssl', 'x509', '-inform', 'PEM', '-outform', 'DER'], shell = False, stdin = PIPE, stdout = PIPE, stderr = PIPE) as x509:
+                ders.append(x509.communicate(input = pem.encode("utf-8"), timeout = 30)[0])
+    except Exception as error:
+        print("Unable to fetch the certificate chain of " + host + ": " + str(error))
+    finally:
+        if bundle is not None:
+            unlink(bundle.name)
+
+    if ders is None:
+        if cached:
+            print("Unable to verify " + host + ", using cached pins")
+            return
+        print("Unable to verify " + host + ", the certificate chain will be validated")
+        ders = []
+    elif len(ders) == 0:
+        print("Server " + host + " doesn't send its issuers, the certificate chain will be validated")
+    else:
+        print("Pinning " + str(len(ders)) + " issuer(s) of " + host)
+    writePins(dir_path, host, ders)
+
 if __name__ == "__main__":
     preBuildCertificates(None)
+    preBuildPins(None)
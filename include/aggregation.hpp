@@ -0,0 +1,76 @@
+#ifndef IOP_AGGREGATION_HPP
+#define IOP_AGGREGATION_HPP
+
+#include "utils.hpp"
+#include <vector>
+
+/// Statistics of a stream of samples in constant memory, using Welford's
+/// algorithm, so the variance doesn't suffer from catastrophic cancellation.
+///
+/// NaN samples (sensor failures) are counted apart and don't affect the
+/// statistics.
+class RunningStats {
+  uint32_t count_;
+  uint32_t failures_;
+  double mean_;
+  double m2;
+  float min_;
+  float max_;
+
+public:
+  RunningStats() noexcept;
+
+  void add(float sample) noexcept;
+  void reset() noexcept;
+
+  auto count() const noexcept -> uint32_t { return this->count_; }
+  auto failures() const noexcept -> uint32_t { return this->failures_; }
+  /// NaN if there are no samples (same for min and max)
+  auto mean() const noexcept -> float;
+  auto min() const noexcept -> float;
+  auto max() const noexcept -> float;
+  /// Sample standard deviation, zero if there is less than two samples
+  auto stddev() const noexcept -> float;
+};
+
+/// Window statistics of a single sensor
+struct ReadingSummary {
+  Measure measure;
+  uint8_t sensor;
+  float min;
+  float max;
+  float mean;
+  float stddev;
+  uint32_t count;
+};
+
+/// Summary of every sensor sampled in a window
+class Summary {
+public:
+  std::vector<ReadingSummary> readings;
+
+  auto empty() const noexcept -> bool { return this->readings.empty(); }
+  /// Keeps only the means, to fit a fixed flash slot. Readings past
+  /// `maxEventReadings` are dropped
+  auto toEvent() const noexcept -> Event;
+};
+
+/// Oversampling stage between the sensors and the uploads. Sensors are
+/// sampled many times per window, but only a summary of it is reported.
+class Aggregator {
+  struct Entry {
+    Measure measure;
+    uint8_t sensor;
+    RunningStats stats;
+  };
+  std::vector<Entry> entries;
+
+public:
+  Aggregator() noexcept : entries() { IOP_TRACE(); }
+
+  void add(const Reading &reading) noexcept;
+  /// Summary of the samples since the last call, starts a new window
+  auto take() noexcept -> Summary;
+};
+
+#endif
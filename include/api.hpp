@@ -3,9 +3,21 @@
 
 #include "core/log.hpp"
 #include "core/network.hpp"
+#include "aggregation.hpp"
 #include "utils.hpp"
 
 #include <ArduinoJson.h>
+#include <vector>
+
+/// What happened to each event of a `registerEvents` batch
+enum class EventStatus {
+  /// Stored by the server
+  DELIVERED,
+  /// Server is overloaded or broken (429, 503, 5xx), send it again later
+  RETRY,
+  /// Refused for good (other 4xx). Sending it again won't help
+  REJECTED,
+};
 
 /// High level client, that abstracts IoP API access in a safe and ergonomic way
 ///
@@ -26,21 +38,21 @@ public:
   auto loggerLevel() const noexcept -> iop::LogLevel;
   auto network() const noexcept -> const iop::Network &;
 
-  /// Sends a log message through the network, currently needs a buffer.
-  /// Streaming is a TODO.
+  /// Reports a panic to the server. Asynchronous, poll the request until
+  /// it's finished. Possible statuses:
   ///
-  /// OK: success, this won't be triggered because success returns AuthToken
+  /// OK: success
   /// FORBIDDEN: auth token is invalid
   /// CONNECTION_ISSUES: problems with connection, retry later?
   /// CLIENT_BUFFER_OVERFLOW: this route shouldn't trigger this, ever
   /// BROKEN_SERVER: just wait until server is fixed
   auto reportPanic(const AuthToken &authToken,
-                   const PanicData &event) const noexcept -> iop::NetworkStatus;
+                   const PanicData &event) const noexcept -> iop::PendingRequest;
 
   /// Register frequent event to server, with measurements and device
-  /// information
+  /// information. Asynchronous, poll the request until it's finished
   ///
-  /// Possible responses:
+  /// Possible statuses:
   ///
   /// OK: success
   /// FORBIDDEN: auth token is invalid
@@ -49,7 +61,36 @@ public:
   /// MUST_UPGRADE: Well, upgrade your code
   /// BROKEN_SERVER: Must wait until server is fixed
   auto registerEvent(const AuthToken &token, const Event &event) const noexcept
-      -> iop::NetworkStatus;
+      -> iop::PendingRequest;
+
+  /// Register the summary of a reporting window, with the statistics of
+  /// each sensor. Asynchronous, same statuses as `registerEvent`, except
+  /// CLIENT_BUFFER_OVERFLOW: the statistics don't fit the json document
+  auto registerSummary(const AuthToken &token, const Summary &summary) const noexcept
+      -> iop::PendingRequest;
+
+  /// Register many events in a single request, in order. Use
+  /// `eventBatchSize` to choose how many to send at once. Asynchronous, poll
+  /// the request until it's finished, its statuses have the same meanings as
+  /// `registerEvent`.
+  ///
+  /// If it finished OK each event got its own status (in the same order), read
+  /// them with `eventStatuses`. Rejected events should be dropped, or they
+  /// will be refused forever.
+  ///
+  /// Sent delta encoded (`EventCodec`) if the server supports it. If the
+  /// batch doesn't fit the heap right now it's CONNECTION_ISSUES, retry later.
+  auto registerEvents(const AuthToken &token,
+                      const std::vector<Event> &events) const noexcept
+      -> iop::PendingRequest;
+  /// Status of each of the `count` events of the last `registerEvents`, once
+  /// it finished OK. BROKEN_SERVER if the answer doesn't make sense
+  auto eventStatuses(size_t count) const noexcept
+      -> std::variant<std::vector<EventStatus>, iop::NetworkStatus>;
+
+  /// How many events fit in a `registerEvents` request, considering the
+  /// biggest heap block available right now
+  auto eventBatchSize() const noexcept -> uint16_t;
 
   /// Tries to authenticate with the server getting AuthToken if succeeded
   ///
@@ -62,15 +103,16 @@ public:
                     std::string_view password) const noexcept
       -> std::variant<AuthToken, iop::NetworkStatus>;
 
-  /// Reports panicHandler message to server. Possible responses:
+  /// Sends a log message through the network. Asynchronous, poll the request
+  /// until it's finished. Possible statuses:
   ///
-  /// OK: panicHandler successfully reported
+  /// OK: log successfully reported
   /// FORBIDDEN: auth token is invalid
   /// CONNECTION_ISSUES: problems with connection, retry later?
   /// CLIENT_BUFFER_OVERFLOW: something is very broken with this method's code
   /// BROKEN_SERVER: must wait until server is fixeds
   auto registerLog(const AuthToken &authToken,
-                   std::string_view log) const noexcept -> iop::NetworkStatus;
+                   std::string_view log) const noexcept -> iop::PendingRequest;
 
   /// Tries to update. Restarts on success. Returns OK if no updates are
   /// available
@@ -92,18 +134,41 @@ public:
   auto upgrade(const AuthToken &token) const noexcept
       -> iop::NetworkStatus;
 
+  /// Fills json object with the event's fields. Public to allow benchmarking
+  /// the wire formats
+  static void fillEvent(JsonObject obj, const Event &event) noexcept;
+  /// Json document capacity needed by `fillEvent`
+  static auto eventJsonSize(const Event &event) noexcept -> size_t;
+  /// Classifies the HTTP status code the server gave to one event of a batch
+  static auto eventStatus(int code) noexcept -> EventStatus;
+  /// Fills json object with one object of statistics per sensor
+  static void fillSummary(JsonObject obj, const Summary &summary) noexcept;
+
 private:
   using JsonCallback = std::function<void(JsonDocument &)>;
 
-  /// Abstracs safe json serialization. Returns None on overflow
+  /// Abstracs safe payload serialization, as JSON or MessagePack. Returns
+  /// None on overflow
   ///
-  /// Overflows will mean the json couldn't be generated fitting the SIZE
-  /// provided. This is a critical error and probably will break the system
+  /// Overflows will mean the document couldn't fit in 1024 bytes. This is a
+  /// critical error and probably will break the system. Strings set as
+  /// `const char *` are linked, not copied, so they don't count.
   ///
-  /// Gets a name for logging. And a callback that actually fills the json
-  auto makeJson(const iop::StaticString name,
-                const JsonCallback &func) const noexcept
-      -> std::optional<std::reference_wrapper<std::array<char, 1024>>>;
+  /// Gets a name for logging. And a callback that actually fills the json.
+  /// The body is serialized from a shared document while it's being sent,
+  /// it's invalidated by the next call
+  auto makePayload(const iop::StaticString name, const JsonCallback &func,
+                   iop::ContentType type) const noexcept
+      -> std::optional<iop::BodyStream>;
+
+  /// With IOP_MOCK_MONITOR the request is waited for, then pretends it
+  /// succeeded. Otherwise it's returned as is
+  auto mockIfNeeded(iop::PendingRequest request) const noexcept -> iop::PendingRequest;
+
+  /// Posts an encoded batch of events, the status of each is stored for
+  /// `eventStatuses`
+  auto sendEvents(const AuthToken &token, iop::BodyStream body,
+                  iop::ContentType type) const noexcept -> iop::PendingRequest;
 public:
   ~Api() noexcept;
   Api(Api const &other);
@@ -0,0 +1,52 @@
+#ifndef IOP_CODEC_HPP
+#define IOP_CODEC_HPP
+
+#include "utils.hpp"
+#include <optional>
+#include <vector>
+
+/// Smallest difference each field is able to represent once encoded.
+/// Anything finer than that is rounded away
+struct EventResolution {
+  float airTemperatureCelsius;
+  float airHumidityPercentage;
+  float airHeatIndexCelsius;
+  uint16_t soilResistivityRaw;
+  float soilTemperatureCelsius;
+};
+
+/// Compact encoding for batches of events (`application/vnd.iop.events`).
+///
+/// Consecutive measurements barely change, so each reading is quantized to
+/// the resolution of its measure and only the difference to the previous
+/// reading of the same sensor is stored, as a zigzag varint (mostly a single
+/// byte). The first reading of each sensor in a batch is a keyframe (delta
+/// from zero), so batches decode on their own.
+///
+/// Layout (all integers are unsigned LEB128 varints):
+///   version, event count, resolution of each `Measure` in thousandths,
+///   then for each event: reading count, and for each reading its key
+///   (a byte: `Measure` in the high nibble, sensor in the low) and delta
+///
+/// NaN (sensor failure) is preserved.
+class EventCodec {
+  EventResolution resolution_;
+
+public:
+  static constexpr uint8_t version = 2;
+
+  /// 0.1 for the floats and raw resistivity as is, that's all the precision
+  /// our sensors have
+  static auto defaultResolution() noexcept -> EventResolution;
+
+  explicit EventCodec(EventResolution resolution = EventCodec::defaultResolution()) noexcept;
+
+  auto resolution() const noexcept -> const EventResolution & { return this->resolution_; }
+
+  auto encode(const std::vector<Event> &events) const noexcept -> std::vector<uint8_t>;
+  /// Resolution is read from the payload. None if it's malformed
+  static auto decode(const uint8_t *data, size_t length) noexcept
+      -> std::optional<std::vector<Event>>;
+};
+
+#endif
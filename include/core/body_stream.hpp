@@ -0,0 +1,144 @@
+#ifndef IOP_CORE_BODY_STREAM_HPP
+#define IOP_CORE_BODY_STREAM_HPP
+
+#include "driver/client.hpp"
+#include <array>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace iop {
+
+/// Receives every byte serialized, but only keeps the ones that fall inside
+/// the window. Bytes before it are skipped and the ones after it are dropped.
+///
+/// Compatible with ArduinoJson's custom writers (`serializeJson(doc, writer)`)
+class WindowWriter {
+  uint8_t *out;
+  size_t begin;
+  size_t end;
+  size_t position;
+
+public:
+  WindowWriter(uint8_t *out, size_t begin, size_t length) noexcept;
+
+  auto write(uint8_t byte) noexcept -> size_t;
+  auto write(const uint8_t *buffer, size_t length) noexcept -> size_t;
+  /// Bytes copied to the window so far
+  auto written() const noexcept -> size_t;
+};
+
+/// Request body that is serialized on demand, straight into the connection.
+/// So the payload is never stored in full, and isn't capped by a buffer size.
+///
+/// The size must be known beforehand (measured with a dry run), so
+/// Content-Length can be sent. The serializer is called once per chunk read
+/// and must produce the exact same bytes every time. So a body of N chunks
+/// costs N full serializations, quadratic on its size, use `buffer` when the
+/// heap can afford it.
+class BodyStream : public Stream {
+public:
+  using Serializer = std::function<void(WindowWriter &)>;
+
+private:
+  Serializer serializer;
+  size_t size_;
+  size_t position;
+  /// The serializer only copies from memory, see `buffer`
+  bool stored;
+
+  // Used by byte oriented reads, so we don't serialize everything per byte
+  std::array<uint8_t, 64> cache;
+  size_t cacheStart;
+  size_t cacheLength;
+
+public:
+  BodyStream(Serializer serializer, size_t size) noexcept;
+  /// Body that is already stored somewhere, the view must outlive the stream
+  static auto fromView(std::string_view data) noexcept -> BodyStream;
+  /// Serializes the whole body into memory owned by the returned stream. For
+  /// requests that outlive what the serializer refers to (ex: asynchronous)
+  auto detach() noexcept -> BodyStream;
+  /// Serializes the whole body once, into memory owned by the stream, if it
+  /// has at most `limit` bytes. Reads then copy from it. Returns false if it
+  /// doesn't fit, and the body keeps being serialized per chunk
+  auto buffer(size_t limit) noexcept -> bool;
+
+  auto size() const noexcept -> size_t { return this->size_; }
+  /// Starts over, so the body can be sent again (ex: in a new connection)
+  void rewind() noexcept;
+
+  auto available() -> int override;
+  auto read() -> int override;
+  auto peek() -> int override;
+  auto read(uint8_t *buffer, size_t length) -> int override;
+  auto readBytes(char *buffer, size_t length) -> size_t override;
+  /// Read only stream, writes are ignored
+  auto write(uint8_t byte) -> size_t override;
+  auto write(const uint8_t *buffer, size_t length) -> size_t override;
+
+  ~BodyStream() noexcept override = default;
+  BodyStream(BodyStream const &other) = default;
+  BodyStream(BodyStream &&other) = default;
+  auto operator=(BodyStream const &other) -> BodyStream & = default;
+  auto operator=(BodyStream &&other) -> BodyStream & = default;
+};
+/// Receives a response body while it's read from the connection, so it's
+/// never stored in between. Returning false refuses it (ex: it doesn't fit)
+using PayloadSink = std::function<bool(std::string_view)>;
+
+/// Response body stored in caller supplied memory. Bodies that don't fit are
+/// refused while they are read, instead of after
+class PayloadBuffer {
+  char *data;
+  size_t capacity;
+  size_t length_;
+
+public:
+  PayloadBuffer(char *data, size_t capacity) noexcept;
+  template <size_t SIZE>
+  explicit PayloadBuffer(std::array<char, SIZE> &storage) noexcept
+      : PayloadBuffer(storage.data(), storage.size()) {}
+
+  /// Appends to the buffer. Must not outlive it
+  auto sink() noexcept -> PayloadSink;
+  auto view() const noexcept -> std::string_view;
+  auto length() const noexcept -> size_t { return this->length_; }
+};
+
+/// Write only stream that forwards the response body to a sink, refusing it
+/// past the limit. Without a sink the body is discarded, but still read, so
+/// the connection can be reused
+class PayloadStream : public Stream {
+  PayloadSink sink;
+  size_t limit;
+  size_t length_;
+  bool refused_;
+
+public:
+  PayloadStream(PayloadSink sink, size_t limit) noexcept;
+
+  /// Bytes accepted
+  auto length() const noexcept -> size_t { return this->length_; }
+  /// If the body went over the limit, or the sink refused it
+  auto refused() const noexcept -> bool { return this->refused_; }
+
+  auto write(uint8_t byte) -> size_t override;
+  auto write(const uint8_t *buffer, size_t length) -> size_t override;
+  /// Write only stream, there is nothing to read
+  auto available() -> int override;
+  auto read() -> int override;
+  auto peek() -> int override;
+  auto read(uint8_t *buffer, size_t length) -> int override;
+  auto readBytes(char *buffer, size_t length) -> size_t override;
+
+  ~PayloadStream() noexcept override = default;
+  PayloadStream(PayloadStream const &other) = default;
+  PayloadStream(PayloadStream &&other) = default;
+  auto operator=(PayloadStream const &other) -> PayloadStream & = default;
+  auto operator=(PayloadStream &&other) -> PayloadStream & = default;
+};
+} // namespace iop
+
+#endif
@@ -1,7 +1,9 @@
 #ifndef IOP_CORE_CERTSTORE_HPP
 #define IOP_CORE_CERTSTORE_HPP
 
+#include <memory>
 #include <optional>
+#include <vector>
 #include "driver/cert_store.hpp"
 
 namespace iop {
@@ -31,6 +33,10 @@ struct Cert {
 /// Certificates Sizes and Hashes. With that the certificate storage can be
 /// installed and provide certificates as needed
 ///
+/// Certificates are sorted by hash at build time. A directory with the first
+/// certificate of each possible first byte (and the count at the end) narrows
+/// the binary search, so few hashes are read from flash per lookup
+///
 /// You won't have to instantiate your own CertList. This should be generated
 /// too.
 ///
@@ -44,14 +50,23 @@ class CertList {
   const uint16_t *sizes;
   const uint8_t *const *indexes;
   const uint8_t *const *certs;
+  const uint16_t *buckets;
   uint16_t numberOfCertificates;
 
 public:
+  /// One bucket per possible first byte of the hash, plus the end
+  constexpr static uint16_t bucketCount = 257;
+  constexpr static uint8_t hashSize = 32;
+
   CertList(const uint8_t *const *certs, const uint8_t *const *indexes,
-           const uint16_t *sizes, uint16_t numberOfCertificates) noexcept;
+           const uint16_t *sizes, const uint16_t *buckets,
+           uint16_t numberOfCertificates) noexcept;
 
   auto cert(uint16_t index) const noexcept -> Cert;
   auto count() const noexcept -> uint16_t;
+  /// First certificate with this hash (of its issuer DN), `hash` must have
+  /// `hashSize` bytes
+  auto find(const uint8_t *hash) const noexcept -> std::optional<Cert>;
 
   CertList(CertList const &other) noexcept = default;
   CertList(CertList &&other) noexcept;
@@ -60,26 +75,67 @@ public:
   ~CertList() noexcept = default;
 };
 
+/// Trust anchor cache counters, to measure hit rate and heap churn
+struct CertCacheStats {
+  uint32_t hits;
+  uint32_t misses;
+  uint32_t evictions;
+  /// Bytes decoded into the heap, and released from it. Estimated by the
+  /// certificates' sizes
+  uint32_t allocatedBytes;
+  uint32_t freedBytes;
+};
+
 /// TLS certificate storage using hardcoded certs. You must construct with the
 /// hardcoded certs. The certList should be generated together with the
 /// certificates. Check the (build/preBuildCertificates.py)
 ///
-/// Should be constructed in static. It's not copyable, nor movable.
+/// Decoded trust anchors are kept in a LRU cache, bounded in bytes, so
+/// handshakes with the same host don't parse the same root from flash again.
+/// Anchors in use by BearSSL are never evicted. The cache is dropped when the
+/// CertList changes, anchors still in use are freed once BearSSL is done
+///
+/// Should be constructed in static. It's not copyable.
 class CertStore : public BearSSL::CertStoreBase {
-  std::optional<BearSSL::X509List> x509;
+public:
+  /// Fits the usual root (or two), a bundle has ~150 of them
+  constexpr static size_t defaultCacheBytes = 3 * 1024;
+
+private:
+  struct CachedAnchor {
+    std::unique_ptr<BearSSL::X509List> x509;
+    const br_x509_trust_anchor *anchor;
+    uint16_t bytes;
+    uint8_t users;
+    /// From a previous CertList, freed once unused and never looked up
+    bool stale;
+  };
+
   CertList certList;
+  /// Most recently used first
+  std::vector<CachedAnchor> cache;
+  size_t cacheBytes;
+  size_t maxCacheBytes;
+  CertCacheStats stats_;
+
+  /// Frees unused stale anchors, then evicts unused anchors, from the least
+  /// recently used, until it fits
+  void trim() noexcept;
 
 public:
   explicit CertStore(CertList list) noexcept;
 
   CertStore(CertStore const &other) noexcept = delete;
-  CertStore(CertStore &&other) noexcept: x509(std::optional<BearSSL::X509List>()), certList(std::move(other.certList)) {}
+  CertStore(CertStore &&other) noexcept;
   auto operator=(CertStore const &other) noexcept -> CertStore & = delete;
-  auto operator=(CertStore &&other) noexcept -> CertStore & {
-    this->x509.reset();
-    this->certList = std::move(other.certList);
-    return *this;
-  }
+  auto operator=(CertStore &&other) noexcept -> CertStore &;
+
+  /// Replaces the certificates, decoded anchors are dropped (the ones in use
+  /// when BearSSL frees them)
+  void setCertList(CertList list) noexcept;
+  /// Zero decodes the anchor for every lookup
+  void setCacheSize(size_t bytes) noexcept;
+  auto cacheStats() const noexcept -> CertCacheStats { return this->stats_; }
 
   /// Called by libraries like HttpClient. Call `setCertList` before passing
   /// iop::CertStore to whiever lib is going to use it.
@@ -97,6 +153,25 @@ private:
       -> const br_x509_trust_anchor *;
   static void freeHashedTA(void *ctx, const br_x509_trust_anchor *ta);
 };
+
+/// Chooses what verifies the server's chain. Its own issuers, pinned at build
+/// time, are checked in milliseconds, while looking the chain up in the
+/// CertStore takes seconds. If the pinned issuers refuse the chain the server
+/// changed its CA, so the CertStore is used from then on (until reboot)
+class TrustSelector {
+  bool pinned_;
+
+public:
+  /// BearSSL's `BR_ERR_X509_OK`, its X509 validation errors are the 31 after it
+  constexpr static int x509Errors = 32;
+
+  explicit TrustSelector(bool pinned = false) noexcept : pinned_(pinned) {}
+  auto pinned() const noexcept -> bool { return this->pinned_; }
+  /// Called with the last BearSSL error when a new connection failed. True if
+  /// the pinned issuers refused the chain, so it just fell back to the
+  /// CertStore. Other failures (ex: network) say nothing about the chain
+  auto connectionFailed(int sslError) noexcept -> bool;
+};
 } // namespace iop
 
 #endif
@@ -0,0 +1,49 @@
+#ifndef IOP_CORE_HEADER_BLOCK_HPP
+#define IOP_CORE_HEADER_BLOCK_HPP
+
+#include <array>
+#include <optional>
+#include <string_view>
+
+namespace iop {
+
+/// Device state sent with every request, for performance monitoring
+struct Telemetry {
+  uint32_t freeStack;
+  uint32_t freeHeap;
+  uint32_t biggestFreeBlock;
+  uint32_t vcc;
+  uint32_t timeRunning;
+};
+
+/// Headers sent with every request, serialized in one reusable block:
+///
+/// VERSION: <md5 of the firmware>
+/// MAC_ADDRESS: <mac address>
+/// TELEMETRY: <8 hex digits per Telemetry field, in declaration order>
+///
+/// The constant ones are written once, at setup. The telemetry is fixed
+/// width, so it's rewritten in place for each request, without allocating.
+class HeaderBlock {
+public:
+  constexpr static size_t telemetryLength = 5 * 8;
+
+private:
+  std::array<char, 160> block;
+  size_t length;
+  size_t telemetryOffset;
+
+public:
+  HeaderBlock() noexcept;
+
+  void setup(std::string_view version, std::string_view macAddress) noexcept;
+  /// Rewrites the telemetry, returns the whole block
+  auto update(const Telemetry &telemetry) noexcept -> std::string_view;
+  auto view() const noexcept -> std::string_view;
+
+  /// Reads the TELEMETRY header value. None if it's malformed
+  static auto parseTelemetry(std::string_view value) noexcept -> std::optional<Telemetry>;
+};
+} // namespace iop
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef IOP_CORE_HTTP_PARSER_HPP
+#define IOP_CORE_HTTP_PARSER_HPP
+
+#include <array>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace iop {
+
+enum class ParserState {
+  STATUS_LINE,
+  HEADER_LINE,
+  /// Delimited by Content-Length
+  BODY,
+  /// Neither Content-Length nor chunked, ends when the connection closes
+  BODY_UNTIL_CLOSE,
+  CHUNK_SIZE,
+  CHUNK_DATA,
+  CHUNK_DATA_END,
+  TRAILER_LINE,
+  DONE,
+  FAILED,
+};
+
+/// Incremental HTTP/1.1 response parser. Input can be split anywhere, each
+/// byte is looked at once.
+///
+/// Body bytes are handed to the sink as views of the input, they are never
+/// copied. Only lines split between two reads are buffered (up to
+/// `maxLineLength`), and only the headers registered with `collect` are
+/// stored.
+class HttpParser {
+public:
+  /// Receives the body, in pieces. Returning false aborts the parsing
+  using BodySink = std::function<bool(std::string_view)>;
+  constexpr static size_t maxLineLength = 512;
+
+private:
+  ParserState state_;
+  BodySink sink;
+  std::vector<std::string> keys;
+  std::vector<std::optional<std::string>> values;
+
+  std::array<char, maxLineLength> line;
+  size_t lineLength;
+
+  uint16_t status_;
+  bool keepAlive_;
+  bool chunked;
+  std::optional<size_t> contentLength_;
+  size_t remaining;
+  size_t bodyLength_;
+
+  auto feedLine(std::string_view data, size_t &consumed) noexcept -> std::optional<std::string_view>;
+  void parseStatusLine(std::string_view line) noexcept;
+  void parseHeaderLine(std::string_view line) noexcept;
+  void parseChunkSize(std::string_view line) noexcept;
+  auto deliver(std::string_view body) noexcept -> bool;
+  auto feed(std::string_view data, bool headersOnly) noexcept -> size_t;
+
+public:
+  explicit HttpParser(BodySink sink) noexcept;
+
+  /// Only headers registered here are stored. Names are case insensitive
+  void collect(std::string_view key) noexcept;
+  /// Prepares for the next response, keeps the collected keys
+  void reset() noexcept;
+  void setSink(BodySink sink) noexcept;
+
+  /// Parses as much as possible, returns how many bytes were consumed. Stops
+  /// when the response is done, the rest belongs to the next response
+  auto feed(std::string_view data) noexcept -> size_t;
+  /// Like `feed`, but stops at the end of the headers. So the body can be
+  /// handed to a sink chosen after looking at them
+  auto feedHeaders(std::string_view data) noexcept -> size_t;
+  /// The connection was closed by the server
+  void finish() noexcept;
+
+  auto state() const noexcept -> ParserState { return this->state_; }
+  auto done() const noexcept -> bool { return this->state_ == ParserState::DONE; }
+  auto failed() const noexcept -> bool { return this->state_ == ParserState::FAILED; }
+  /// Status line and headers were parsed
+  auto headersDone() const noexcept -> bool {
+    return this->state_ != ParserState::STATUS_LINE &&
+           this->state_ != ParserState::HEADER_LINE &&
+           this->state_ != ParserState::FAILED;
+  }
+
+  auto status() const noexcept -> uint16_t { return this->status_; }
+  /// If the connection can be reused after this response
+  auto keepAlive() const noexcept -> bool { return this->keepAlive_; }
+  auto contentLength() const noexcept -> std::optional<size_t> { return this->contentLength_; }
+  /// Body bytes handed to the sink so far
+  auto bodyLength() const noexcept -> size_t { return this->bodyLength_; }
+  /// Value of a collected header, if it was in the response
+  auto header(std::string_view key) const noexcept -> std::optional<std::string_view>;
+};
+} // namespace iop
+
+#endif
@@ -2,6 +2,7 @@
 #define IOP_CORE_LOG_HPP
 
 #include "driver/log.hpp"
+#include "core/log_ring.hpp"
 #include <functional>
 
 #define IOP_FILE ::iop::StaticString(FPSTR(__FILE__))
@@ -33,6 +34,8 @@ public:
 
   using TraceViewPrinter = ViewPrinter;
   using TraceStaticPrinter = StaticPrinter;
+  /// Receives whole messages, instead of their pieces (ex: binary encoders)
+  using RecordPrinter = void (*) (LogLevel, StaticString target, const LogPart *parts, size_t count);
 
   ViewPrinter viewPrint;
   StaticPrinter staticPrint;
@@ -40,6 +43,8 @@ public:
   Flusher flush;
   TraceViewPrinter traceViewPrint;
   TraceStaticPrinter traceStaticPrint;
+  /// Optional, messages are printed in pieces without it
+  RecordPrinter record;
 
   /// Prints log to Serial.
   /// May be called from interrupt because it's the default tracing printer
@@ -57,7 +62,7 @@ public:
     : viewPrint(std::move(viewPrinter)), staticPrint(std::move(staticPrinter)),
       setup(std::move(setuper)), flush(std::move(flusher)),
       traceViewPrint(defaultViewPrinter),
-      traceStaticPrint(defaultStaticPrinter) {}
+      traceStaticPrint(defaultStaticPrinter), record(nullptr) {}
   // Specifies custom tracer funcs, may be called from interrupts (put it into
   // ICACHE_RAM). Don't be fancy, and be aware, it can saturate channels very
   // fast
@@ -69,7 +74,20 @@ public:
       : viewPrint(std::move(viewPrinter)), staticPrint(std::move(staticPrinter)),
         setup(std::move(setuper)), flush(std::move(flusher)),
         traceViewPrint(std::move(traceViewPrint)),
-        traceStaticPrint(std::move(traceStaticPrint)) {}
+        traceStaticPrint(std::move(traceStaticPrint)), record(nullptr) {}
+  // Whole messages are handed to the record printer, pieces printed outside
+  // of loggers (ex: tracing) still go to the other printers
+  constexpr LogHook(LogHook::ViewPrinter viewPrinter,
+                  LogHook::StaticPrinter staticPrinter, LogHook::Setuper setuper,
+                  LogHook::Flusher flusher,
+                  LogHook::TraceViewPrinter traceViewPrint,
+                  LogHook::TraceStaticPrinter traceStaticPrint,
+                  LogHook::RecordPrinter recordPrinter) noexcept
+      : viewPrint(std::move(viewPrinter)), staticPrint(std::move(staticPrinter)),
+        setup(std::move(setuper)), flush(std::move(flusher)),
+        traceViewPrint(std::move(traceViewPrint)),
+        traceStaticPrint(std::move(traceStaticPrint)),
+        record(std::move(recordPrinter)) {}
   ~LogHook() noexcept = default;
   LogHook(LogHook const &other) noexcept;
   LogHook(LogHook &&other) noexcept;
@@ -77,10 +95,6 @@ public:
   auto operator=(LogHook &&other) noexcept -> LogHook &;
 };
 
-static auto defaultLineTermination() -> StaticString {
-  return StaticString(F("\n"));
-}
-
 /// Logger with its own log level and target
 class Log {
   LogLevel level_;
@@ -90,8 +104,6 @@ public:
   Log(const LogLevel &level, StaticString target) noexcept
       : level_{level}, target_(std::move(target)) {}
 
-  static void shouldFlush(bool flush) noexcept;
-
   /// Replaces current hook for this. Very useful to support other logging
   /// channels, like network or flash. Default just prints to serial.
   ///
@@ -109,76 +121,48 @@ public:
   static auto isTracing() noexcept -> bool;
 
   template <typename... Args> void trace(const Args &...args) const noexcept {
-    this->log_recursive(LogLevel::TRACE, true, args...);
+    this->logParts(LogLevel::TRACE, args...);
   }
   template <typename... Args> void debug(const Args &...args) const noexcept {
-    this->log_recursive(LogLevel::DEBUG, true, args...);
+    this->logParts(LogLevel::DEBUG, args...);
   }
   template <typename... Args> void info(const Args &...args) const noexcept {
-    this->log_recursive(LogLevel::INFO, true, args...);
+    this->logParts(LogLevel::INFO, args...);
   }
   template <typename... Args> void warn(const Args &...args) const noexcept {
-    this->log_recursive(LogLevel::WARN, true, args...);
+    this->logParts(LogLevel::WARN, args...);
   }
   template <typename... Args> void error(const Args &...args) const noexcept {
-    this->log_recursive(LogLevel::ERROR, true, args...);
+    this->logParts(LogLevel::ERROR, args...);
   }
   template <typename... Args> void crit(const Args &...args) const noexcept {
-    this->log_recursive(LogLevel::CRIT, true, args...);
+    this->logParts(LogLevel::CRIT, args...);
   }
 
   static void print(StaticString progmem, LogLevel level,
                     LogType kind) noexcept;
   static void print(std::string_view view, LogLevel level, LogType kind) noexcept;
+  /// Writes buffered messages without blocking, returns how many bytes
+  static auto poll() noexcept -> size_t;
+  /// Blocks until every buffered message is written. It stalls, so it's only
+  /// for panics
   static void flush() noexcept;
   static void setup(LogLevel level) noexcept;
+  /// Messages dropped because the buffer was full
+  static auto dropped() noexcept -> uint32_t;
+  /// Buffers bytes for the serial as they are, for hooks that encode messages
+  /// themselves
+  static void write(std::string_view bytes) noexcept;
 
-  // "Recursive" variadic function
-  template <typename... Args>
-  void log_recursive(const LogLevel &level, const bool first,
-                     const StaticString msg,
-                     const Args &...args) const noexcept {
-    if (first) {
-      this->log(level, msg, LogType::START, F(""));
-    } else {
-      this->log(level, msg, LogType::CONTINUITY, F(""));
-    }
-    this->log_recursive(level, false, args...);
-  }
-
-  // Terminator
-  template <typename... Args>
-  void log_recursive(const LogLevel &level, const bool first,
-                     const StaticString msg) const noexcept {
-    if (first) {
-      this->log(level, msg, LogType::STARTEND, defaultLineTermination());
-    } else {
-      this->log(level, msg, LogType::END, defaultLineTermination());
-    }
-  }
-
-  // "Recursive" variadic function
-  template <typename... Args>
-  void log_recursive(const LogLevel &level, const bool first,
-                     const std::string_view msg, const Args &...args) const noexcept {
-    if (first) {
-      this->log(level, msg, LogType::START, F(""));
-    } else {
-      this->log(level, msg, LogType::CONTINUITY, F(""));
-    }
-    this->log_recursive(level, false, args...);
-  }
-
-  // Terminator
+  /// The whole message is buffered at once, so threads don't interleave
   template <typename... Args>
-  void log_recursive(const LogLevel &level, const bool first,
-                     const std::string_view msg) const noexcept {
-    if (first) {
-      this->log(level, msg, LogType::STARTEND, defaultLineTermination());
-    } else {
-      this->log(level, msg, LogType::END, defaultLineTermination());
-    }
+  void logParts(const LogLevel &level, const Args &...args) const noexcept {
+    if (this->level_ > level)
+      return;
+    const std::array<LogPart, sizeof...(Args)> parts = {LogPart(args)...};
+    this->log(level, parts.data(), parts.size());
   }
+  void log(const LogLevel &level, const LogPart *parts, size_t count) const noexcept;
 
   void printLogType(const LogType &logType,
                     const LogLevel &level) const noexcept;
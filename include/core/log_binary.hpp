@@ -0,0 +1,48 @@
+#ifndef IOP_CORE_LOG_BINARY_HPP
+#define IOP_CORE_LOG_BINARY_HPP
+
+#include "core/log.hpp"
+
+namespace iop {
+
+/// Compact binary log encoding (like defmt). Nothing is formatted on the
+/// device: constant strings (`F()`) are sent as their offset to an anchor in
+/// flash, the linker interns them. Numbers are sent as varints. The host
+/// reconstructs the text with `build/decodeLogs.py` and the firmware ELF.
+///
+/// Frames are COBS encoded, each one ends at a zero byte:
+///  - Header: `version << 4 | level`, or `pieceLevel` for text printed outside
+///    of loggers (ex: tracing), those have no target
+///  - Target: interned
+///  - Arguments: a `Tag` followed by its value
+///
+/// Install it with `Log::setHook(BinaryLog::hook())`, or define `IOP_BINARY_LOG`
+class BinaryLog {
+public:
+  constexpr static uint8_t version = 1;
+  constexpr static uint8_t pieceLevel = 0xF;
+  /// Longer strings are truncated to fit. It's less than 254 bytes, so COBS
+  /// adds a single byte
+  constexpr static size_t maxFrameSize = 192;
+
+  enum class Tag : uint8_t {
+    /// Zigzag varint offset of a PROGMEM string to the anchor
+    INTERNED,
+    /// Varint length, then the bytes
+    STRING,
+    UNSIGNED,
+    /// Zigzag varint
+    SIGNED,
+  };
+
+  /// Returns the size of the frame, zero terminator included. `out` must have
+  /// `maxFrameSize` bytes. Target is skipped if it's null
+  static auto encode(uint8_t header, const StaticString *target, const LogPart *parts,
+                     size_t count, uint8_t *out) noexcept -> size_t;
+  /// Interned strings are relative to it, decoders look for it in the ELF
+  static auto anchor() noexcept -> const char *;
+  static auto hook() noexcept -> LogHook;
+};
+} // namespace iop
+
+#endif
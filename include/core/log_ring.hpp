@@ -0,0 +1,108 @@
+#ifndef IOP_CORE_LOG_RING_HPP
+#define IOP_CORE_LOG_RING_HPP
+
+#include "core/string.hpp"
+
+#include <array>
+#include <atomic>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+namespace iop {
+
+/// Piece of a log message, text in RAM or in flash (PROGMEM), or a number. Numbers
+/// are only formatted when written as text
+struct LogPart {
+  enum class Kind : uint8_t { RAM, FLASH, UNSIGNED, SIGNED };
+  /// Enough for any 64 bits number
+  constexpr static size_t maxNumberLength = 21;
+
+  const char *data;
+  /// Text length, or the number itself
+  size_t length;
+  Kind kind;
+
+  LogPart() noexcept: data(""), length(0), kind(Kind::RAM) {}
+  // NOLINTNEXTLINE hicpp-explicit-conversions
+  LogPart(std::string_view view) noexcept: data(view.data()), length(view.length()), kind(Kind::RAM) {}
+  // NOLINTNEXTLINE hicpp-explicit-conversions
+  LogPart(const std::string &str) noexcept: data(str.data()), length(str.length()), kind(Kind::RAM) {}
+  // NOLINTNEXTLINE hicpp-explicit-conversions
+  LogPart(const char *str) noexcept: data(str), length(strlen(str)), kind(Kind::RAM) {}
+  // NOLINTNEXTLINE hicpp-explicit-conversions
+  LogPart(StaticString str) noexcept: data(str.asCharPtr()), length(str.length()), kind(Kind::FLASH) {}
+  // NOLINTNEXTLINE hicpp-explicit-conversions
+  LogPart(const __FlashStringHelper *str) noexcept: LogPart(StaticString(str)) {}
+  /// Numbers must fit in `length`, bigger ones need `std::to_string`
+  template <typename T, typename = std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, bool> && !std::is_same_v<T, char>>>
+  // NOLINTNEXTLINE hicpp-explicit-conversions
+  LogPart(const T number) noexcept
+      : data(nullptr), length(static_cast<size_t>(number)),
+        kind(std::is_signed_v<T> ? Kind::SIGNED : Kind::UNSIGNED) {
+    static_assert(sizeof(T) <= sizeof(size_t), "Number doesn't fit in a log part");
+  }
+
+  auto isNumber() const noexcept -> bool { return this->kind == Kind::UNSIGNED || this->kind == Kind::SIGNED; }
+  /// Length of the text, numbers included
+  auto textLength() const noexcept -> size_t;
+  /// Formats the number into `out`, that has `maxNumberLength` bytes
+  auto format(char *out) const noexcept -> size_t;
+};
+
+/// Fixed size buffer of log messages, written by any thread (or interrupt) and
+/// drained by one consumer at a time, without locks.
+///
+/// Each message is copied once, as a single record, so messages from different
+/// threads never interleave. Producers reserve space with a CAS and publish the
+/// record by storing its length, the consumer hands whole published records to
+/// the writer in order. When it's full new messages are dropped and counted,
+/// they never block
+class LogRing {
+public:
+  constexpr static size_t capacity = 2048;
+  /// Records start at slot boundaries, each slot has its published length
+  constexpr static size_t slotSize = 16;
+  constexpr static size_t slots = capacity / slotSize;
+  static_assert((capacity & (capacity - 1)) == 0, "Positions wrap around, capacity must be a power of two");
+
+  /// Writes what it can without blocking, returns how many bytes it wrote
+  using Writer = size_t (*) (std::string_view);
+
+private:
+  std::array<char, capacity> buffer;
+  /// Zero while the record that starts there is being written
+  std::array<std::atomic<uint16_t>, slots> lengths;
+  /// Positions grow forever (wrapping around), offsets are positions modulo capacity
+  std::atomic<uint32_t> reserved;
+  std::atomic<uint32_t> consumed;
+  /// Bytes of the oldest record already written, it may be partially written
+  size_t written;
+  std::atomic<bool> draining;
+  std::atomic<uint32_t> dropped_;
+
+  void copy(uint32_t position, const LogPart &part) noexcept;
+
+public:
+  LogRing() noexcept;
+
+  /// One record with all parts, false if it was dropped
+  auto push(const LogPart *parts, size_t count) noexcept -> bool;
+  auto push(std::string_view message) noexcept -> bool;
+  /// Hands published records to the writer until it stops accepting, returns
+  /// how many bytes it wrote. Returns zero if someone else is draining
+  auto drain(Writer writer) noexcept -> size_t;
+
+  auto isEmpty() const noexcept -> bool;
+  /// Messages that didn't fit
+  auto dropped() const noexcept -> uint32_t { return this->dropped_.load(std::memory_order_relaxed); }
+
+  ~LogRing() noexcept = default;
+  LogRing(LogRing const &other) noexcept = delete;
+  LogRing(LogRing &&other) noexcept = delete;
+  auto operator=(LogRing const &other) noexcept -> LogRing & = delete;
+  auto operator=(LogRing &&other) noexcept -> LogRing & = delete;
+};
+} // namespace iop
+
+#endif
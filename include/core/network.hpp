@@ -4,20 +4,98 @@
 #include <variant>
 #include <optional>
 #include <string>
+#include <functional>
 #include "driver/client.hpp"
+#include "driver/thread.hpp"
+#include "core/body_stream.hpp"
 #include "core/log.hpp"
+#include "core/retry.hpp"
 
 namespace iop {
 /// Higher level error reporting. Lower level is logged
 enum class NetworkStatus {
   CONNECTION_ISSUES,
   BROKEN_SERVER,
+  /// Server is shedding load (429 or 503), its endpoint is deferred for
+  /// `Network::retryAfter()`
+  THROTTLED,
   CLIENT_BUFFER_OVERFLOW, // BROKEN_CLIENT
 
   OK,
   FORBIDDEN,
 };
 
+/// Request body encodings. The server advertises binary support with the
+/// `ACCEPTED_CONTENT_TYPE` response header, JSON is always accepted
+enum class ContentType {
+  JSON,
+  MSGPACK,
+  /// Delta encoded event batches, see `EventCodec`
+  IOP_EVENTS,
+};
+
+/// Connection reuse counters, since boot. Each new connection costs a TCP
+/// handshake and, with TLS, a few seconds of BearSSL handshake
+struct NetworkStats {
+  uint32_t connections;
+  uint32_t requests;
+  /// Kept alive connections the server had closed, retried in a new one
+  uint32_t reconnections;
+  /// Failed requests sent again, after a backoff
+  uint32_t retries;
+  /// Requests failed without being sent, their endpoint was known to be down
+  uint32_t shortCircuits;
+  /// Responses asking the device to slow down
+  uint32_t throttled;
+};
+
+/// Phases of an asynchronous request, in order
+enum class RequestPhase {
+  CONNECT,
+  SEND,
+  AWAIT_HEADERS,
+  READ_BODY,
+  /// Failed, waiting to be sent again
+  BACKOFF,
+  DONE,
+};
+
+/// How long each phase of an asynchronous request may take, from when it
+/// starts, in milliseconds. Expired phases fail the request as a timeout
+struct RequestDeadlines {
+  esp_time connect;
+  esp_time send;
+  esp_time headers;
+  esp_time body;
+};
+
+/// Handle of an asynchronous request (see `Network::httpPostAsync`), polled
+/// by the event loop until it's finished. Only one request is in flight at a
+/// time, it owns the connection until it's finished or cancelled
+class PendingRequest {
+  uint32_t id;
+  std::optional<NetworkStatus> status_;
+  size_t payloadLength_;
+
+public:
+  explicit PendingRequest(uint32_t id) noexcept;
+  /// Nothing is sent, the outcome is already known (ex: serialization failed)
+  static auto finished(NetworkStatus status) noexcept -> PendingRequest;
+
+  auto phase() const noexcept -> RequestPhase;
+  /// Advances the request as far as it can without blocking. Returns the
+  /// status once it's finished, with the same meanings as `Response::status`
+  auto poll() noexcept -> std::optional<NetworkStatus>;
+  /// Polls until it's finished. Only for callers that can't return to the
+  /// event loop (ex: panics)
+  auto wait() noexcept -> NetworkStatus;
+  /// Drops the request, closing the connection. It finishes with
+  /// CONNECTION_ISSUES
+  void cancel() noexcept;
+  /// Bytes handed to the sink, once finished
+  auto payloadLength() const noexcept -> size_t { return this->payloadLength_; }
+};
+
 class Response;
 enum class RawStatus;
 enum class HttpMethod;
@@ -41,6 +119,8 @@ public:
 /// about http protocol
 ///
 /// MUST CALL `setCertStore` otherwise TLS won't work. It _will_ panic.
+/// `setPinnedIssuers` makes handshakes validate the chain with the server's
+/// own issuers, the CertStore is the fallback if the server changes its CA
 ///
 /// `setUpgradeHook` to monitor when the server offers upgrade
 ///
@@ -55,6 +135,12 @@ public:
   auto uri() const noexcept -> StaticString { return this->uri_; };
 
   static void setCertStore(CertStore &store) noexcept;
+  /// DER encoded issuers of the monitor server's certificate (intermediates
+  /// and root), in PROGMEM. Any of them may sign the chain, so renewing the
+  /// server's certificate doesn't break it. Check
+  /// `build/preBuildCertificates.py`. None disables pinning
+  static void setPinnedIssuers(const uint8_t *const *ders, const uint16_t *sizes,
+                               uint8_t count) noexcept;
 
   /// Replaces current hook for this. Very useful to support upgrades
   /// reported by the network (LAST_VERSION header different than current
@@ -68,17 +154,104 @@ public:
   static void disconnect() noexcept;
   static auto isConnected() noexcept -> bool;
 
+  /// Connections opened versus requests sent. The connection is kept alive
+  /// between requests, so they should be far apart
+  static auto stats() noexcept -> NetworkStats;
+
+  /// Most compact request body encoding the server has advertised (in any
+  /// response so far). Defaults to JSON
+  static auto acceptedContentType() noexcept -> ContentType;
+  /// If the server advertised (in any response so far) it understands this
+  /// encoding. JSON is always accepted
+  static auto isContentTypeAccepted(ContentType type) noexcept -> bool;
+  static auto contentTypeToString(ContentType type) noexcept -> StaticString;
+
+  /// If an asynchronous request is in flight. Synchronous requests are
+  /// refused meanwhile, they would share its connection
+  static auto isBusy() noexcept -> bool;
+  /// Drops the asynchronous request in flight, if any. For when nobody will
+  /// poll it anymore (ex: panics)
+  static void cancelPending() noexcept;
+
+  /// Replaces the retry policy, the default is `defaultRetryPolicy`
+  static void setRetryPolicy(RetryPolicy policy) noexcept;
+  /// Health of the endpoint, see `CircuitBreaker`
+  static auto circuitState(StaticString path) noexcept -> CircuitState;
+  /// How long the latest throttled response asked to wait
+  static auto retryAfter() noexcept -> esp_time;
+  /// Longer `Retry-After` values are capped at this
+  constexpr static esp_time maxRetryAfter = 60 * 60 * 1000;
+
+  /// Asynchronous requests are retried, synchronous ones only go through the
+  /// circuit breaker (their callers retry later)
+  constexpr static RetryPolicy defaultRetryPolicy = {
+      .attempts = 3,
+      .baseDelay = 1000,
+      .maxDelay = 30 * 1000,
+      .failureThreshold = 5,
+      .openFor = 60 * 1000,
+  };
+
+  constexpr static RequestDeadlines defaultDeadlines = {
+      .connect = 10 * 1000,
+      .send = 10 * 1000,
+      .headers = 30 * 1000,
+      .body = 30 * 1000,
+  };
+
   auto httpPost(std::string_view token, StaticString path,
-                std::string_view data) const noexcept
+                std::string_view data, ContentType type) const noexcept
       -> std::variant<Response, int> const &;
-  auto httpPost(StaticString path, std::string_view data) const noexcept
+  /// Body is serialized once if it fits half of the biggest heap block,
+  /// otherwise while it's sent, so it doesn't need to fit in memory.
+  ///
+  /// The response body is streamed into the sink as it's read, without the
+  /// sink it's discarded
+  auto httpPost(std::string_view token, StaticString path,
+                BodyStream &body, ContentType type,
+                PayloadSink sink = PayloadSink()) const noexcept
       -> std::variant<Response, int> const &;
+  auto httpPost(StaticString path, BodyStream &body,
+                PayloadSink sink = PayloadSink()) const noexcept
+      -> std::variant<Response, int> const &;
+
+  /// Starts a request that is advanced by polling the returned handle, so the
+  /// caller isn't blocked while it waits for the network. Refused with
+  /// CONNECTION_ISSUES if a request is already in flight, or if the
+  /// endpoint's circuit is open.
+  ///
+  /// Except to connect: opening a connection (and its TLS handshake) blocks,
+  /// up to the connect deadline. Reused connections skip it.
+  ///
+  /// Head and body are serialized before it returns, into a single heap
+  /// buffer held until it's finished (so the body may refer to the caller's
+  /// memory). Requests bigger than half the biggest heap block are refused
+  /// with CONNECTION_ISSUES.
+  ///
+  /// CONNECTION_ISSUES and BROKEN_SERVER are retried after a backoff, while
+  /// the retry budget lasts. Unless part of the response body already
+  /// reached the sink
+  auto httpPostAsync(std::string_view token, StaticString path, BodyStream body,
+                     ContentType type, PayloadSink sink = PayloadSink(),
+                     RequestDeadlines deadlines = defaultDeadlines) const noexcept
+      -> PendingRequest;
 
   auto httpRequest(HttpMethod method, const std::optional<std::string_view> &token,
                    StaticString path,
-                   const std::optional<std::string_view> &data) const noexcept
+                   std::optional<std::reference_wrapper<BodyStream>> body,
+                   ContentType type, PayloadSink sink) const noexcept
+      -> std::variant<Response, int> const &;
+
+private:
+  /// `httpRequest` without the circuit breaker
+  auto attemptRequest(HttpMethod method, const std::optional<std::string_view> &token,
+                      StaticString path,
+                      std::optional<std::reference_wrapper<BodyStream>> body,
+                      ContentType type, PayloadSink sink) const noexcept
       -> std::variant<Response, int> const &;
 
+public:
+
   static auto rawStatusToString(const RawStatus &status) noexcept
       -> StaticString;
   auto rawStatus(int code) const noexcept -> RawStatus;
@@ -95,13 +268,15 @@ public:
   auto operator=(Network &&other) -> Network & = delete;
 };
 
+/// The payload isn't stored here, it was streamed into the request's sink
 class Response {
 public:
-  std::optional<std::string> payload;
+  /// Bytes handed to the sink
+  size_t payloadLength;
   NetworkStatus status;
   ~Response() noexcept;
   explicit Response(const NetworkStatus &status) noexcept;
-  Response(const NetworkStatus &status, std::string payload) noexcept;
+  Response(const NetworkStatus &status, size_t payloadLength) noexcept;
   Response(Response &resp) noexcept = delete;
   Response(Response &&resp) noexcept;
   auto operator=(Response &resp) noexcept -> Response & = delete;
@@ -131,6 +306,8 @@ enum class RawStatus {
   OK = HTTP_CODE_OK,
   SERVER_ERROR = HTTP_CODE_INTERNAL_SERVER_ERROR,
   FORBIDDEN = HTTP_CODE_FORBIDDEN,
+  TOO_MANY_REQUESTS = HTTP_CODE_TOO_MANY_REQUESTS,
+  SERVICE_UNAVAILABLE = HTTP_CODE_SERVICE_UNAVAILABLE,
 
   UNKNOWN = 999
 };
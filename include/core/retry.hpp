@@ -0,0 +1,89 @@
+#ifndef IOP_CORE_RETRY_HPP
+#define IOP_CORE_RETRY_HPP
+
+#include "driver/thread.hpp"
+#include <optional>
+#include <stdint.h>
+#include <string_view>
+
+namespace iop {
+
+/// Xorshift generator, good enough to spread retries. Seed it per device (ex:
+/// with its MAC address), so devices don't draw the same delays
+class Random {
+  uint32_t state;
+
+public:
+  explicit Random(uint32_t seed) noexcept;
+
+  auto next() noexcept -> uint32_t;
+  /// Uniform in [0, bound]
+  auto upTo(uint32_t bound) noexcept -> uint32_t;
+};
+
+/// How failed requests are retried, and when an endpoint is considered down
+struct RetryPolicy {
+  /// Attempts per request, including the first
+  uint8_t attempts;
+  /// Cap of the first retry delay, doubles per retry up to `maxDelay`
+  esp_time baseDelay;
+  esp_time maxDelay;
+  /// Consecutive failures of an endpoint that open its circuit
+  uint8_t failureThreshold;
+  /// How long an open circuit short-circuits requests, then one is let
+  /// through to probe the server
+  esp_time openFor;
+};
+
+/// Exponential backoff with full jitter: uniform in [0, min(maxDelay,
+/// baseDelay * 2^retry)]. Clients that failed together don't retry together,
+/// so a server that just came back isn't hit by the whole fleet at once
+auto backoffDelay(const RetryPolicy &policy, uint8_t retry, Random &random) noexcept -> esp_time;
+
+/// Milliseconds asked by a `Retry-After` header, capped at `max`. Only the
+/// delay in seconds is understood, there may be no clock to compare an
+/// HTTP-date against
+auto parseRetryAfter(std::string_view value, esp_time max) noexcept -> std::optional<esp_time>;
+
+enum class CircuitState {
+  /// Requests are sent
+  CLOSED,
+  /// Endpoint is known to be down, requests are short-circuited
+  OPEN,
+  /// A probe request was let through, the others wait for its outcome
+  HALF_OPEN,
+};
+
+/// Tracks the health of an endpoint. After `failureThreshold` consecutive
+/// failures the circuit opens, failing requests without sending them, until
+/// `openFor` elapses and a single probe is let through. Its success closes
+/// the circuit, its failure opens it again.
+///
+/// The server may also ask for the endpoint to be left alone for a while, see
+/// `defer`
+class CircuitBreaker {
+  CircuitState state_;
+  uint8_t failures;
+  esp_time openedAt;
+  /// Replaces `RetryPolicy::openFor`, if the circuit was opened by `defer`
+  esp_time deferredFor;
+
+public:
+  CircuitBreaker() noexcept;
+
+  /// If a request may be sent now
+  auto allow(const RetryPolicy &policy, esp_time now) noexcept -> bool;
+  /// The server answered (even if it refused the request)
+  void success() noexcept;
+  /// The server couldn't be reached, or is broken
+  void failure(const RetryPolicy &policy, esp_time now) noexcept;
+  /// The server is shedding load, opens the circuit for `delay`
+  void defer(esp_time now, esp_time delay) noexcept;
+
+  auto state() const noexcept -> CircuitState { return this->state_; }
+  /// Opened by `defer`, not by failures
+  auto deferred() const noexcept -> bool { return this->state_ != CircuitState::CLOSED && this->deferredFor > 0; }
+};
+} // namespace iop
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef IOP_CORE_TLS_SESSION_HPP
+#define IOP_CORE_TLS_SESSION_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string_view>
+
+namespace iop {
+
+/// Keeps the TLS session parameters of the last handshake in RTC memory. So
+/// requests after a soft reboot (ex: upgrades, panics, deep sleep) resume the
+/// session with an abbreviated handshake, instead of paying for the full one.
+///
+/// Not stored in flash on purpose, the master secret must not survive a power
+/// cycle. Parameters are bound to the host and checksummed, garbage left in
+/// RTC memory by a cold boot is never loaded
+class TlsSessionStore {
+public:
+  /// Big enough for `br_ssl_session_parameters`
+  constexpr static size_t capacity = 96;
+  /// Offset, in 4 byte blocks, of the slot in RTC user memory
+  constexpr static uint32_t rtcOffset = 0;
+
+  /// Copies the parameters stored for this host, if they are intact and
+  /// exactly `size` bytes long
+  static auto load(std::string_view host, uint8_t *data, size_t size) noexcept -> bool;
+  /// Only writes if they changed. Bigger than `capacity` is ignored
+  static void store(std::string_view host, const uint8_t *data, size_t size) noexcept;
+  static void clear() noexcept;
+};
+} // namespace iop
+
+#endif
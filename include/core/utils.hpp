@@ -20,6 +20,10 @@
 // (Un)Comment this line to toggle memory stats logging
 #define LOG_MEMORY
 
+// (Un)Comment this line to toggle binary logs, decode them with
+// `build/decodeLogs.py`
+//#define IOP_BINARY_LOG
+
 namespace iop {
 using MD5Hash = std::array<char, 32>;
 using MacAddress = std::array<char, 17>;
@@ -4,14 +4,19 @@
 #ifdef IOP_DESKTOP
 #include <cstdint>
 #include <stddef.h>
+#include <cstring>
 #define memcpy_P memcpy
 #define memcmp_P memcmp
-class br_x509_minimal_context;
+#define pgm_read_word(addr) (*static_cast<const uint16_t *>(addr))
 class br_x509_trust_anchor {
 public:
   struct { struct { uint8_t *data; size_t len; } dn; };
 };
-static br_x509_trust_anchor dummyAnchor;
+struct br_x509_minimal_context {
+  const br_x509_trust_anchor* (*trust_anchor_dynamic)(void *ctx, void *hashed_dn, size_t hashed_dn_len);
+  void *trust_anchor_dynamic_ctx;
+  void (*trust_anchor_dynamic_free)(void *ctx, const br_x509_trust_anchor *ta);
+};
 
 namespace BearSSL {
 class CertStoreBase {
@@ -23,15 +28,20 @@ class CertStoreBase {
 };
         
 class X509List {
-  uint8_t dummy;
+  uint8_t dn[64];
+  br_x509_trust_anchor anchor;
 public:
-  X509List(const uint8_t * const cert, const uint16_t size) {
+  X509List(const uint8_t * const cert, const uint16_t size): dn{0}, anchor() {
     (void)cert;
     (void)size;
+    this->anchor.dn.data = this->dn;
+    this->anchor.dn.len = sizeof(this->dn);
   }
+  X509List(X509List const &other) = delete;
+  X509List &operator=(X509List const &other) = delete;
 
   const br_x509_trust_anchor* getTrustAnchors() const {
-    return &dummyAnchor;
+    return &this->anchor;
   }
 };
 } // namespace BearSSL
@@ -39,10 +49,9 @@ public:
 static void br_x509_minimal_set_dynamic(br_x509_minimal_context *ctx, void *dynamic_ctx,
 	const br_x509_trust_anchor* (*dynamic)(void *ctx, void *hashed_dn, size_t hashed_dn_len),
         void (*dynamic_free)(void *ctx, const br_x509_trust_anchor *ta)) {
-  (void)ctx;
-  (void)dynamic_ctx;
-  (void)dynamic;
-  (void)dynamic_free;
+  ctx->trust_anchor_dynamic = dynamic;
+  ctx->trust_anchor_dynamic_ctx = dynamic_ctx;
+  ctx->trust_anchor_dynamic_free = dynamic_free;
 }
 #else
 #include "CertStoreBearSSL.h"
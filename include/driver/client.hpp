@@ -4,6 +4,17 @@
 #ifndef IOP_DESKTOP
 #include "ESP8266WiFi.h"
 #include "ESP8266HTTPClient.h"
+#include <string_view>
+
+/// Sends headers serialized beforehand as they are, instead of building each
+/// header line per request
+class HeaderBlockHTTPClient : public HTTPClient {
+public:
+  /// Must be valid header lines, each ending in "\r\n"
+  void addHeaderBlock(std::string_view block) {
+    this->_headers.concat(block.data(), block.length());
+  }
+};
 #else
 #include "driver/wifi.hpp"
 
@@ -19,20 +30,27 @@
 #define HTTPC_ERROR_STREAM_WRITE        (-10)
 #define HTTPC_ERROR_READ_TIMEOUT        (-11)
 
+#include <array>
 #include <vector>
 #include <string>
 #include <unordered_map>
 #include "core/string.hpp"
 #include "core/utils.hpp"
 #include "core/log.hpp"
+#include "core/http_parser.hpp"
 
 #include <algorithm>
 #include <cctype>
 #include <string>
 
+#include <memory>
+
 #include <stdio.h>
 #include <sys/socket.h>
+#include <sys/ioctl.h>
 #include <arpa/inet.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <unistd.h>
 #include <stdlib.h>
 
@@ -41,7 +59,8 @@ static iop::Log clientDriverLogger(iop::LogLevel::WARN, F("HTTP Client"));
 static ssize_t send__(uint32_t fd, const char * msg, const size_t len) noexcept {
   if (iop::Log::isTracing())
     iop::Log::print(msg, iop::LogLevel::TRACE, iop::LogType::STARTEND);
-  return write(fd, msg, len);
+  // The server may close a kept alive connection, that must not kill us
+  return send(fd, msg, len, MSG_NOSIGNAL);
 }
 static ssize_t recv(uint32_t fd, char *msg, size_t len) {
   return read(fd, msg, len);
@@ -109,16 +128,15 @@ typedef enum {
 } t_http_codes;
 
 class Stream {
-  uint32_t fd;
 public:
-  Stream(uint32_t fd): fd(fd) {}
-
-  ssize_t write(const char *msg, size_t len) {
-    return send__(this->fd, msg, len);
-  }
-  ssize_t read(char *buff, size_t len) {
-    return recv(this->fd, buff, len);
-  }
+  virtual auto available() -> int = 0;
+  virtual auto read() -> int = 0;
+  virtual auto peek() -> int = 0;
+  virtual auto read(uint8_t *buffer, size_t length) -> int = 0;
+  virtual auto readBytes(char *buffer, size_t length) -> size_t = 0;
+  virtual auto write(uint8_t byte) -> size_t = 0;
+  virtual auto write(const uint8_t *buffer, size_t length) -> size_t = 0;
+  virtual ~Stream() noexcept = default;
 };
 
 enum HTTPUpdateResult {
@@ -131,49 +149,185 @@ namespace BearSSL {
   class CertStoreBase;
 }
 
+/// TCP connection with the ESP8266 WiFiClient API, used by the asynchronous
+/// requests. Reads and writes never block, only `connect` does (up to the
+/// timeout). Copies share the connection, like in ESP8266
 class WiFiClient {
+  std::shared_ptr<int32_t> fd;
+  uint32_t timeoutMs = 5000;
+
 public:
   void setNoDelay(bool b) { (void) b; }
   void setSync(bool b) { (void) b; }
   void setInsecure() const noexcept {}
   void setCertStore(const BearSSL::CertStoreBase *base) const noexcept { (void) base; }
+  void setTimeout(uint32_t ms) { this->timeoutMs = ms; }
+
+  int connect(const char *host, uint16_t port) {
+    this->stop();
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, host, &addr.sin_addr) <= 0) {
+      clientDriverLogger.error(F("Address not supported: "), host);
+      return 0;
+    }
+
+    const int32_t raw = socket(AF_INET, SOCK_STREAM, 0);
+    if (raw < 0) {
+      clientDriverLogger.error(F("Unable to open socket"));
+      return 0;
+    }
+    auto socketFd = std::shared_ptr<int32_t>(new int32_t(raw), [](int32_t *fd) {
+      close(*fd);
+      delete fd;
+    });
+    fcntl(raw, F_SETFL, fcntl(raw, F_GETFL, 0) | O_NONBLOCK);
+
+    if (::connect(raw, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) < 0) {
+      if (errno != EINPROGRESS) {
+        clientDriverLogger.error(F("Unable to connect: "), std::to_string(errno), F(" - "), strerror(errno));
+        return 0;
+      }
+      struct pollfd pfd = {raw, POLLOUT, 0};
+      int error = 0;
+      socklen_t length = sizeof(error);
+      if (poll(&pfd, 1, static_cast<int>(this->timeoutMs)) <= 0 ||
+          getsockopt(raw, SOL_SOCKET, SO_ERROR, &error, &length) < 0 || error != 0) {
+        clientDriverLogger.error(F("Unable to connect: "), std::to_string(error), F(" - "), strerror(error));
+        return 0;
+      }
+    }
+    this->fd = socketFd;
+    return 1;
+  }
+  uint8_t connected() {
+    if (!this->fd)
+      return 0;
+    char byte = 0;
+    const auto size = ::recv(*this->fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+    if (size == 0 || (size < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+      this->stop();
+      return 0;
+    }
+    return 1;
+  }
+  int available() {
+    int size = 0;
+    if (!this->fd || ioctl(*this->fd, FIONREAD, &size) < 0)
+      return 0;
+    return size;
+  }
+  int read(uint8_t *buffer, size_t length) {
+    if (!this->fd)
+      return -1;
+    const auto size = ::recv(*this->fd, buffer, length, MSG_DONTWAIT);
+    return size < 0 ? -1 : static_cast<int>(size);
+  }
+  size_t availableForWrite() {
+    if (!this->fd)
+      return 0;
+    struct pollfd pfd = {*this->fd, POLLOUT, 0};
+    // Whatever the kernel takes, we don't know how much it is
+    return poll(&pfd, 1, 0) > 0 && (pfd.revents & POLLOUT) ? 1460 : 0;
+  }
+  size_t write(const uint8_t *buffer, size_t length) {
+    if (!this->fd)
+      return 0;
+    const auto size = send(*this->fd, buffer, length, MSG_DONTWAIT | MSG_NOSIGNAL);
+    return size < 0 ? 0 : static_cast<size_t>(size);
+  }
+  void stop() { this->fd.reset(); }
 };
 
 class HTTPClient {
-  std::vector<std::string> headersToCollect;
-
   std::string uri;
   std::unordered_map<std::string, std::string> headers;
-  std::string authorization;
+  std::string_view headerBlock;
 
   std::string responsePayload;
-  std::unordered_map<std::string, std::string> responseHeaders;
+  bool payloadRead = false;
+  iop::HttpParser parser{nullptr};
+  // Body bytes read together with the headers, not parsed yet
+  std::array<char, 1024> readBuffer;
+  std::string_view pending;
 
   std::optional<int32_t> currentFd;
+  /// Host and port the current connection is open to
+  std::string currentHost;
+  bool reuse = false;
 public:
-  void setReuse(bool reuse) { (void) reuse; }
+  /// Keeps the connection open between requests (HTTP/1.1 keep-alive)
+  void setReuse(bool reuse) { this->reuse = reuse; }
+  /// If there is an open connection. Detects connections closed by the server
+  bool connected() {
+    if (!this->currentFd.has_value())
+      return false;
+
+    char byte = 0;
+    const auto size = ::recv(iop::unwrap_ref(this->currentFd, IOP_CTX()), &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+    if (size == 0 || (size < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+      clientDriverLogger.debug(F("Connection closed by the server"));
+      this->disconnect();
+      return false;
+    }
+    return true;
+  }
   void collectHeaders(const char **headerKeys, size_t count) {
     for (uint8_t index = 0; index < count; ++index) {
-        this->headersToCollect.push_back(headerKeys[index]);
+        this->parser.collect(headerKeys[index]);
     }
   }
   std::string header(std::string key) {
-    if (this->responseHeaders.count(key) == 0) return "";
-    return this->responseHeaders.at(key);
+    return std::string(this->parser.header(key).value_or(""));
   }
-  size_t getSize() {
-    return this->responsePayload.length();
+  /// Content-Length, -1 if unknown (like ESP8266HTTPClient)
+  int getSize() {
+    const auto length = this->parser.contentLength();
+    return length.has_value() ? static_cast<int>(*length) : -1;
   }
   std::string getString() {
+    if (!this->payloadRead) {
+      this->payloadRead = true;
+      this->readPayload([this](std::string_view piece) {
+        this->responsePayload.append(piece);
+        return true;
+      });
+    }
     return this->responsePayload;
   }
+  /// Streams the body into the stream, returns bytes written or a negative
+  /// error (HTTPC_ERROR_STREAM_WRITE if the stream refused it)
+  int writeToStream(Stream *stream) {
+    this->payloadRead = true;
+    size_t written = 0;
+    bool refused = false;
+    const auto code = this->readPayload([stream, &written, &refused](std::string_view piece) {
+      const auto size = stream->write(reinterpret_cast<const uint8_t*>(piece.data()), piece.length());
+      written += size;
+      refused = size != piece.length();
+      return !refused;
+    });
+    if (refused)
+      return HTTPC_ERROR_STREAM_WRITE;
+    if (code < 0)
+      return code;
+    return static_cast<int>(written);
+  }
+  /// Finishes the request, the connection is only closed if it can't be reused
   void end() {
-    if (this->currentFd.has_value())
-      close(iop::unwrap(this->currentFd, IOP_CTX()));
+    // Unread bodies would be mistaken for the next response
+    if (!this->reuse || !this->parser.done())
+      this->disconnect();
 
-    this->authorization.clear();
+    this->headers.clear();
+    this->headerBlock = std::string_view();
     this->responsePayload.clear();
-    this->responseHeaders.clear();
+    this->payloadRead = false;
+    this->pending = std::string_view();
+    this->parser.reset();
     this->uri.clear();
   }
   void addHeader(iop::StaticString key, iop::StaticString value) {
@@ -190,198 +344,215 @@ public:
         [](unsigned char c){ return std::tolower(c); });
     this->headers.emplace(keyLower, value);
   }
+  /// Must be valid header lines, each ending in "\r\n". Isn't copied, must
+  /// outlive the request
+  void addHeaderBlock(std::string_view block) { this->headerBlock = block; }
   void setTimeout(uint32_t ms) { (void) ms; }
   void setAuthorization(std::string auth) {
     if (auth.length() == 0) return;
     this->headers.emplace(std::string("Authorization"), std::string("Basic ") + auth);
   }
   int sendRequest(std::string method, const uint8_t *data, size_t len) {
+    if (!this->currentFd.has_value())
+      return HTTPC_ERROR_NOT_CONNECTED;
+    uint32_t fd = iop::unwrap_ref(this->currentFd, IOP_CTX());
+    if (!this->sendHeaders(method, len))
+      return HTTPC_ERROR_SEND_HEADER_FAILED;
+    if (len > 0 && send__(fd, (char*)data, len) < 0) {
+      this->disconnect();
+      return HTTPC_ERROR_SEND_PAYLOAD_FAILED;
+    }
+    if (clientDriverLogger.level() == iop::LogLevel::TRACE || iop::Log::isTracing())
+      iop::Log::print(F(""), iop::LogLevel::TRACE, iop::LogType::END);
+    clientDriverLogger.debug(F("Sent data"));
+    return this->readHeaders();
+  }
+
+  /// Body is pulled from the stream in chunks, so it's never fully in memory
+  int sendRequest(std::string method, Stream *stream, size_t len) {
+    if (!this->currentFd.has_value())
+      return HTTPC_ERROR_NOT_CONNECTED;
+    uint32_t fd = iop::unwrap_ref(this->currentFd, IOP_CTX());
+    if (!this->sendHeaders(method, len))
+      return HTTPC_ERROR_SEND_HEADER_FAILED;
+
+    std::array<uint8_t, 128> chunk;
+    size_t sent = 0;
+    while (sent < len) {
+      const auto size = stream->read(chunk.data(), std::min(chunk.size(), len - sent));
+      if (size <= 0) {
+        clientDriverLogger.error(F("Body stream ended early: "), std::to_string(sent), F(" of "), std::to_string(len));
+        this->disconnect();
+        return HTTPC_ERROR_SEND_PAYLOAD_FAILED;
+      }
+      if (send__(fd, reinterpret_cast<const char*>(chunk.data()), static_cast<size_t>(size)) < 0) {
+        this->disconnect();
+        return HTTPC_ERROR_SEND_PAYLOAD_FAILED;
+      }
+      sent += static_cast<size_t>(size);
+    }
+    if (clientDriverLogger.level() == iop::LogLevel::TRACE || iop::Log::isTracing())
+      iop::Log::print(F(""), iop::LogLevel::TRACE, iop::LogType::END);
+    clientDriverLogger.debug(F("Sent data"));
+    return this->readHeaders();
+  }
+
+private:
+  void disconnect() {
+    if (this->currentFd.has_value()) {
+      clientDriverLogger.debug(F("Close client: "), std::to_string(iop::unwrap_ref(this->currentFd, IOP_CTX())));
+      close(iop::unwrap_ref(this->currentFd, IOP_CTX()));
+    }
+    this->currentFd.reset();
+    this->currentHost.clear();
+  }
+
+  bool sendHeaders(const std::string &method, size_t len) {
     this->responsePayload.clear();
+    this->payloadRead = false;
+    this->pending = std::string_view();
+    this->parser.reset();
 
     const std::string_view path(this->uri.c_str() + this->uri.find("/", this->uri.find("://") + 3));
-    clientDriverLogger->debug(F("Send request to "), path);
+    clientDriverLogger.debug(F("Send request to "), path);
+
+    std::string head;
+    head.reserve(256);
+    head += method;
+    head += " ";
+    head += path;
+    head += " HTTP/1.1\r\nHost: ";
+    head += this->currentHost;
+    head += this->reuse ? "\r\nConnection: keep-alive" : "\r\nConnection: close";
+    head += "\r\nContent-Length: ";
+    head += std::to_string(len);
+    head += "\r\n";
+    head += this->headerBlock;
+    for (const auto& [key, value]: this->headers) {
+      head += key;
+      head += ": ";
+      head += value;
+      head += "\r\n";
+    }
+    head += "\r\n";
 
     uint32_t fd = iop::unwrap_ref(this->currentFd, IOP_CTX());
-    if (clientDriverLogger->level() == iop::LogLevel::TRACE || iop::Log::isTracing())
+    if (clientDriverLogger.level() == iop::LogLevel::TRACE || iop::Log::isTracing())
       iop::Log::print(F(""), iop::LogLevel::TRACE, iop::LogType::START);
-    send__(fd, method.c_str(), method.length());
-    send__(fd, " ", 1);
-    send__(fd, path.begin(), path.length());
-    send__(fd, " HTTP/1.0\r\n", 11);
-    send__(fd, "Content-Length: ", 16);
-    const auto dataLengthStr = std::to_string(len);
-    send__(fd, dataLengthStr.c_str(), dataLengthStr.length());
-    send__(fd, "\r\n", 2);
-    for (const auto& [key, value]: this->headers) {
-      send__(fd, key.c_str(), key.length());
-      send__(fd, ": ", 2);
-      send__(fd, value.c_str(), value.length());
-      send__(fd, "\r\n", 2);
+    if (send__(fd, head.c_str(), head.length()) < 0) {
+      clientDriverLogger.warn(F("Unable to send headers: "), std::to_string(errno), F(" - "), strerror(errno));
+      this->disconnect();
+      return false;
     }
-    send__(fd, "\r\n", 2);
-    send__(fd, (char*)data, len);
-    if (clientDriverLogger->level() == iop::LogLevel::TRACE || iop::Log::isTracing())
-      iop::Log::print(F(""), iop::LogLevel::TRACE, iop::LogType::END);
-    clientDriverLogger->debug(F("Sent data"));
-    
-    auto buffer = iop::FixedString<5096>::empty();
-    
-    ssize_t size = 0;
-    auto firstLine = true;
-    auto isPayload = false;
-    
-    auto status = std::make_optional(1000);
-    std::string_view buff(buffer.get());
-    while (true) {
-      clientDriverLogger->debug(F("Try read: "), std::to_string(buffer.length()));
-
-      if (buffer.length() < buffer.size &&
-          (size = read(fd, buffer.asMut() + buffer.length(), buffer.size - buffer.length())) < 0) {
-        clientDriverLogger->error(F("Error reading from socket ("), std::to_string(size), F("): "), std::to_string(errno), F(" - "), strerror(errno)); 
-        close(fd);
-        return 500;
-      }
-      buff = buffer.get();
-      clientDriverLogger->debug(F("Len: "), std::to_string(size));
-      if (firstLine && size == 0) {
-        close(fd);
-        clientDriverLogger->warn(F("Empty request: "), std::to_string(fd), F(" "), std::string(reinterpret_cast<const char*>(data), len));
-        return status.value_or(500);
-        //continue;
-      }
-      
-      clientDriverLogger->debug(F("Buffer: "), buff.substr(0, buff.find("\n") - 1));
-      //if (!buff.contains(F("\n"))) continue;
-      clientDriverLogger->debug(F("Read: ("), std::to_string(size), F(") ["), std::to_string(buffer.length()), F("]: "), std::string(buffer.get()).substr(0, buff.find("\n")));
-
-      if (firstLine && buff.find("\n") == buff.npos) continue;
+    return true;
+  }
 
-      if (firstLine && size < 10) { // len("HTTP/1.1 ") = 9
-        clientDriverLogger->error(F("Error reading first line: "), std::to_string(size));
-        return 500;
-      }
+  /// Reads the status line and headers. Like ESP8266HTTPClient the body
+  /// stays in the connection, until `writeToStream` or `getString`
+  int readHeaders() {
+    uint32_t fd = iop::unwrap_ref(this->currentFd, IOP_CTX());
 
-      if (firstLine && size > 0) {
-        clientDriverLogger->debug(F("Found first line: "));
-
-        const std::string_view statusStr(buffer.get() + 9); // len("HTTP/1.1 ") = 9
-        const auto codeEnd = statusStr.find(" ");
-        if (codeEnd == statusStr.npos) {
-          clientDriverLogger->error(F("Bad server: "), statusStr, F(" -- "), buff);
-          return 500;
-        }
-        //iop_assert(buff.contains(F("\n")), iop::StaticString(F("First: ")).toStdString() + std::to_string(buffer.length()) + iop::StaticString(F(" bytes don't contain newline, the path is too long\n")).toStdString());
-        status = std::make_optional(atoi(std::string(statusStr.begin(), 0, codeEnd).c_str()));
-        clientDriverLogger->debug(F("Status: "), std::to_string(status.value_or(500)));
-        firstLine = false;
-
-        const char* ptr = buff.begin() + buff.find("\n") + 1;
-        memmove(buffer.asMut(), ptr, strlen(ptr) + 1);
-        buff = buffer.get();
+    size_t received = 0;
+    while (!this->parser.headersDone() && !this->parser.failed()) {
+      const auto size = recv(fd, this->readBuffer.data(), this->readBuffer.size());
+      if (size < 0) {
+        clientDriverLogger.error(F("Error reading from socket ("), std::to_string(size), F("): "), std::to_string(errno), F(" - "), strerror(errno));
+        this->disconnect();
+        return HTTPC_ERROR_CONNECTION_LOST;
       }
-      if (!status.has_value()) {
-        clientDriverLogger->error(F("No status"));
-        return 500;
+      if (size == 0) {
+        this->parser.finish();
+        break;
       }
-      clientDriverLogger->debug(F("Buffer: "), buff.substr(0, buff.find("\n") - 1));
-      //if (!buff.contains(F("\n"))) continue;
-      clientDriverLogger->debug(F("Headers + Payload: "), std::string(buffer.get()).substr(0, buff.find("\n")));
-
-      while (len > 0 && buffer.length() > 0 && !isPayload) {
-        // TODO: if empty line is split into t  wo reads (because of buff len) we are screwed
-        //  || buff.contains(F("\n\n")) || buff.contains(F("\n\r\n"))
-        if (buff.find("\r\n") == 0) {
-          clientDriverLogger->debug(F("Found Payload"));
-          isPayload = true;
-
-          const char* ptr = buff.begin() + buff.find("\r\n") + 2;
-          memmove(buffer.asMut(), ptr, strlen(ptr) + 1);
-          buff = buffer.get();
-          continue;
-        } else if (buff.find("\r\n") == buff.npos) {
-          iop_panic(F("Bad software bruh"));
-        } else if (buff.find("\r\n") != buff.npos) {
-          clientDriverLogger->debug(F("Found headers (buffer length: "), std::to_string(buff.length()), F(")"));
-          for (const auto &key: this->headersToCollect) {
-            if (buff.length() < key.length()) continue;
-            std::string headerKey(buffer.get(), 0, key.length());
-            // Headers can't be UTF8 so we cool
-            std::transform(headerKey.begin(), headerKey.end(), headerKey.begin(),
-              [](unsigned char c){ return std::tolower(c); });
-            clientDriverLogger->debug(headerKey, F(" == "), key);
-            if (headerKey != key)
-              continue;
-
-            auto valueView = buff.substr(key.length() + 1); // ":"
-            while (*valueView.begin() == ' ') valueView = valueView.substr(1);
-
-            iop_assert(valueView.find("\r\n") != valueView.npos, F("Must contain endline"));
-            const std::string value(valueView, 0, valueView.find("\r\n"));
-            clientDriverLogger->debug(F("Found header "), key, F(" = "), value, F("\n"));
-            this->responseHeaders.emplace(key, value);
-
-            iop_assert(buff.find("\r\n") > 0, F("Must contain endline"));
-            const char* ptr = buff.begin() + buff.find("\r\n") + 2;
-            memmove(buffer.asMut(), ptr, strlen(ptr) + 1);
-            buff = buffer.get();
-            if (buff.find("\n") == buff.npos) iop_panic(F("Fuuuc")); //continue;
-          }
-          if (buff.find("\n") == buff.npos) {
-            clientDriverLogger->warn(F("Newline missing in buffer: "), buff);
-            return 500;
-          }
-          clientDriverLogger->debug(F("Buffer: "), buff.substr(0, buff.find("\n") - 1));
-          clientDriverLogger->debug(F("Skipping header ("), buff.substr(0, buff.find("\n") - 1), F(")"));
-          const char* ptr = buff.begin() + buff.find("\r\n") + 2;
-          memmove(buffer.asMut(), ptr, strlen(ptr) + 1);
-          buff = buffer.get();
-          if (buff.find("\n") == buff.npos) iop_panic(F("Fuuk")); //continue;
-        } else {
-          iop_panic(F("Press F to pay respect"));
-        }
+      received += static_cast<size_t>(size);
+      const std::string_view data(this->readBuffer.data(), static_cast<size_t>(size));
+      this->pending = data.substr(this->parser.feedHeaders(data));
+    }
+
+    if (this->parser.failed()) {
+      this->disconnect();
+      // Nothing read means the server closed a kept alive connection
+      if (received == 0) {
+        clientDriverLogger.warn(F("Connection closed before the response"));
+        return HTTPC_ERROR_CONNECTION_LOST;
       }
+      clientDriverLogger.error(F("Bad server response, state: "), std::to_string(static_cast<int>(this->parser.state())));
+      return HTTPC_ERROR_NO_HTTP_SERVER;
+    }
 
-      clientDriverLogger->debug(F("Payload ("), std::to_string(buff.length()), F(") ["), std::to_string(size), F("]: "), std::string(buffer.get()).substr(0, buff.find("\n") == buff.npos ? buff.find("\n") : buffer.length()));
+    const auto status = this->parser.status();
+    clientDriverLogger.info(F("Status: "), std::to_string(status));
+    return status;
+  }
+
+  /// Hands the body to the sink as it's read, in pieces of the read buffer
+  int readPayload(iop::HttpParser::BodySink sink) {
+    if (!this->currentFd.has_value() || !this->parser.headersDone())
+      return HTTPC_ERROR_NOT_CONNECTED;
+    uint32_t fd = iop::unwrap_ref(this->currentFd, IOP_CTX());
 
-      this->responsePayload += buff;
+    this->parser.setSink(std::move(sink));
+    this->parser.feed(this->pending);
+    this->pending = std::string_view();
 
-      // TODO: For some weird reason `read` is blocking if we try to read after EOF
-      // But it's not clear what will happen if EOF is exactly at buffer.size
-      // Because it will continue, altough there isn't anything, but it's blocking on EOF
-      // But this behavior is not documented. To replicate remove:
-      // ` && len == buffer.size` and it will get stuck in the `read` above
-      if (len > 0 && buff.length() > 0 && len == buffer.size)
-        continue;
-      break;
+    while (!this->parser.done() && !this->parser.failed()) {
+      const auto size = recv(fd, this->readBuffer.data(), this->readBuffer.size());
+      if (size < 0) {
+        clientDriverLogger.error(F("Error reading from socket ("), std::to_string(size), F("): "), std::to_string(errno), F(" - "), strerror(errno));
+        break;
+      }
+      if (size == 0) {
+        this->parser.finish();
+        break;
+      }
+      this->parser.feed(std::string_view(this->readBuffer.data(), static_cast<size_t>(size)));
     }
+    this->parser.setSink(nullptr);
 
-    clientDriverLogger->debug(F("Close client: "), std::to_string(fd), F(" "), std::string(reinterpret_cast<const char*>(data), len));
-    close(fd);
-    clientDriverLogger->info(F("Status: "), std::to_string(status.value_or(500)));
-    return iop::unwrap(status, IOP_CTX());
+    if (!this->parser.done()) {
+      clientDriverLogger.error(F("Connection lost reading payload: "), std::to_string(this->parser.bodyLength()));
+      this->disconnect();
+      return HTTPC_ERROR_CONNECTION_LOST;
+    }
+    clientDriverLogger.debug(F("Payload ("), std::to_string(this->parser.bodyLength()), F(")"));
+
+    if (!this->parser.keepAlive() || !this->reuse)
+      this->disconnect();
+    return static_cast<int>(this->parser.bodyLength());
   }
 
+public:
   bool begin(WiFiClient client, std::string host, uint32_t port, std::string uri) {
     return this->begin(client, std::string("http://") + host + ":" + std::to_string(port) + uri);
   }
 
   bool begin(WiFiClient client, std::string uri_) {
-    this->end();
     this->uri = uri_;
     (void) client;
 
     std::string_view uri(uri_);
-     
+
+    iop_assert(uri.find("http://") == 0, F("Protocol must be http (no SSL)"));
+    uri = std::string_view(uri.begin() + 7);
+
+    auto hostEnd = uri.find("/");
+    if (hostEnd == uri.npos) hostEnd = uri.length();
+    const auto hostAndPort = std::string(uri.substr(0, hostEnd));
+
+    // Kept alive connection to the same server
+    if (this->hostAndPortMatches(hostAndPort) && this->connected()) {
+      clientDriverLogger.debug(F("Reusing connection: "), std::to_string(iop::unwrap_ref(this->currentFd, IOP_CTX())));
+      return true;
+    }
+    this->disconnect();
+
     struct sockaddr_in serv_addr;
     int32_t fd = socket(AF_INET, SOCK_STREAM, 0);
     if (fd < 0) {
-      clientDriverLogger->error(F("Unable to open socket"));
+      clientDriverLogger.error(F("Unable to open socket"));
       return false;
     }
 
-    iop_assert(uri.find("http://") == 0, F("Protocol must be http (no SSL)"));
-    uri = std::string_view(uri.begin() + 7);
-    
     const auto portIndex = uri.find(iop::StaticString(F(":")).toStdString());
     uint16_t port = 443;
     if (portIndex != uri.npos) {
@@ -389,11 +560,12 @@ public:
       if (end == uri.npos) end = uri.length();
       port = static_cast<uint16_t>(strtoul(std::string(uri.begin(), portIndex + 1, end).c_str(), nullptr, 10));
       if (port == 0) {
-        clientDriverLogger->error(F("Unable to parse port, broken server: "), uri);
+        clientDriverLogger.error(F("Unable to parse port, broken server: "), uri);
+        close(fd);
         return false;
       }
     }
-    clientDriverLogger->debug(F("Port: "), std::to_string(port));
+    clientDriverLogger.debug(F("Port: "), std::to_string(port));
 
     serv_addr.sin_family = AF_INET;
     serv_addr.sin_port = htons(port);
@@ -406,20 +578,26 @@ public:
     // Convert IPv4 and IPv6 addresses from text to binary form
     if(inet_pton(AF_INET, host.c_str(), &serv_addr.sin_addr) <= 0) {
       close(fd);
-      clientDriverLogger->error(F("Address not supported: "), host);
+      clientDriverLogger.error(F("Address not supported: "), host);
       return false;
     }
 
     int32_t connection = connect(fd, (struct sockaddr *)&serv_addr, sizeof(serv_addr));
     if (connection < 0) {
-      clientDriverLogger->error(F("Unnable to connect: "), std::to_string(connection));
+      clientDriverLogger.error(F("Unnable to connect: "), std::to_string(connection));
       close(fd);
       return false;
     }
-    clientDriverLogger->debug(F("Began connection: "), uri);
+    clientDriverLogger.debug(F("Began connection: "), uri);
     this->currentFd = std::make_optional(fd);
+    this->currentHost = hostAndPort;
     return true;
   }
+
+private:
+  bool hostAndPortMatches(const std::string &hostAndPort) const {
+    return this->currentFd.has_value() && this->currentHost == hostAndPort;
+  }
 };
 
 #ifdef IOP_SSL
@@ -16,6 +16,10 @@ public:
   void deepSleep(uint32_t seconds) const noexcept;
   std::array<char, 32>& binaryMD5() const noexcept;
   std::array<char, 17>& macAddress() const noexcept;
+  /// RTC user memory survives soft reboots and deep sleep, but not power
+  /// loss. 512 bytes, the offset is in 4 byte blocks, the size in bytes
+  auto rtcRead(uint32_t offset, uint32_t *data, size_t size) const noexcept -> bool;
+  auto rtcWrite(uint32_t offset, const uint32_t *data, size_t size) const noexcept -> bool;
 };
 extern Device device;
 }
@@ -25,6 +25,27 @@ public:
   }
 };
 extern Flash flash;
+
+/// Raw flash sectors, outside of the emulated EEPROM, so they aren't mirrored
+/// in RAM. They are the start of the filesystem area, we don't mount one.
+///
+/// Like NOR flash, writes only clear bits and erasing sets a whole sector back
+/// to 0xFF. Offsets, sizes and buffers must be 4 bytes aligned
+class FlashSectors {
+  size_t count_ = 0;
+  uint8_t *buffer = nullptr;
+public:
+  constexpr static size_t sectorSize = 4096;
+
+  /// Less sectors are available if the filesystem area is too small
+  void setup(size_t count) noexcept;
+  auto count() const noexcept -> size_t { return this->count_; }
+  auto read(size_t sector, size_t offset, void *out, size_t size) const noexcept -> bool;
+  auto write(size_t sector, size_t offset, const void *data, size_t size) noexcept -> bool;
+  /// Blocks for tens of milliseconds
+  auto erase(size_t sector) noexcept -> bool;
+};
+extern FlashSectors flashSectors;
 }
 
 #endif
\ No newline at end of file
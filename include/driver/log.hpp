@@ -12,8 +12,11 @@ enum class LogLevel;
 }
 
 void logSetup(const iop::LogLevel &level) noexcept;
-void logPrint(const std::string_view msg) noexcept;
-void logPrint(const iop::StaticString msg) noexcept;
+/// Writes what fits without blocking, returns how many bytes were written
+auto logWrite(std::string_view msg) noexcept -> size_t;
+/// A message was buffered, drains it or wakes whoever does
+void logPending() noexcept;
+/// Blocks until everything written was sent
 void logFlush() noexcept;
 
 #endif
\ No newline at end of file
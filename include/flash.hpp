@@ -4,6 +4,7 @@
 #include "core/log.hpp"
 #include "utils.hpp"
 #include <optional>
+#include <vector>
 
 #include "driver/wifi.hpp"
 
@@ -26,6 +27,27 @@ public:
   void removeWifiConfig() const noexcept;
   void writeWifiConfig(const WifiCredentials &config) const noexcept;
 
+  /// Bounded queue of measurements that couldn't be delivered, so they
+  /// survive offline periods (and reboots). It has its own flash sectors,
+  /// outside of the EEPROM, so it takes no RAM besides a few counters.
+  ///
+  /// Events are written to flash as they are enqueued, and marked as removed
+  /// as they are delivered. Neither erases a sector, the writer erases the
+  /// next one when the current is full. When full, the oldest sector's events
+  /// (`eventSlotsPerSector` of them) are dropped at once.
+  ///
+  /// An event delivered right before a reset, but not marked yet, is sent
+  /// again after it. The server must tolerate duplicates
+  void enqueueEvent(const EventStorage &event) const noexcept;
+  /// Up to `max` of the oldest events stored, in order
+  auto peekEvents(uint16_t max) const noexcept -> std::vector<Event>;
+  /// Removes the events delivered, from the ones returned by the last
+  /// `peekEvents`. `delivered[i]` refers to its i-th event. The events kept
+  /// remain at the front of the queue, in the same order. Events dropped
+  /// meanwhile (the queue was full) are ignored
+  void removeEvents(const std::vector<bool> &delivered) const noexcept;
+  auto queuedEvents() const noexcept -> uint16_t;
+
   ~Flash() { IOP_TRACE(); }
   Flash(Flash const &other) noexcept = default;
   Flash(Flash &&other) noexcept = default;
@@ -18,6 +18,7 @@
 
 #include "configuration.hpp"
 #include "flash.hpp"
+#include "policy.hpp"
 #include "sensors.hpp"
 #include "server.hpp"
 #include "api.hpp"
@@ -35,10 +36,25 @@ private:
   iop::Log logger;
   Flash flash_;
   Sensors sensors;
+  UploadPolicy policy;
+  Stagger stagger;
+  bool wasConnected;
+
+  /// Summary upload in flight, polled every iteration. Its event is queued
+  /// in flash if it fails
+  std::optional<iop::PendingRequest> upload;
+  EventStorage uploading;
+  /// Summary waiting for another request to finish, only one is in flight
+  std::optional<Summary> deferred;
+  /// Queued events batch in flight, its `draining` events are removed from
+  /// flash once the server answers for each
+  std::optional<iop::PendingRequest> drain;
+  uint16_t draining;
 
   iop::esp_time nextMeasurement;
   iop::esp_time nextYieldLog;
   iop::esp_time nextHandleConnectionLost;
+  iop::esp_time nextEventQueueDrain;
 
 public:
   Api const & api() const noexcept { return this->api_; }
@@ -49,7 +65,10 @@ public:
 private:
   void handleInterrupt(const InterruptEvent event, const std::optional<AuthToken> &maybeToken) const noexcept;
   void handleCredentials() noexcept;
-  void handleMeasurements(const AuthToken &token) noexcept;
+  void handleMeasurements(const AuthToken &token, const Summary &summary) noexcept;
+  void handleUpload() noexcept;
+  void handleEventQueue(const AuthToken &token) noexcept;
+  void handleDrain() noexcept;
 
 public:
   auto operator=(EventLoop const &other) noexcept -> EventLoop & {
@@ -58,6 +77,14 @@ public:
       return *this;
 
     this->sensors = other.sensors;
+    this->policy = other.policy;
+    this->stagger = other.stagger;
+    this->wasConnected = other.wasConnected;
+    this->upload = other.upload;
+    this->uploading = other.uploading;
+    this->deferred = other.deferred;
+    this->drain = other.drain;
+    this->draining = other.draining;
     this->api_ = other.api_;
     this->credentialsServer = other.credentialsServer;
     this->logger = other.logger;
@@ -65,11 +92,20 @@ public:
     this->nextMeasurement = other.nextMeasurement;
     this->nextYieldLog = other.nextYieldLog;
     this->nextHandleConnectionLost = other.nextHandleConnectionLost;
+    this->nextEventQueueDrain = other.nextEventQueueDrain;
     return *this;
   };
   auto operator=(EventLoop &&other) noexcept -> EventLoop & {
     IOP_TRACE();
     this->sensors = other.sensors;
+    this->policy = other.policy;
+    this->stagger = other.stagger;
+    this->wasConnected = other.wasConnected;
+    this->upload = other.upload;
+    this->uploading = other.uploading;
+    this->deferred = other.deferred;
+    this->drain = other.drain;
+    this->draining = other.draining;
     this->api_ = other.api_;
     this->credentialsServer = other.credentialsServer;
     this->logger = other.logger;
@@ -77,6 +113,7 @@ public:
     this->nextMeasurement = other.nextMeasurement;
     this->nextYieldLog = other.nextYieldLog;
     this->nextHandleConnectionLost = other.nextHandleConnectionLost;
+    this->nextEventQueueDrain = other.nextEventQueueDrain;
     return *this;
   }
   ~EventLoop() noexcept { IOP_TRACE(); }
@@ -84,8 +121,10 @@ public:
       : credentialsServer(logLevel_),
         api_(std::move(uri), logLevel_),
         logger(logLevel_, F("LOOP")), flash_(logLevel_),
-        sensors(config::soilResistivityPower, config::soilTemperature, config::airTempAndHumidity, config::dhtVersion),
-        nextMeasurement(0), nextYieldLog(0), nextHandleConnectionLost(0) {
+        sensors(), policy(config::uploadPolicy), stagger(0), wasConnected(false),
+        upload(), uploading{}, deferred(), drain(), draining(0),
+        nextMeasurement(0), nextYieldLog(0), nextHandleConnectionLost(0),
+        nextEventQueueDrain(0) {
     IOP_TRACE();
   }
   EventLoop(EventLoop const &other) noexcept
@@ -94,17 +133,35 @@ public:
         logger(other.logger),
         flash_(other.flash_),
         sensors(other.sensors),
+        policy(other.policy),
+        stagger(other.stagger),
+        wasConnected(other.wasConnected),
+        upload(other.upload),
+        uploading(other.uploading),
+        deferred(other.deferred),
+        drain(other.drain),
+        draining(other.draining),
         nextMeasurement(other.nextMeasurement),
         nextYieldLog(other.nextYieldLog),
-        nextHandleConnectionLost(other.nextHandleConnectionLost) {
+        nextHandleConnectionLost(other.nextHandleConnectionLost),
+        nextEventQueueDrain(other.nextEventQueueDrain) {
     IOP_TRACE();
   }
   EventLoop(EventLoop &&other) noexcept
       : credentialsServer(other.credentialsServer), api_(other.api_),
         logger(other.logger), flash_(other.flash_), sensors(other.sensors),
+        policy(other.policy),
+        stagger(other.stagger),
+        wasConnected(other.wasConnected),
+        upload(other.upload),
+        uploading(other.uploading),
+        deferred(other.deferred),
+        drain(other.drain),
+        draining(other.draining),
         nextMeasurement(other.nextMeasurement),
         nextYieldLog(other.nextYieldLog),
-        nextHandleConnectionLost(other.nextHandleConnectionLost) {
+        nextHandleConnectionLost(other.nextHandleConnectionLost),
+        nextEventQueueDrain(other.nextEventQueueDrain) {
     IOP_TRACE();
   }
 };
@@ -114,7 +171,6 @@ class Unused4KbSysStack {
   struct StackStruct {
     std::optional<EventLoop> loop;
     std::optional<StaticJsonDocument<1024>> json;
-    std::array<char, 1024> text;
     //std::optional<std::pair<std::array<char, 128>, std::array<char, 128>>> iop;
     //std::optional<std::pair<std::array<char, 32>, std::array<char, 64>>> wifi;
     #ifndef IOP_DESKTOP
@@ -126,7 +182,7 @@ class Unused4KbSysStack {
     #else
     std::optional<WiFiClient> client;
     #endif
-    HTTPClient http;
+    HeaderBlockHTTPClient http;
     bool isHttpSet;
     #endif
     std::array<char, 64> token;
@@ -169,7 +225,7 @@ public:
     return iop::unwrap_mut(this->data->client, IOP_CTX());
   }
   #endif
-  auto http() noexcept -> HTTPClient & {
+  auto http() noexcept -> HeaderBlockHTTPClient & {
     if (!this->data->isHttpSet) {
       this->data->isHttpSet = true;
       this->data->http.setUserAgent(String(F("ESP8266HTTPClient")));
@@ -210,9 +266,6 @@ public:
       this->data->json = std::make_optional(StaticJsonDocument<1024>());
     return iop::unwrap_mut(this->data->json, IOP_CTX());
   }
-  auto text() noexcept -> std::array<char, 1024> & {
-    return this->data->text;
-  }
   // ...
 };
 extern Unused4KbSysStack unused4KbSysStack;
@@ -0,0 +1,79 @@
+#ifndef IOP_POLICY_HPP
+#define IOP_POLICY_HPP
+
+#include "aggregation.hpp"
+#include "utils.hpp"
+#include "core/retry.hpp"
+#include <array>
+#include <vector>
+#include "driver/thread.hpp"
+
+/// Limits of the report by exception policy
+struct PolicyConfig {
+  /// Reporting window used while readings change fast
+  iop::esp_time minInterval;
+  /// Reporting window used while readings are stable. Shouldn't be longer than
+  /// the heartbeat, or the heartbeat will be late
+  iop::esp_time maxInterval;
+  /// Maximum time without uploading, even if nothing changed
+  iop::esp_time heartbeat;
+  /// Change of the mean, per measure, since the last upload that's considered
+  /// noise, readings inside it aren't uploaded. Zero uploads any change
+  std::array<float, measureVariants> deadbands;
+};
+
+/// Decides when to measure and when to upload.
+///
+/// The reporting window doubles while every mean stays inside half of its
+/// deadband since the previous window, and halves when any of them moves more
+/// than the deadband. A window is only uploaded if some mean left the
+/// deadband around its last uploaded value, a sensor appeared or failed, or
+/// the heartbeat expired. So the server can reconstruct the series by holding
+/// the last value.
+class UploadPolicy {
+  PolicyConfig config;
+  iop::esp_time interval_;
+  std::optional<iop::esp_time> lastUpload;
+  /// Last uploaded mean of each sensor, NaN if never uploaded
+  std::vector<float> reported;
+  /// Mean of each sensor in the previous window, NaN if unknown
+  std::vector<float> previous;
+
+public:
+  explicit UploadPolicy(PolicyConfig config) noexcept;
+
+  /// Length of the next reporting window
+  auto interval() const noexcept -> iop::esp_time { return this->interval_; }
+  /// Consumes the window summary, adapting the next window. Returns whether
+  /// it must be uploaded, if so it's assumed to be
+  auto evaluate(const Summary &summary, iop::esp_time now) noexcept -> bool;
+};
+
+/// Spreads the fleet's uploads over the reporting window.
+///
+/// Devices that boot together (ex: after a power cut) would otherwise upload
+/// in the same second, every window. So each one keeps a fixed phase inside
+/// the window, derived from its MAC address, and windows end at that phase.
+/// Queues drained after reconnecting are delayed at random too, since the
+/// whole site reconnects together
+class Stagger {
+  uint64_t deviceHash;
+  iop::Random random;
+
+public:
+  /// Up to how long queue drains are delayed after reconnecting
+  constexpr static iop::esp_time reconnectSpread = 60 * 1000;
+
+  /// The hash of the MAC address (see `iop::hashString`)
+  explicit Stagger(uint64_t deviceHash) noexcept;
+
+  /// Offset of this device inside windows of `interval`
+  auto phase(iop::esp_time interval) const noexcept -> iop::esp_time;
+  /// End of the window that contains `now`, at this device's phase. Always
+  /// after `now`, and at most `interval` after it
+  auto next(iop::esp_time now, iop::esp_time interval) const noexcept -> iop::esp_time;
+  /// When to drain the queue after reconnecting at `now`
+  auto afterReconnect(iop::esp_time now) noexcept -> iop::esp_time;
+};
+
+#endif
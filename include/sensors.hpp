@@ -1,56 +1,173 @@
 #ifndef IOP_SENSORS_HPP
 #define IOP_SENSORS_HPP
 
+#include "aggregation.hpp"
 #include "utils.hpp"
+#include <array>
 #include <memory>
+#include <optional>
+#include <vector>
 #include "driver/sensors.hpp"
+#include "driver/thread.hpp"
 
-/// Abstracts away sensors access, providing a cohesive state. It's
-/// completely synchronous.
-class Sensors {
+/// Common interface of sensor drivers. Measurements are split in `start` and
+/// `poll`, so slow sensors don't block the event loop.
+class SensorDriver {
+public:
+  virtual void setup() noexcept = 0;
+  /// Starts a measurement. Returns false if it can't start right now (ex: a
+  /// shared resource is busy), it will be retried in the next iteration
+  virtual auto start(iop::esp_time now) noexcept -> bool = 0;
+  /// Readings of the measurement started, once it's done
+  virtual auto poll(iop::esp_time now) noexcept
+      -> std::optional<std::vector<Reading>> = 0;
+  /// Readings each measurement produces, known after `setup`. Zero if there
+  /// is nothing to measure, or the sensor index isn't below
+  /// `maxSensorsPerMeasure`
+  virtual auto readings() const noexcept -> uint8_t = 0;
+
+  SensorDriver() noexcept = default;
+  virtual ~SensorDriver() noexcept = default;
+  SensorDriver(SensorDriver const &other) = delete;
+  SensorDriver(SensorDriver &&other) = delete;
+  auto operator=(SensorDriver const &other) -> SensorDriver & = delete;
+  auto operator=(SensorDriver &&other) -> SensorDriver & = delete;
+};
+
+/// Air temperature, humidity and heat index, read all at once
+class DhtSensor : public SensorDriver {
 #ifdef IOP_SENSORS
-  gpio::Pin soilResistivityPower;
-  // We use a shared_ptr because we have a self-reference to this and
-  // DallasTemperature only copies itself. So moving would mean
-  // 'soilTemperatureSensor' points to a unique_ptr that it doesn't own, so
-  // only copies are allowed. This is the simplest way. UNSAFE: SELF_REF
-  //std::shared_ptr<OneWire> soilTemperatureOneWireBus;
-  DallasTemperature soilTemperatureSensor;
-  DHT airTempAndHumiditySensor;
+  DHT dht;
 #endif
+  uint8_t sensor;
 
 public:
-  Sensors(const gpio::Pin soilResistivityPower,
-          const gpio::Pin soilTemperature, const gpio::Pin dht,
-          const uint8_t dhtVersion) noexcept
+  DhtSensor(gpio::Pin pin, uint8_t version, uint8_t sensor) noexcept;
+  void setup() noexcept override;
+  auto start(iop::esp_time now) noexcept -> bool override;
+  auto poll(iop::esp_time now) noexcept
+      -> std::optional<std::vector<Reading>> override;
+  auto readings() const noexcept -> uint8_t override;
+};
+
+/// How the soil resistivity probe is sampled. It's only powered while
+/// measuring, to slow down its corrosion
+struct SoilResistivityConfig {
+  /// Time between powering the probe and the first reading
+  iop::esp_time settle;
+  /// Readings averaged into a single measurement
+  uint8_t samples;
+  /// Time between each reading
+  iop::esp_time sampleInterval;
+};
+
+/// Resumable soil resistivity measurement. Instead of blocking while the
+/// probe settles, `poll` takes readings when they are due. The probe is
+/// powered off as soon as the last one is in.
+///
+/// Probes share the analog pin, so only one measures at a time.
+class SoilResistivitySensor : public SensorDriver {
+  enum class State {
+    IDLE,
+    SETTLING,
+    SAMPLING,
+  };
+
+  gpio::Pin power;
+  SoilResistivityConfig config;
+  uint8_t sensor;
+  State state;
+  iop::esp_time nextStep;
+  uint8_t taken;
+  uint32_t sum;
+
+public:
+  SoilResistivitySensor(gpio::Pin power, SoilResistivityConfig config,
+                        uint8_t sensor) noexcept;
+  void setup() noexcept override;
+  auto start(iop::esp_time now) noexcept -> bool override;
+  auto poll(iop::esp_time now) noexcept
+      -> std::optional<std::vector<Reading>> override;
+  auto readings() const noexcept -> uint8_t override;
+};
+
+/// Asynchronous DS18B20 probes, many may share the same OneWire bus. Up to
+/// `probes` of them are measured, each with its own sensor index starting from
+/// `firstSensor`. Indexes past the last one (`maxSensorsPerMeasure`) are
+/// ignored.
+///
+/// A probe keeps the index it got when first found, even if others disappear.
+/// Indexes without a probe report NaN.
+///
+/// ROM addresses are cached, so reads don't enumerate the bus again. It's
+/// only searched again while no probe is known or after one disconnects. A
+/// single conversion is broadcasted to every probe at `start`, without
+/// waiting, and the results are collected by `poll` once it's done.
+///
+/// Resolution trades precision for latency: 9 bits (0.5°C) converts in
+/// ~94ms, 12 bits (0.0625°C) in ~750ms.
+class SoilTemperatureSensor : public SensorDriver {
 #ifdef IOP_SENSORS
-      : soilResistivityPower(soilResistivityPower),
-        soilTemperatureSensor(),
-        airTempAndHumiditySensor(static_cast<uint8_t>(dht), dhtVersion) {
-    IOP_TRACE();
-    static OneWire oneWire(static_cast<uint8_t>(soilTemperature));
-    this->soilTemperatureSensor = DallasTemperature(&oneWire);
-#else
-{
-  IOP_TRACE();
-  (void) soilResistivityPower;
-  (void) soilTemperature;
-  (void) dht;
-  (void) dhtVersion;
+  // DallasTemperature keeps a pointer to the bus, drivers are never moved
+  OneWire bus;
+  DallasTemperature dallas;
 #endif
-  }
+  uint8_t resolution;
+  uint8_t firstSensor;
+  /// ROM address of the probe of each sensor index, zeroed if there is none
+  std::vector<std::array<uint8_t, 8>> addresses;
+  bool searching;
+  bool converting;
+  iop::esp_time readyAt;
+
+  void search() noexcept;
+
+public:
+  SoilTemperatureSensor(gpio::Pin pin, uint8_t resolution, uint8_t firstSensor,
+                        uint8_t probes) noexcept;
+  void setup() noexcept override;
+  auto start(iop::esp_time now) noexcept -> bool override;
+  /// Disconnected probes are logged and their readings are NaN
+  auto poll(iop::esp_time now) noexcept
+      -> std::optional<std::vector<Reading>> override;
+  auto readings() const noexcept -> uint8_t override;
+};
+
+/// Registry of the sensors fitted to this device. Sensors not registered
+/// cost nothing.
+///
+/// Each sensor is measured on its own interval, usually many times per
+/// reporting window. Their readings are aggregated until the window's
+/// summary is taken.
+class Sensors {
+  struct Entry {
+    std::shared_ptr<SensorDriver> driver;
+    iop::esp_time interval;
+    iop::esp_time next;
+    bool measuring;
+  };
+
+  std::vector<Entry> drivers;
+  Aggregator aggregator;
+
+public:
+  Sensors() noexcept : drivers(), aggregator() { IOP_TRACE(); }
+
+  /// Registers a sensor, measured every `interval` milliseconds
+  void add(std::shared_ptr<SensorDriver> driver, iop::esp_time interval) noexcept;
+  /// Sets the sensors up. Sensors without readings, or whose readings don't
+  /// fit an event (`maxEventReadings`) with the ones before them, are logged
+  /// and dropped
   void setup() noexcept;
-  auto measure() noexcept -> Event;
-  ~Sensors() noexcept { IOP_TRACE(); }
+  /// Starts the measurements due and collects the finished ones. Must be
+  /// called every loop iteration
+  void poll() noexcept;
+  /// Statistics of each sensor since the last call, starts a new window
+  auto take() noexcept -> Summary;
 
+  ~Sensors() noexcept { IOP_TRACE(); }
   Sensors(Sensors const &other)
-#ifdef IOP_SENSORS
-      : soilResistivityPower(other.soilResistivityPower),
-        soilTemperatureOneWireBus(other.soilTemperatureOneWireBus),
-        soilTemperatureSensor(other.soilTemperatureSensor),
-        airTempAndHumiditySensor(other.airTempAndHumiditySensor)
-#endif
-  {
+      : drivers(other.drivers), aggregator(other.aggregator) {
     IOP_TRACE();
   }
   Sensors(Sensors &&other) = delete;
@@ -58,15 +175,11 @@ public:
     IOP_TRACE();
     if (this == &other)
       return *this;
-#ifdef IOP_SENSORS
-    this->soilResistivityPower = other.soilResistivityPower;
-    this->soilTemperatureOneWireBus = other.soilTemperatureOneWireBus;
-    this->soilTemperatureSensor = other.soilTemperatureSensor;
-    this->airTempAndHumiditySensor = other.airTempAndHumiditySensor;
-#endif
+    this->drivers = other.drivers;
+    this->aggregator = other.aggregator;
     return *this;
   }
   auto operator=(Sensors &&other) -> Sensors & = delete;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -4,8 +4,11 @@
 #include "core/log.hpp"
 #include "core/utils.hpp"
 
+#include <algorithm>
+#include <array>
 #include <cstdint>
 #include <memory>
+#include <optional>
 
 // (Un)Comment this line to toggle credentials server dependency
 #define IOP_SERVER
@@ -61,6 +64,9 @@ namespace panic {
 }
 namespace network_logger {
   void setup() noexcept;
+  /// Sends buffered logs in batches and advances the one in flight, called by
+  /// the event loop
+  void poll() noexcept;
 }
 
 /// Abstracts factory resets
@@ -104,21 +110,57 @@ public:
       -> WifiCredentials & = default;
 };
 
+/// What a reading measures, the unit is part of the name
+enum class Measure : uint8_t {
+  AIR_TEMPERATURE_CELSIUS = 0,
+  AIR_HUMIDITY_PERCENTAGE = 1,
+  AIR_HEAT_INDEX_CELSIUS = 2,
+  SOIL_RESISTIVITY_RAW = 3,
+  SOIL_TEMPERATURE_CELSIUS = 4,
+};
+constexpr static uint8_t measureVariants = 5;
+
+/// Sensors of the same kind are told apart by their index, up to 16 of each
+constexpr static uint8_t maxSensorsPerMeasure = 16;
+
+struct Reading {
+  Measure measure;
+  uint8_t sensor;
+  float value;
+};
+
+/// Bounds the size of an event, so they can be stored in fixed flash slots
+constexpr static uint8_t maxEventReadings = 8;
+
+/// Readings are stored as parallel arrays, so there is no padding between
+/// them. Flash space is scarce. Only the first `length` are valid
 struct EventStorage {
-  float airTemperatureCelsius;
-  float airHumidityPercentage;
-  float airHeatIndexCelsius;
-  uint16_t soilResistivityRaw;
-  float soilTemperatureCelsius;
+  std::array<float, maxEventReadings> values;
+  /// `Measure` in the high nibble, sensor index in the low one
+  std::array<uint8_t, maxEventReadings> keys;
+  uint8_t length;
 };
 
+/// Variable set of readings, each sensor fitted reports its own
 class Event {
 public:
   EventStorage storage;
   ~Event() noexcept { IOP_TRACE(); }
+  Event() noexcept : storage{} { IOP_TRACE(); }
   explicit Event(EventStorage storage) noexcept : storage(storage) {
     IOP_TRACE();
+    this->storage.length = std::min(this->storage.length, maxEventReadings);
   }
+
+  auto size() const noexcept -> uint8_t { return this->storage.length; }
+  auto empty() const noexcept -> bool { return this->storage.length == 0; }
+  auto at(uint8_t index) const noexcept -> Reading;
+  /// Replaces the reading of the same sensor, if there is one. Returns false
+  /// if the event is full
+  auto set(Reading reading) noexcept -> bool;
+  auto find(Measure measure, uint8_t sensor) const noexcept -> std::optional<float>;
+  void clear() noexcept { this->storage.length = 0; }
+
   Event(Event const &ev) noexcept : storage(ev.storage) { IOP_TRACE(); }
   Event(Event &&ev) noexcept : storage(ev.storage) { IOP_TRACE(); }
   auto operator=(Event const &ev) noexcept -> Event & {
@@ -0,0 +1,96 @@
+#include "aggregation.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+RunningStats::RunningStats() noexcept
+    : count_(0), failures_(0), mean_(0), m2(0),
+      min_(std::numeric_limits<float>::infinity()),
+      max_(-std::numeric_limits<float>::infinity()) {}
+
+void RunningStats::add(const float sample) noexcept {
+  if (std::isnan(sample)) {
+    this->failures_++;
+    return;
+  }
+
+  this->count_++;
+  const auto delta = static_cast<double>(sample) - this->mean_;
+  this->mean_ += delta / this->count_;
+  this->m2 += delta * (static_cast<double>(sample) - this->mean_);
+  this->min_ = std::min(this->min_, sample);
+  this->max_ = std::max(this->max_, sample);
+}
+
+void RunningStats::reset() noexcept { *this = RunningStats(); }
+
+auto RunningStats::mean() const noexcept -> float {
+  if (this->count_ == 0)
+    return std::numeric_limits<float>::quiet_NaN();
+  return static_cast<float>(this->mean_);
+}
+
+auto RunningStats::min() const noexcept -> float {
+  if (this->count_ == 0)
+    return std::numeric_limits<float>::quiet_NaN();
+  return this->min_;
+}
+
+auto RunningStats::max() const noexcept -> float {
+  if (this->count_ == 0)
+    return std::numeric_limits<float>::quiet_NaN();
+  return this->max_;
+}
+
+auto RunningStats::stddev() const noexcept -> float {
+  if (this->count_ < 2)
+    return 0;
+  return static_cast<float>(std::sqrt(this->m2 / (this->count_ - 1)));
+}
+
+auto Summary::toEvent() const noexcept -> Event {
+  IOP_TRACE();
+  Event event;
+  for (const auto &reading: this->readings)
+    event.set((Reading){reading.measure, reading.sensor, reading.mean});
+  return event;
+}
+
+void Aggregator::add(const Reading &reading) noexcept {
+  IOP_TRACE();
+  for (auto &entry: this->entries) {
+    if (entry.measure == reading.measure && entry.sensor == reading.sensor) {
+      entry.stats.add(reading.value);
+      return;
+    }
+  }
+
+  this->entries.push_back((Entry){reading.measure, reading.sensor, RunningStats()});
+  this->entries.back().stats.add(reading.value);
+}
+
+auto Aggregator::take() noexcept -> Summary {
+  IOP_TRACE();
+  Summary summary;
+  summary.readings.reserve(this->entries.size());
+  for (auto &entry: this->entries) {
+    const auto &stats = entry.stats;
+    // Windows where the sensor only failed are reported, as NaN
+    if (stats.count() == 0 && stats.failures() == 0)
+      continue;
+
+    summary.readings.push_back((ReadingSummary){
+        .measure = entry.measure,
+        .sensor = entry.sensor,
+        .min = stats.min(),
+        .max = stats.max(),
+        .mean = stats.mean(),
+        .stddev = stats.stddev(),
+        .count = stats.count(),
+    });
+    // Entries are kept, the set of sensors rarely changes
+    entry.stats.reset();
+  }
+  return summary;
+}
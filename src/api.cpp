@@ -1,6 +1,8 @@
 #include "api.hpp"
+#include "codec.hpp"
 #include "core/cert_store.hpp"
 #include "generated/certificates.hpp"
+#include "generated/pins.hpp"
 #include "utils.hpp"
 #include <string>
 #include "loop.hpp"
@@ -12,11 +14,16 @@
 #ifndef IOP_API_DISABLED
 
 #include "driver/client.hpp"
+#include "driver/device.hpp"
 #include "driver/server.hpp"
 #include "cont.h"
 
-auto Api::makeJson(const iop::StaticString name, const JsonCallback &func) const noexcept
-    -> std::optional<std::reference_wrapper<std::array<char, 1024>>> {
+#include <algorithm>
+#include <array>
+
+auto Api::makePayload(const iop::StaticString name, const JsonCallback &func,
+                      const iop::ContentType type) const noexcept
+    -> std::optional<iop::BodyStream> {
   IOP_TRACE();
   iop::logMemory(this->logger);
 
@@ -25,15 +32,23 @@ auto Api::makeJson(const iop::StaticString name, const JsonCallback &func) const
   func(doc);
 
   if (doc.overflowed()) {
-    this->logger.error(F("Payload doesn't fit Json<1024> at "), name);
-    return std::optional<std::reference_wrapper<std::array<char, 1024>>>();
+    this->logger.error(F("Payload doesn't fit json document of 1024 bytes at "), name);
+    return std::optional<iop::BodyStream>();
   }
 
-  auto &fixed = unused4KbSysStack.text();
-  fixed.fill('\0');
-  serializeJson(doc, fixed.data(), fixed.max_size());
-  this->logger.debug(F("Json: "), iop::to_view(fixed));
-  return std::make_optional(std::ref(fixed));
+  // The payload is serialized again for every chunk sent, straight into the
+  // connection. So the only thing kept in memory is the document
+  const auto size = type == iop::ContentType::MSGPACK ? measureMsgPack(doc) : measureJson(doc);
+  this->logger.debug(F("Payload: "), std::to_string(size), F(" bytes"));
+
+  const auto serialize = [&doc, type](iop::WindowWriter &writer) {
+    if (type == iop::ContentType::MSGPACK) {
+      serializeMsgPack(doc, writer);
+    } else {
+      serializeJson(doc, writer);
+    }
+  };
+  return std::make_optional(iop::BodyStream(serialize, size));
 }
 
 #ifdef IOP_ONLINE
@@ -62,96 +77,269 @@ auto Api::setup() const noexcept -> void {
   iop::Network::setUpgradeHook(iop::UpgradeHook(upgradeScheduler));
 #endif
 
+#ifdef IOP_SSL
+  // Pinned issuers first, the whole bundle if the server changes its CA
+  static iop::CertStore certStore(generated::certList);
+  iop::Network::setCertStore(certStore);
+  iop::Network::setPinnedIssuers(generated::pins, generated::pinSizes, generated::numberOfPins);
+#endif
+
   this->network().setup();
 
-#ifdef IOP_SSL
-  // client.setInsecure();
-  // We should make sure our server supports Max Fragment Length Negotiation
-  // if (client.probeMaxFragmentLength(uri, port, 512))
-  //     client.setBufferSizes(512, 512);
 #endif
+}
 
+auto Api::mockIfNeeded(iop::PendingRequest request) const noexcept -> iop::PendingRequest {
+#ifndef IOP_MOCK_MONITOR
+  (void)*this;
+  return request;
+#else
+  (void)*this;
+  request.wait();
+  return iop::PendingRequest::finished(iop::NetworkStatus::OK);
 #endif
 }
 
 auto Api::reportPanic(const AuthToken &authToken,
                       const PanicData &event) const noexcept
-    -> iop::NetworkStatus {
+    -> iop::PendingRequest {
   IOP_TRACE();
   this->logger.debug(F("Report iop_panic: "), event.msg);
 
-  auto msg = event.msg;
-  std::optional<std::reference_wrapper<std::array<char, 1024>>> maybeJson;
-
-  while (true) {
-    const auto make = [event, &msg](JsonDocument &doc) {
-      doc["file"] = event.file.toStdString();
-      doc["line"] = event.line;
-      doc["func"] = event.func.toStdString();
-      doc["msg"] = msg;
-    };
-    maybeJson = this->makeJson(F("Api::reportPanic"), make);
-
-    if (!maybeJson.has_value()) {
-      iop_assert(msg.length() / 2 != 0, F("Message would be empty, function is broken"));
-      msg = msg.substr(0, msg.length() / 2);
+  const auto type = iop::Network::acceptedContentType();
+
+  // Strings are linked by pointer, so the document doesn't store them and
+  // the message size isn't limited by it
+  const auto file = event.file.toStdString();
+  const auto func = event.func.toStdString();
+  const auto msg = std::string(event.msg);
+  const auto make = [&file, &func, &msg, &event](JsonDocument &doc) {
+    doc["file"] = file.c_str();
+    doc["line"] = event.line;
+    doc["func"] = func.c_str();
+    doc["msg"] = msg.c_str();
+  };
+  auto maybePayload = this->makePayload(F("Api::reportPanic"), make, type);
+  if (!maybePayload.has_value())
+    return iop::PendingRequest::finished(iop::NetworkStatus::CLIENT_BUFFER_OVERFLOW);
+  auto &payload = iop::unwrap_mut(maybePayload, IOP_CTX());
+
+  const auto token = std::string_view(authToken.data(), authToken.max_size());
+  return this->mockIfNeeded(this->network().httpPostAsync(token, F("/v1/panic"), std::move(payload), type));
+}
+
+// Literals are linked by the json document, instead of copied
+static const std::array<const char *, measureVariants> measureNames = {
+  "air_temperature_celsius",
+  "air_humidity_percentage",
+  "air_heat_index_celsius",
+  "soil_resistivity_raw",
+  "soil_temperature_celsius",
+};
+
+// Enough for the longest measure name plus "_15" and the null terminator
+constexpr const size_t maxReadingNameSize = 32;
+
+/// Sensors after the first of each kind get their index as a suffix
+/// (`soil_temperature_celsius_1`), those keys are copied into the document
+auto Api::eventJsonSize(const Event &event) noexcept -> size_t {
+  size_t size = JSON_OBJECT_SIZE(event.size());
+  for (uint8_t index = 0; index < event.size(); ++index) {
+    if (event.at(index).sensor > 0)
+      size += maxReadingNameSize;
+  }
+  return size;
+}
+
+void Api::fillEvent(JsonObject obj, const Event &event) noexcept {
+  for (uint8_t index = 0; index < event.size(); ++index) {
+    const auto reading = event.at(index);
+    const auto *name = measureNames.at(static_cast<uint8_t>(reading.measure));
+    if (reading.sensor == 0) {
+      obj[name] = reading.value;
       continue;
     }
-    break;
+
+    obj[std::string(name) + "_" + std::to_string(reading.sensor)] = reading.value;
   }
+}
 
-  if (!maybeJson.has_value())
-    return iop::NetworkStatus::CLIENT_BUFFER_OVERFLOW;
-  const auto &json = iop::unwrap(maybeJson, IOP_CTX()).get();
+void Api::fillSummary(JsonObject obj, const Summary &summary) noexcept {
+  for (const auto &reading: summary.readings) {
+    const auto *name = measureNames.at(static_cast<uint8_t>(reading.measure));
+    auto stats = reading.sensor == 0
+      ? obj.createNestedObject(name)
+      : obj.createNestedObject(std::string(name) + "_" + std::to_string(reading.sensor));
+    stats["min"] = reading.min;
+    stats["max"] = reading.max;
+    stats["mean"] = reading.mean;
+    stats["stddev"] = reading.stddev;
+    stats["count"] = reading.count;
+  }
+}
 
-  const auto token = std::string_view(authToken.data(), authToken.max_size());
-  auto const & maybeResp = this->network().httpPost(token, F("/v1/panic"), json.data());
+auto Api::registerSummary(const AuthToken &authToken,
+                          const Summary &summary) const noexcept
+    -> iop::PendingRequest {
+  IOP_TRACE();
+  this->logger.debug(F("Send summary"));
 
-#ifndef IOP_MOCK_MONITOR
-  if (iop::is_err(maybeResp)) {
-    const auto code = std::to_string(iop::unwrap_err_ref(maybeResp, IOP_CTX()));
-    this->logger.error(F("Unexpected response at Api::reportPanic: "), code);
-    return iop::NetworkStatus::BROKEN_SERVER;
-  }
-  return iop::unwrap_ok_ref(maybeResp, IOP_CTX()).status;
-#else
-  return iop::NetworkStatus::OK;
-#endif
+  const auto make = [&summary](JsonDocument &doc) {
+    Api::fillSummary(doc.to<JsonObject>(), summary);
+  };
+  const auto type = iop::Network::acceptedContentType();
+  auto maybePayload = this->makePayload(F("Api::registerSummary"), make, type);
+  if (!maybePayload.has_value())
+    return iop::PendingRequest::finished(iop::NetworkStatus::CLIENT_BUFFER_OVERFLOW);
+  auto &payload = iop::unwrap_mut(maybePayload, IOP_CTX());
+
+  const auto token = std::string_view(authToken.data(), authToken.max_size());
+  return this->mockIfNeeded(this->network().httpPostAsync(token, F("/v1/summary"), std::move(payload), type));
 }
 
 auto Api::registerEvent(const AuthToken &authToken,
                         const Event &event) const noexcept
-    -> iop::NetworkStatus {
+    -> iop::PendingRequest {
   IOP_TRACE();
   this->logger.debug(F("Send event"));
 
   const auto make = [&event](JsonDocument &doc) {
-    doc["air_temperature_celsius"] = event.storage.airTemperatureCelsius;
-    doc["air_humidity_percentage"] = event.storage.airHumidityPercentage;
-    doc["air_heat_index_celsius"] = event.storage.airHeatIndexCelsius;
-    doc["soil_temperature_celsius"] = event.storage.soilTemperatureCelsius;
-    doc["soil_resistivity_raw"] = event.storage.soilResistivityRaw;
+    Api::fillEvent(doc.to<JsonObject>(), event);
   };
   // 256 bytes is more than enough (we checked, it doesn't get to 200 bytes)
-  auto maybeJson = this->makeJson(F("Api::registerEvent"), make);
-  if (!maybeJson.has_value())
-    return iop::NetworkStatus::CLIENT_BUFFER_OVERFLOW;
-  const auto &json = iop::unwrap(maybeJson, IOP_CTX()).get();
+  const auto type = iop::Network::acceptedContentType();
+  auto maybePayload = this->makePayload(F("Api::registerEvent"), make, type);
+  if (!maybePayload.has_value())
+    return iop::PendingRequest::finished(iop::NetworkStatus::CLIENT_BUFFER_OVERFLOW);
+  auto &payload = iop::unwrap_mut(maybePayload, IOP_CTX());
 
   const auto token = std::string_view(authToken.data(), authToken.max_size());
-  auto const & maybeResp = this->network().httpPost(token, F("/v1/event"), json.data());
+  return this->mockIfNeeded(this->network().httpPostAsync(token, F("/v1/event"), std::move(payload), type));
+}
+// Json object of a full event plus its serialized text (we checked, it doesn't
+// get to 300 bytes)
+constexpr const size_t eventBatchItemCost = JSON_OBJECT_SIZE(maxEventReadings) + maxEventReadings * maxReadingNameSize + 300;
+constexpr const uint16_t maxEventBatchSize = 32;
+
+auto Api::eventBatchSize() const noexcept -> uint16_t {
+  IOP_TRACE();
+  // Only half of the biggest block is used, so we don't starve the heap
+  const auto available = driver::device.biggestHeapBlock() / 2;
+  const auto fits = available / eventBatchItemCost;
+  if (fits == 0)
+    return 1;
+  return static_cast<uint16_t>(std::min<size_t>(fits, maxEventBatchSize));
+}
+
+/// Receives the per event statuses of `registerEvents`. Static, so it
+/// outlives the asynchronous request
+static auto eventStatusPayload() noexcept -> iop::PayloadBuffer & {
+  // One status code per event, like [200,403], fits the biggest batch
+  static std::array<char, 256> buffer;
+  static iop::PayloadBuffer payload(buffer);
+  return payload;
+}
+
+auto Api::registerEvents(const AuthToken &authToken,
+                         const std::vector<Event> &events) const noexcept
+    -> iop::PendingRequest {
+  IOP_TRACE();
+  this->logger.debug(F("Send events: "), std::to_string(events.size()));
+  if (events.empty())
+    return iop::PendingRequest::finished(iop::NetworkStatus::OK);
+
+  // Delta encoding is much smaller than any document, when supported
+  if (iop::Network::isContentTypeAccepted(iop::ContentType::IOP_EVENTS)) {
+    const auto encoded = EventCodec().encode(events);
+    this->logger.debug(F("Delta encoded events: "), std::to_string(encoded.size()), F(" bytes"));
+    const auto view = std::string_view(reinterpret_cast<const char *>(encoded.data()), encoded.size());
+    return this->sendEvents(authToken, iop::BodyStream::fromView(view), iop::ContentType::IOP_EVENTS);
+  }
+
+  // Batches don't fit the 1KB document we keep, so they are heap allocated
+  const auto type = iop::Network::acceptedContentType();
+  size_t capacity = JSON_ARRAY_SIZE(events.size());
+  for (const auto &event: events)
+    capacity += Api::eventJsonSize(event);
+  DynamicJsonDocument doc(capacity);
+  // The heap may just be fragmented right now, like a request that doesn't fit
+  // it (see `Network::httpPostAsync`). Only an overflow is a bug
+  if (doc.capacity() == 0) {
+    this->logger.warn(F("Unable to allocate json for events, retrying later: "), std::to_string(events.size()));
+    return iop::PendingRequest::finished(iop::NetworkStatus::CONNECTION_ISSUES);
+  }
+
+  auto array = doc.to<JsonArray>();
+  for (const auto &event: events)
+    Api::fillEvent(array.createNestedObject(), event);
+
+  if (doc.overflowed()) {
+    this->logger.error(F("Payload doesn't fit Json at Api::registerEvents"));
+    return iop::PendingRequest::finished(iop::NetworkStatus::CLIENT_BUFFER_OVERFLOW);
+  }
+
+  const auto serialize = [&doc, type](iop::WindowWriter &writer) {
+    if (type == iop::ContentType::MSGPACK) {
+      serializeMsgPack(doc, writer);
+    } else {
+      serializeJson(doc, writer);
+    }
+  };
+  const auto size = type == iop::ContentType::MSGPACK ? measureMsgPack(doc) : measureJson(doc);
+  return this->sendEvents(authToken, iop::BodyStream(serialize, size), type);
+}
+
+auto Api::eventStatus(const int code) noexcept -> EventStatus {
+  if (code >= 200 && code < 300)
+    return EventStatus::DELIVERED;
+  // 429 means slow down, not that the event is wrong
+  if (code >= 400 && code < 500 && code != 429)
+    return EventStatus::REJECTED;
+  return EventStatus::RETRY;
+}
+
+auto Api::sendEvents(const AuthToken &authToken, iop::BodyStream body,
+                     const iop::ContentType type) const noexcept
+    -> iop::PendingRequest {
+  IOP_TRACE();
+  const auto token = std::string_view(authToken.data(), authToken.max_size());
+  auto sink = eventStatusPayload().sink();
+  return this->mockIfNeeded(this->network().httpPostAsync(token, F("/v1/events"), std::move(body), type, std::move(sink)));
+}
+
+auto Api::eventStatuses(const size_t count) const noexcept
+    -> std::variant<std::vector<EventStatus>, iop::NetworkStatus> {
+  IOP_TRACE();
+  if (count == 0)
+    return std::vector<EventStatus>();
 
 #ifndef IOP_MOCK_MONITOR
-  if (iop::is_err(maybeResp)) {
-    const auto code = std::to_string(iop::unwrap_err_ref(maybeResp, IOP_CTX()));
-    this->logger.error(F("Unexpected response at Api::registerEvent: "), code);
+  const auto &payload = eventStatusPayload();
+  if (payload.length() == 0) {
+    this->logger.error(F("Server answered OK, but payload is missing"));
     return iop::NetworkStatus::BROKEN_SERVER;
   }
-  return iop::unwrap_ok_ref(maybeResp, IOP_CTX()).status;
+
+  // The server answers with an array of HTTP status codes, one per event
+  DynamicJsonDocument doc(JSON_ARRAY_SIZE(count));
+  const auto view = payload.view();
+  const auto error = deserializeJson(doc, view.data(), view.length());
+  const auto codes = doc.as<JsonArrayConst>();
+  if (error || codes.isNull() || codes.size() != count) {
+    this->logger.error(F("Invalid per event status at Api::registerEvents: "), iop::to_view(iop::scapeNonPrintable(view)));
+    return iop::NetworkStatus::BROKEN_SERVER;
+  }
+
+  std::vector<EventStatus> statuses;
+  statuses.reserve(count);
+  for (const auto code: codes)
+    statuses.push_back(Api::eventStatus(code.as<int>()));
+  return statuses;
 #else
-  return iop::NetworkStatus::OK;
+  return std::vector<EventStatus>(count, EventStatus::DELIVERED);
 #endif
 }
+
 auto Api::authenticate(std::string_view username,
                        std::string_view password) const noexcept
     -> std::variant<AuthToken, iop::NetworkStatus> {
@@ -169,13 +357,15 @@ auto Api::authenticate(std::string_view username,
     doc["email"] = username;
     doc["password"] = password;
   };
-  auto maybeJson = this->makeJson(F("Api::authenticate"), make);
+  auto maybeJson = this->makePayload(F("Api::authenticate"), make, iop::ContentType::JSON);
 
   if (!maybeJson.has_value())
     return iop::NetworkStatus::CLIENT_BUFFER_OVERFLOW;
-  const auto &json = iop::unwrap(maybeJson, IOP_CTX()).get();
+  auto &json = iop::unwrap_mut(maybeJson, IOP_CTX());
   
-  auto const & maybeResp = this->network().httpPost(F("/v1/user/login"), json.data());
+  // The token is written straight to its final place, bigger ones are refused
+  iop::PayloadBuffer payload(unused4KbSysStack.token());
+  auto const & maybeResp = this->network().httpPost(F("/v1/user/login"), json, payload.sink());
 
 #ifndef IOP_MOCK_MONITOR
   if (iop::is_err(maybeResp)) {
@@ -190,46 +380,80 @@ auto Api::authenticate(std::string_view username,
     return resp.status;
   }
 
-  if (!resp.payload.has_value()) {
+  if (payload.length() == 0) {
     this->logger.error(F("Server answered OK, but payload is missing"));
     return iop::NetworkStatus::BROKEN_SERVER;
   }
 
-  const auto & payload = iop::unwrap_ref(resp.payload, IOP_CTX());
-  if (!iop::isAllPrintable(payload)) {
-    this->logger.error(F("Unprintable payload, this isn't supported: "), iop::to_view(iop::scapeNonPrintable(payload)));
+  if (!iop::isAllPrintable(payload.view())) {
+    this->logger.error(F("Unprintable payload, this isn't supported: "), iop::to_view(iop::scapeNonPrintable(payload.view())));
     return iop::NetworkStatus::BROKEN_SERVER;
   }
   if (payload.length() != 64) {
     this->logger.error(F("Auth token does not occupy 64 bytes: size = "), std::to_string(payload.length()));
+    return iop::NetworkStatus::BROKEN_SERVER;
   }
 
-  memcpy(unused4KbSysStack.token().data(), payload.c_str(), 64);
   return unused4KbSysStack.token();
 #else
   return AuthToken::empty();
 #endif
 }
 
+static auto msgPackStrHeaderLength(const size_t length) noexcept -> size_t {
+  if (length < 32) return 1;
+  if (length <= UINT8_MAX) return 2;
+  if (length <= UINT16_MAX) return 3;
+  return 5;
+}
+
+/// Big endian, like everything in MessagePack
+static auto msgPackStrHeader(const size_t length) noexcept -> std::array<uint8_t, 5> {
+  std::array<uint8_t, 5> header = {0};
+  const auto len = static_cast<uint32_t>(length);
+  switch (msgPackStrHeaderLength(length)) {
+  case 1: // fixstr
+    header[0] = static_cast<uint8_t>(0xa0 | len);
+    break;
+  case 2: // str8
+    header[0] = 0xd9;
+    header[1] = static_cast<uint8_t>(len);
+    break;
+  case 3: // str16
+    header[0] = 0xda;
+    header[1] = static_cast<uint8_t>(len >> 8);
+    header[2] = static_cast<uint8_t>(len);
+    break;
+  default: // str32
+    header[0] = 0xdb;
+    header[1] = static_cast<uint8_t>(len >> 24);
+    header[2] = static_cast<uint8_t>(len >> 16);
+    header[3] = static_cast<uint8_t>(len >> 8);
+    header[4] = static_cast<uint8_t>(len);
+  }
+  return header;
+}
+
 auto Api::registerLog(const AuthToken &authToken,
                       std::string_view log) const noexcept
-    -> iop::NetworkStatus {
+    -> iop::PendingRequest {
   IOP_TRACE();
   const auto token = std::string_view(authToken.data(), authToken.max_size());
   this->logger.debug(F("Register log. Token: "), token, F(". Log: "), log);
-  auto const & maybeResp = this->network().httpPost(token, F("/v1/log"), std::move(log));
 
-#ifndef IOP_MOCK_MONITOR
-  if (iop::is_err(maybeResp)) {
-    const auto code = std::to_string(iop::unwrap_err_ref(maybeResp, IOP_CTX()));
-    this->logger.error(F("Unexpected response at Api::registerLog: "), code);
-    return iop::NetworkStatus::BROKEN_SERVER;
-  }
+  // MessagePack strings are a header with their length followed by the raw
+  // bytes, so the log is streamed as is, without being copied
+  const auto type = iop::Network::acceptedContentType();
+  const auto header = msgPackStrHeader(log.length());
+  const auto serialize = [log, header, type](iop::WindowWriter &writer) {
+    if (type == iop::ContentType::MSGPACK)
+      writer.write(header.data(), msgPackStrHeaderLength(log.length()));
+    writer.write(reinterpret_cast<const uint8_t *>(log.begin()), log.length());
+  };
+  const auto headerLength = type == iop::ContentType::MSGPACK ? msgPackStrHeaderLength(log.length()) : 0;
+  auto payload = iop::BodyStream(serialize, headerLength + log.length());
 
-  return iop::unwrap_ok_ref(maybeResp, IOP_CTX()).status;
-#else
-  return iop::NetworkStatus::OK;
-#endif
+  return this->mockIfNeeded(this->network().httpPostAsync(token, F("/v1/log"), std::move(payload), type));
 }
 
 #ifdef IOP_DESKTOP
@@ -300,21 +524,50 @@ auto Api::upgrade(const AuthToken &token) const noexcept
 }
 auto Api::reportPanic(const AuthToken &authToken,
                       const PanicData &event) const noexcept
-    -> iop::NetworkStatus {
+    -> iop::PendingRequest {
   (void)*this;
   (void)authToken;
   (void)event;
   IOP_TRACE();
-  return iop::NetworkStatus::OK;
+  return iop::PendingRequest::finished(iop::NetworkStatus::OK);
 }
 auto Api::registerEvent(const AuthToken &token,
                         const Event &event) const noexcept
-    -> iop::NetworkStatus {
+    -> iop::PendingRequest {
   (void)*this;
   (void)token;
   (void)event;
   IOP_TRACE();
-  return iop::NetworkStatus::OK;
+  return iop::PendingRequest::finished(iop::NetworkStatus::OK);
+}
+auto Api::registerSummary(const AuthToken &token,
+                          const Summary &summary) const noexcept
+    -> iop::PendingRequest {
+  (void)*this;
+  (void)token;
+  (void)summary;
+  IOP_TRACE();
+  return iop::PendingRequest::finished(iop::NetworkStatus::OK);
+}
+auto Api::registerEvents(const AuthToken &token,
+                         const std::vector<Event> &events) const noexcept
+    -> iop::PendingRequest {
+  (void)*this;
+  (void)token;
+  (void)events;
+  IOP_TRACE();
+  return iop::PendingRequest::finished(iop::NetworkStatus::OK);
+}
+auto Api::eventStatuses(const size_t count) const noexcept
+    -> std::variant<std::vector<EventStatus>, iop::NetworkStatus> {
+  (void)*this;
+  IOP_TRACE();
+  return std::vector<EventStatus>(count, EventStatus::DELIVERED);
+}
+auto Api::eventBatchSize() const noexcept -> uint16_t {
+  (void)*this;
+  IOP_TRACE();
+  return 1;
 }
 auto Api::authenticate(std::string_view username,
                        std::string_view password) const noexcept
@@ -327,12 +580,12 @@ auto Api::authenticate(std::string_view username,
 }
 auto Api::registerLog(const AuthToken &authToken,
                       std::string_view log) const noexcept
-    -> iop::NetworkStatus {
+    -> iop::PendingRequest {
   (void)*this;
   (void)authToken;
   (void)std::move(log);
   IOP_TRACE();
-  return iop::NetworkStatus::OK;
+  return iop::PendingRequest::finished(iop::NetworkStatus::OK);
 }
 
 auto Api::setup() const noexcept -> void {}
@@ -0,0 +1,180 @@
+#include "codec.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+
+// Quantized NaN, can't be produced by a real value because of the clamping
+constexpr const int32_t quantizedNaN = std::numeric_limits<int32_t>::min();
+// Latest quantized value of each sensor, indexed by its reading key
+constexpr const uint16_t keyCount = measureVariants * maxSensorsPerMeasure;
+
+using Resolutions = std::array<float, measureVariants>;
+
+static auto resolutions(const EventResolution &resolution) noexcept -> Resolutions {
+  return {
+    resolution.airTemperatureCelsius,
+    resolution.airHumidityPercentage,
+    resolution.airHeatIndexCelsius,
+    static_cast<float>(resolution.soilResistivityRaw),
+    resolution.soilTemperatureCelsius,
+  };
+}
+
+static auto quantize(const float value, const float resolution) noexcept -> int32_t {
+  if (std::isnan(value))
+    return quantizedNaN;
+
+  // Float can't represent INT32_MAX exactly, so the rounded value is clamped
+  constexpr auto max = std::numeric_limits<int32_t>::max();
+  constexpr auto limit = static_cast<float>(max);
+  const auto rounded = std::llround(std::clamp(value / resolution, -limit, limit));
+  return static_cast<int32_t>(std::clamp<long long>(rounded, -max, max));
+}
+
+static auto dequantize(const int32_t value, const float resolution) noexcept -> float {
+  if (value == quantizedNaN)
+    return std::numeric_limits<float>::quiet_NaN();
+  return static_cast<float>(value) * resolution;
+}
+
+static void writeVarint(std::vector<uint8_t> &out, uint64_t value) noexcept {
+  while (value >= 0x80) {
+    out.push_back(static_cast<uint8_t>(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<uint8_t>(value));
+}
+
+static auto readVarint(const uint8_t *&data, const uint8_t *end) noexcept -> std::optional<uint64_t> {
+  uint64_t value = 0;
+  for (uint8_t shift = 0; shift < 64 && data < end; shift += 7) {
+    const auto byte = *data++; // NOLINT *-pro-bounds-pointer-arithmetic
+    value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0)
+      return value;
+  }
+  return std::optional<uint64_t>();
+}
+
+// Maps small negative numbers to small positive ones: 0, -1, 1, -2, 2...
+static auto zigzag(const int64_t value) noexcept -> uint64_t {
+  return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+static auto unzigzag(const uint64_t value) noexcept -> int64_t {
+  return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+auto EventCodec::defaultResolution() noexcept -> EventResolution {
+  return (EventResolution) {
+    .airTemperatureCelsius = 0.1F,
+    .airHumidityPercentage = 0.1F,
+    .airHeatIndexCelsius = 0.1F,
+    .soilResistivityRaw = 1,
+    .soilTemperatureCelsius = 0.1F,
+  };
+}
+
+EventCodec::EventCodec(const EventResolution resolution) noexcept
+    : resolution_(resolution) {
+  IOP_TRACE();
+}
+
+auto EventCodec::encode(const std::vector<Event> &events) const noexcept
+    -> std::vector<uint8_t> {
+  IOP_TRACE();
+  // Header plus two bytes per reading, deltas are usually a single byte
+  std::vector<uint8_t> out;
+  out.reserve(2 + 3 * measureVariants + events.size() * (1 + maxEventReadings * 2));
+
+  out.push_back(EventCodec::version);
+  writeVarint(out, events.size());
+
+  // The resolution is sent in thousandths, so the server can dequantize
+  auto res = resolutions(this->resolution_);
+  for (auto &resolution: res) {
+    const auto thousandths = std::max(1LL, std::llround(resolution * 1000));
+    writeVarint(out, static_cast<uint64_t>(thousandths));
+    // Both sides must quantize with the exact value that was sent
+    resolution = static_cast<float>(thousandths) / 1000;
+  }
+
+  // The first reading of each sensor in the batch is a delta from zero, so
+  // it's a keyframe
+  std::vector<int32_t> previous(keyCount, 0);
+  for (const auto &event: events) {
+    writeVarint(out, event.size());
+    for (uint8_t index = 0; index < event.size(); ++index) {
+      const auto key = event.storage.keys.at(index);
+      const auto reading = event.at(index);
+      const auto current = quantize(reading.value, res.at(static_cast<uint8_t>(reading.measure)));
+      out.push_back(key);
+      writeVarint(out, zigzag(static_cast<int64_t>(current) - previous.at(key)));
+      previous.at(key) = current;
+    }
+  }
+  return out;
+}
+
+auto EventCodec::decode(const uint8_t *data, const size_t length) noexcept
+    -> std::optional<std::vector<Event>> {
+  IOP_TRACE();
+  const auto *const end = data + length; // NOLINT *-pro-bounds-pointer-arithmetic
+  if (length == 0 || *data++ != EventCodec::version) // NOLINT *-pro-bounds-pointer-arithmetic
+    return std::optional<std::vector<Event>>();
+
+  const auto count = readVarint(data, end);
+  // Every event needs at least a byte
+  if (!count.has_value() || *count > length)
+    return std::optional<std::vector<Event>>();
+
+  Resolutions res = {0};
+  for (auto &resolution: res) {
+    const auto thousandths = readVarint(data, end);
+    if (!thousandths.has_value() || *thousandths == 0)
+      return std::optional<std::vector<Event>>();
+    resolution = static_cast<float>(*thousandths) / 1000;
+  }
+
+  std::vector<Event> events;
+  events.reserve(*count);
+
+  std::vector<int32_t> previous(keyCount, 0);
+  for (uint64_t event = 0; event < *count; ++event) {
+    const auto readings = readVarint(data, end);
+    if (!readings.has_value() || *readings > maxEventReadings)
+      return std::optional<std::vector<Event>>();
+
+    Event decoded;
+    for (uint8_t index = 0; index < *readings; ++index) {
+      if (data >= end)
+        return std::optional<std::vector<Event>>();
+      const auto key = *data++; // NOLINT *-pro-bounds-pointer-arithmetic
+      const auto measure = static_cast<uint8_t>(key >> 4);
+      const auto delta = readVarint(data, end);
+      if (measure >= measureVariants || !delta.has_value())
+        return std::optional<std::vector<Event>>();
+
+      // Encoded values are quantized into 32 bits, anything else is corrupt
+      int32_t current = 0;
+      if (__builtin_add_overflow(previous.at(key), unzigzag(*delta), &current))
+        return std::optional<std::vector<Event>>();
+      previous.at(key) = current;
+      const auto reading = (Reading) {
+        .measure = static_cast<Measure>(measure),
+        .sensor = static_cast<uint8_t>(key & 0x0F),
+        .value = dequantize(previous.at(key), res.at(measure)),
+      };
+      // Repeated sensors in the same event are malformed
+      if (decoded.find(reading.measure, reading.sensor).has_value() || !decoded.set(reading))
+        return std::optional<std::vector<Event>>();
+    }
+    events.push_back(decoded);
+  }
+
+  if (data != end)
+    return std::optional<std::vector<Event>>();
+  return events;
+}
@@ -0,0 +1,201 @@
+#include "core/body_stream.hpp"
+#include "core/log.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace iop {
+WindowWriter::WindowWriter(uint8_t *out, const size_t begin,
+                           const size_t length) noexcept
+    : out(out), begin(begin), end(begin + length), position(0) {}
+
+auto WindowWriter::write(const uint8_t byte) noexcept -> size_t {
+  return this->write(&byte, 1);
+}
+
+auto WindowWriter::write(const uint8_t *buffer, const size_t length) noexcept
+    -> size_t {
+  const auto start = this->position;
+  this->position += length;
+
+  const auto from = std::max(start, this->begin);
+  const auto to = std::min(this->position, this->end);
+  if (from < to) {
+    // NOLINTNEXTLINE *-pro-bounds-pointer-arithmetic
+    memcpy(this->out + (from - this->begin), buffer + (from - start), to - from);
+  }
+
+  // We always pretend everything was written, so serializers don't abort
+  return length;
+}
+
+auto WindowWriter::written() const noexcept -> size_t {
+  if (this->position <= this->begin)
+    return 0;
+  return std::min(this->position, this->end) - this->begin;
+}
+
+BodyStream::BodyStream(Serializer serializer, const size_t size) noexcept
+    : serializer(std::move(serializer)), size_(size), position(0), stored(false), cache{0},
+      cacheStart(0), cacheLength(0) {
+  IOP_TRACE();
+}
+
+auto BodyStream::fromView(const std::string_view data) noexcept -> BodyStream {
+  IOP_TRACE();
+  const auto serialize = [data](WindowWriter &writer) {
+    writer.write(reinterpret_cast<const uint8_t *>(data.begin()), data.length());
+  };
+  auto stream = BodyStream(serialize, data.length());
+  stream.stored = true;
+  return stream;
+}
+
+auto BodyStream::detach() noexcept -> BodyStream {
+  IOP_TRACE();
+  // Shared, so copies of the stream don't copy the body
+  auto data = std::make_shared<std::string>(this->size_, '\0');
+  WindowWriter writer(reinterpret_cast<uint8_t *>(&(*data)[0]), 0, this->size_);
+  this->serializer(writer);
+  data->resize(writer.written());
+
+  const auto serialize = [data](WindowWriter &writer) {
+    writer.write(reinterpret_cast<const uint8_t *>(data->data()), data->length());
+  };
+  auto stream = BodyStream(serialize, data->length());
+  stream.stored = true;
+  return stream;
+}
+
+auto BodyStream::buffer(const size_t limit) noexcept -> bool {
+  IOP_TRACE();
+  if (this->stored)
+    return true;
+  if (this->size_ > limit)
+    return false;
+
+  const auto position = this->position;
+  *this = this->detach();
+  this->position = position;
+  return true;
+}
+
+void BodyStream::rewind() noexcept {
+  IOP_TRACE();
+  // The serializer is deterministic, the cache stays valid
+  this->position = 0;
+}
+
+auto BodyStream::available() -> int {
+  return static_cast<int>(this->size_ - this->position);
+}
+
+auto BodyStream::peek() -> int {
+  if (this->position >= this->size_)
+    return -1;
+
+  const auto cached = this->position >= this->cacheStart &&
+                      this->position < this->cacheStart + this->cacheLength;
+  if (!cached) {
+    const auto length = std::min(this->cache.size(), this->size_ - this->position);
+    WindowWriter writer(this->cache.data(), this->position, length);
+    this->serializer(writer);
+
+    this->cacheStart = this->position;
+    this->cacheLength = writer.written();
+    if (this->cacheLength == 0)
+      return -1;
+  }
+  return this->cache.at(this->position - this->cacheStart);
+}
+
+auto BodyStream::read() -> int {
+  const auto byte = this->peek();
+  if (byte >= 0)
+    this->position++;
+  return byte;
+}
+
+auto BodyStream::read(uint8_t *buffer, const size_t length) -> int {
+  const auto toRead = std::min(length, this->size_ - this->position);
+  if (toRead == 0)
+    return 0;
+
+  WindowWriter writer(buffer, this->position, toRead);
+  this->serializer(writer);
+  this->position += writer.written();
+  return static_cast<int>(writer.written());
+}
+
+auto BodyStream::readBytes(char *buffer, const size_t length) -> size_t {
+  return static_cast<size_t>(this->read(reinterpret_cast<uint8_t *>(buffer), length));
+}
+
+auto BodyStream::write(const uint8_t byte) -> size_t {
+  (void)byte;
+  return 0;
+}
+
+auto BodyStream::write(const uint8_t *buffer, const size_t length) -> size_t {
+  (void)buffer;
+  (void)length;
+  return 0;
+}
+
+PayloadBuffer::PayloadBuffer(char *data, const size_t capacity) noexcept
+    : data(data), capacity(capacity), length_(0) {
+  IOP_TRACE();
+}
+
+auto PayloadBuffer::sink() noexcept -> PayloadSink {
+  IOP_TRACE();
+  this->length_ = 0;
+  return [this](const std::string_view piece) {
+    if (piece.length() > this->capacity - this->length_)
+      return false;
+    memcpy(this->data + this->length_, piece.data(), piece.length());
+    this->length_ += piece.length();
+    return true;
+  };
+}
+
+auto PayloadBuffer::view() const noexcept -> std::string_view {
+  return std::string_view(this->data, this->length_);
+}
+
+PayloadStream::PayloadStream(PayloadSink sink, const size_t limit) noexcept
+    : sink(std::move(sink)), limit(limit), length_(0), refused_(false) {
+  IOP_TRACE();
+}
+
+auto PayloadStream::write(const uint8_t byte) -> size_t {
+  return this->write(&byte, 1);
+}
+
+auto PayloadStream::write(const uint8_t *buffer, const size_t length) -> size_t {
+  if (this->refused_)
+    return 0;
+
+  const std::string_view piece(reinterpret_cast<const char *>(buffer), length);
+  if (length > this->limit - this->length_ || (this->sink && !this->sink(piece))) {
+    this->refused_ = true;
+    return 0;
+  }
+  this->length_ += length;
+  return length;
+}
+
+auto PayloadStream::available() -> int { return 0; }
+auto PayloadStream::read() -> int { return -1; }
+auto PayloadStream::peek() -> int { return -1; }
+auto PayloadStream::read(uint8_t *buffer, const size_t length) -> int {
+  (void)buffer;
+  (void)length;
+  return 0;
+}
+auto PayloadStream::readBytes(char *buffer, const size_t length) -> size_t {
+  (void)buffer;
+  (void)length;
+  return 0;
+}
+} // namespace iop
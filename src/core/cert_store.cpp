@@ -3,13 +3,80 @@
 #include "core/utils.hpp"
 #include "driver/cert_store.hpp"
 
+#include <algorithm>
+#include <iterator>
+
 namespace iop {
 
-constexpr const uint8_t hashSize = 32;
+constexpr const uint8_t hashSize = CertList::hashSize;
 
 CertStore::CertStore(CertList certList) noexcept
-    : certList(std::move(certList)) {
+    : certList(std::move(certList)), cache(), cacheBytes(0),
+      maxCacheBytes(defaultCacheBytes), stats_{0, 0, 0, 0, 0} {
+  IOP_TRACE();
+}
+
+// Decoded anchors live in the heap, so moving them around keeps the pointers
+// handed to BearSSL valid
+CertStore::CertStore(CertStore &&other) noexcept
+    : certList(std::move(other.certList)), cache(std::move(other.cache)),
+      cacheBytes(other.cacheBytes), maxCacheBytes(other.maxCacheBytes),
+      stats_(other.stats_) {
+  IOP_TRACE();
+  other.cache.clear();
+  other.cacheBytes = 0;
+}
+
+auto CertStore::operator=(CertStore &&other) noexcept -> CertStore & {
+  IOP_TRACE();
+  this->certList = std::move(other.certList);
+  this->cache = std::move(other.cache);
+  this->cacheBytes = other.cacheBytes;
+  this->maxCacheBytes = other.maxCacheBytes;
+  this->stats_ = other.stats_;
+  other.cache.clear();
+  other.cacheBytes = 0;
+  return *this;
+}
+
+void CertStore::setCertList(CertList list) noexcept {
   IOP_TRACE();
+  this->certList = std::move(list);
+  // BearSSL may still be validating a chain with some of them
+  for (auto &entry: this->cache)
+    entry.stale = true;
+  this->trim();
+}
+
+void CertStore::setCacheSize(const size_t bytes) noexcept {
+  IOP_TRACE();
+  this->maxCacheBytes = bytes;
+  this->trim();
+}
+
+void CertStore::trim() noexcept {
+  for (auto entry = this->cache.begin(); entry != this->cache.end();) {
+    if (!entry->stale || entry->users > 0) {
+      ++entry;
+      continue;
+    }
+    this->cacheBytes -= entry->bytes;
+    this->stats_.evictions++;
+    this->stats_.freedBytes += entry->bytes;
+    entry = this->cache.erase(entry);
+  }
+
+  while (this->cacheBytes > this->maxCacheBytes) {
+    auto victim = std::find_if(this->cache.rbegin(), this->cache.rend(),
+                               [](const CachedAnchor &entry) { return entry.users == 0; });
+    if (victim == this->cache.rend())
+      break;
+
+    this->cacheBytes -= victim->bytes;
+    this->stats_.evictions++;
+    this->stats_.freedBytes += victim->bytes;
+    this->cache.erase(std::next(victim).base());
+  }
 }
 
 auto CertStore::findHashedTA(void *ctx, void *hashed_dn, size_t len)
@@ -30,34 +97,51 @@ auto CertStore::findHashedTA(void *ctx, void *hashed_dn, size_t len)
     iop_panic(StaticString(F("Invalid hash len, this is critical: ")).toStdString()
                 + std::to_string(len));
 
-  const auto &list = cs->certList;
-  for (uint16_t i = 0; i < list.count(); i++) {
-    const auto cert = list.cert(i);
+  // Cached anchors have the hash as their DN
+  for (auto entry = cs->cache.begin(); entry != cs->cache.end(); ++entry) {
+    if (entry->stale || memcmp(entry->anchor->dn.data, hashed_dn, hashSize) != 0)
+      continue;
 
-    if (memcmp_P(hashed_dn, cert.index, hashSize) == 0) {
-      cs->x509.emplace(cert.cert, *cert.size);
-      const auto *taTmp = iop::unwrap_ref(cs->x509, IOP_CTX()).getTrustAnchors();
+    entry->users++;
+    cs->stats_.hits++;
+    std::rotate(cs->cache.begin(), entry, std::next(entry));
+    return cs->cache.front().anchor;
+  }
 
-      // We can const cast because x509 is heap allocated and we own it so it's
-      // mutable. This isn't a const function. The upstream API is just that way
-      // NOLINTNEXTLINE cppcoreguidelines-pro-type-const-cast
-      auto *ta = const_cast<br_x509_trust_anchor *>(taTmp);
+  const auto maybeCert = cs->certList.find(static_cast<const uint8_t *>(hashed_dn));
+  if (!maybeCert.has_value())
+    return nullptr;
+  const auto &cert = iop::unwrap_ref(maybeCert, IOP_CTX());
 
-      memcpy_P(ta->dn.data, cert.index, hashSize);
-      ta->dn.len = hashSize;
+  const uint16_t size = pgm_read_word(cert.size);
+  auto x509 = std::make_unique<BearSSL::X509List>(cert.cert, size);
 
-      return ta;
-    }
-  }
+  // We can const cast because x509 is heap allocated and we own it so it's
+  // mutable. This isn't a const function. The upstream API is just that way
+  // NOLINTNEXTLINE cppcoreguidelines-pro-type-const-cast
+  auto *ta = const_cast<br_x509_trust_anchor *>(x509->getTrustAnchors());
+
+  memcpy_P(ta->dn.data, cert.index, hashSize);
+  ta->dn.len = hashSize;
 
-  return nullptr;
+  cs->stats_.misses++;
+  cs->stats_.allocatedBytes += size;
+  cs->cacheBytes += size;
+  cs->cache.insert(cs->cache.begin(), CachedAnchor { std::move(x509), ta, size, 1, false });
+  cs->trim();
+  return ta;
 }
 
 void CertStore::freeHashedTA(void *ctx, const br_x509_trust_anchor *ta) {
   IOP_TRACE();
-  (void)ta; // Unused
+  auto *cs = static_cast<CertStore *>(ctx);
 
-  static_cast<CertStore *>(ctx)->x509.reset();
+  // Stays cached, unless it doesn't fit anymore or its CertList was replaced
+  for (auto &entry: cs->cache) {
+    if (entry.anchor == ta && entry.users > 0)
+      entry.users--;
+  }
+  cs->trim();
 }
 
 void CertStore::installCertStore(br_x509_minimal_context *ctx) {
@@ -77,9 +161,9 @@ Cert::Cert(Cert &&other) noexcept
 }
 
 CertList::CertList(const uint8_t *const *certs, const uint8_t *const *indexes,
-                   const uint16_t *sizes,
+                   const uint16_t *sizes, const uint16_t *buckets,
                    const uint16_t numberOfCertificates) noexcept
-    : sizes(sizes), indexes(indexes), certs(certs),
+    : sizes(sizes), indexes(indexes), certs(certs), buckets(buckets),
       numberOfCertificates(numberOfCertificates) {
   IOP_TRACE();
 }
@@ -95,10 +179,44 @@ auto CertList::cert(uint16_t index) const noexcept -> Cert {
   return {this->certs[index], this->indexes[index], &this->sizes[index]};
 }
 
+auto CertList::find(const uint8_t *hash) const noexcept -> std::optional<Cert> {
+  IOP_TRACE();
+  // Hashes are uniformly distributed, so buckets hold very few certificates.
+  // PROGMEM must be read in aligned words
+  // NOLINTNEXTLINE cppcoreguidelines-pro-bounds-pointer-arithmetic
+  uint16_t low = pgm_read_word(&this->buckets[hash[0]]);
+  // NOLINTNEXTLINE cppcoreguidelines-pro-bounds-pointer-arithmetic
+  uint16_t high = pgm_read_word(&this->buckets[hash[0] + 1]);
+
+  // Lower bound, so the first of equal hashes is found (like the build order)
+  while (low < high) {
+    const auto middle = static_cast<uint16_t>(low + (high - low) / 2);
+    // NOLINTNEXTLINE cppcoreguidelines-pro-bounds-pointer-arithmetic
+    if (memcmp_P(hash, this->indexes[middle], hashSize) > 0) {
+      low = static_cast<uint16_t>(middle + 1);
+    } else {
+      high = middle;
+    }
+  }
+
+  // NOLINTNEXTLINE cppcoreguidelines-pro-bounds-pointer-arithmetic
+  if (low >= this->numberOfCertificates || memcmp_P(hash, this->indexes[low], hashSize) != 0)
+    return std::nullopt;
+  return this->cert(low);
+}
+
 CertList::CertList(CertList &&other) noexcept
     : sizes(other.sizes), indexes(other.indexes), certs(other.certs),
-      numberOfCertificates(other.numberOfCertificates) {
+      buckets(other.buckets), numberOfCertificates(other.numberOfCertificates) {
+  IOP_TRACE();
+}
+
+auto TrustSelector::connectionFailed(const int sslError) noexcept -> bool {
   IOP_TRACE();
+  if (!this->pinned_ || sslError <= x509Errors || sslError >= x509Errors + 32)
+    return false;
+  this->pinned_ = false;
+  return true;
 }
 
 } // namespace iop
\ No newline at end of file
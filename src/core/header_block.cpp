@@ -0,0 +1,79 @@
+#include "core/header_block.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+static void append(std::array<char, 160> &block, size_t &length, const std::string_view data) noexcept {
+  const auto size = std::min(data.length(), block.size() - length);
+  memcpy(block.data() + length, data.data(), size);
+  length += size;
+}
+
+static void writeHex(char *out, const uint32_t value) noexcept {
+  constexpr const char digits[] = "0123456789abcdef";
+  for (uint8_t index = 0; index < 8; ++index)
+    out[index] = digits[(value >> (28 - index * 4)) & 0xF];
+}
+
+static auto readHex(const std::string_view in) noexcept -> std::optional<uint32_t> {
+  uint32_t value = 0;
+  for (const auto digit: in) {
+    value <<= 4;
+    if (digit >= '0' && digit <= '9') {
+      value |= static_cast<uint32_t>(digit - '0');
+    } else if (digit >= 'a' && digit <= 'f') {
+      value |= static_cast<uint32_t>(digit - 'a' + 10);
+    } else {
+      return std::nullopt;
+    }
+  }
+  return value;
+}
+
+namespace iop {
+HeaderBlock::HeaderBlock() noexcept : block{0}, length(0), telemetryOffset(0) {}
+
+void HeaderBlock::setup(const std::string_view version, const std::string_view macAddress) noexcept {
+  this->length = 0;
+  append(this->block, this->length, "VERSION: ");
+  append(this->block, this->length, version);
+  append(this->block, this->length, "\r\nMAC_ADDRESS: ");
+  append(this->block, this->length, macAddress);
+  append(this->block, this->length, "\r\nTELEMETRY: ");
+  this->telemetryOffset = this->length;
+  append(this->block, this->length, std::string_view("0000000000000000000000000000000000000000", telemetryLength));
+  append(this->block, this->length, "\r\n");
+}
+
+auto HeaderBlock::update(const Telemetry &telemetry) noexcept -> std::string_view {
+  // Unreachable if `setup` was called, the block fits the longest version and MAC
+  if (this->telemetryOffset + telemetryLength > this->length)
+    return this->view();
+
+  auto *out = this->block.data() + this->telemetryOffset;
+  writeHex(out, telemetry.freeStack);
+  writeHex(out + 8, telemetry.freeHeap);
+  writeHex(out + 16, telemetry.biggestFreeBlock);
+  writeHex(out + 24, telemetry.vcc);
+  writeHex(out + 32, telemetry.timeRunning);
+  return this->view();
+}
+
+auto HeaderBlock::view() const noexcept -> std::string_view {
+  return std::string_view(this->block.data(), this->length);
+}
+
+auto HeaderBlock::parseTelemetry(const std::string_view value) noexcept -> std::optional<Telemetry> {
+  if (value.length() != telemetryLength)
+    return std::nullopt;
+
+  std::array<uint32_t, 5> fields = {0};
+  for (uint8_t index = 0; index < fields.size(); ++index) {
+    const auto field = readHex(value.substr(index * 8, 8));
+    if (!field.has_value())
+      return std::nullopt;
+    fields[index] = *field;
+  }
+  return Telemetry{fields[0], fields[1], fields[2], fields[3], fields[4]};
+}
+} // namespace iop
@@ -0,0 +1,336 @@
+#include "core/http_parser.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+static auto toLower(const char c) noexcept -> char {
+  return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+static auto equalsIgnoreCase(const std::string_view a, const std::string_view b) noexcept -> bool {
+  if (a.length() != b.length())
+    return false;
+  for (size_t index = 0; index < a.length(); ++index) {
+    if (toLower(a[index]) != toLower(b[index]))
+      return false;
+  }
+  return true;
+}
+
+static auto containsIgnoreCase(const std::string_view haystack, const std::string_view needle) noexcept -> bool {
+  if (needle.length() > haystack.length())
+    return false;
+  for (size_t index = 0; index + needle.length() <= haystack.length(); ++index) {
+    if (equalsIgnoreCase(haystack.substr(index, needle.length()), needle))
+      return true;
+  }
+  return false;
+}
+
+static auto trim(std::string_view view) noexcept -> std::string_view {
+  while (!view.empty() && (view.front() == ' ' || view.front() == '\t'))
+    view.remove_prefix(1);
+  while (!view.empty() && (view.back() == ' ' || view.back() == '\t'))
+    view.remove_suffix(1);
+  return view;
+}
+
+namespace iop {
+HttpParser::HttpParser(BodySink sink) noexcept
+    : state_(ParserState::STATUS_LINE), sink(std::move(sink)), keys(), values(),
+      line{0}, lineLength(0), status_(0), keepAlive_(false), chunked(false),
+      contentLength_(), remaining(0), bodyLength_(0) {}
+
+void HttpParser::collect(const std::string_view key) noexcept {
+  this->keys.emplace_back(key);
+  this->values.emplace_back();
+}
+
+void HttpParser::setSink(BodySink sink) noexcept {
+  this->sink = std::move(sink);
+}
+
+void HttpParser::reset() noexcept {
+  this->state_ = ParserState::STATUS_LINE;
+  this->lineLength = 0;
+  this->status_ = 0;
+  this->keepAlive_ = false;
+  this->chunked = false;
+  this->contentLength_.reset();
+  this->remaining = 0;
+  this->bodyLength_ = 0;
+  for (auto &value: this->values)
+    value.reset();
+}
+
+auto HttpParser::header(const std::string_view key) const noexcept -> std::optional<std::string_view> {
+  for (size_t index = 0; index < this->keys.size(); ++index) {
+    if (equalsIgnoreCase(this->keys[index], key) && this->values[index].has_value())
+      return std::string_view(*this->values[index]);
+  }
+  return std::nullopt;
+}
+
+// Lines that are whole in the input are parsed in place, only the ones split
+// between reads are buffered
+auto HttpParser::feedLine(const std::string_view data, size_t &consumed) noexcept
+    -> std::optional<std::string_view> {
+  const auto *newline = static_cast<const char *>(memchr(data.data(), '\n', data.length()));
+  const auto length = newline == nullptr ? data.length() : static_cast<size_t>(newline - data.data());
+  consumed = newline == nullptr ? length : length + 1;
+
+  std::string_view view;
+  if (this->lineLength == 0 && newline != nullptr) {
+    view = data.substr(0, length);
+  } else {
+    if (this->lineLength + length > this->line.size()) {
+      this->state_ = ParserState::FAILED;
+      return std::nullopt;
+    }
+    memcpy(this->line.data() + this->lineLength, data.data(), length);
+    this->lineLength += length;
+    if (newline == nullptr)
+      return std::nullopt;
+
+    view = std::string_view(this->line.data(), this->lineLength);
+    this->lineLength = 0;
+  }
+
+  if (view.length() > this->line.size()) {
+    this->state_ = ParserState::FAILED;
+    return std::nullopt;
+  }
+  if (!view.empty() && view.back() == '\r')
+    view.remove_suffix(1);
+  return view;
+}
+
+void HttpParser::parseStatusLine(const std::string_view line) noexcept {
+  // HTTP/1.1 200 OK
+  if (line.length() < 12 || line.substr(0, 7) != "HTTP/1." ||
+      (line[7] != '0' && line[7] != '1') || line[8] != ' ') {
+    this->state_ = ParserState::FAILED;
+    return;
+  }
+
+  uint16_t status = 0;
+  for (const auto digit: line.substr(9, 3)) {
+    if (digit < '0' || digit > '9') {
+      this->state_ = ParserState::FAILED;
+      return;
+    }
+    status = static_cast<uint16_t>(status * 10 + (digit - '0'));
+  }
+  if (line.length() > 12 && line[12] != ' ') {
+    this->state_ = ParserState::FAILED;
+    return;
+  }
+
+  this->status_ = status;
+  // HTTP/1.0 closes by default, HTTP/1.1 keeps alive by default
+  this->keepAlive_ = line[7] == '1';
+  this->state_ = ParserState::HEADER_LINE;
+}
+
+void HttpParser::parseHeaderLine(const std::string_view line) noexcept {
+  if (line.empty()) {
+    // Interim response (ex: 100 Continue), the real one follows
+    if (this->status_ < 200) {
+      const auto keepAlive = this->keepAlive_;
+      this->reset();
+      this->keepAlive_ = keepAlive;
+      return;
+    }
+
+    if (this->status_ == 204 || this->status_ == 304) {
+      this->state_ = ParserState::DONE;
+    } else if (this->chunked) {
+      this->state_ = ParserState::CHUNK_SIZE;
+    } else if (this->contentLength_.has_value()) {
+      this->remaining = *this->contentLength_;
+      this->state_ = this->remaining == 0 ? ParserState::DONE : ParserState::BODY;
+    } else {
+      this->keepAlive_ = false;
+      this->state_ = ParserState::BODY_UNTIL_CLOSE;
+    }
+    return;
+  }
+
+  const auto colon = line.find(':');
+  // Obsolete line folding is refused, like RFC 7230 allows
+  if (colon == line.npos || colon == 0 || line[0] == ' ' || line[0] == '\t') {
+    this->state_ = ParserState::FAILED;
+    return;
+  }
+  const auto key = line.substr(0, colon);
+  const auto value = trim(line.substr(colon + 1));
+
+  if (equalsIgnoreCase(key, "content-length")) {
+    if (value.empty()) {
+      this->state_ = ParserState::FAILED;
+      return;
+    }
+    size_t length = 0;
+    for (const auto digit: value) {
+      if (digit < '0' || digit > '9' || length > (std::numeric_limits<size_t>::max() - 9) / 10) {
+        this->state_ = ParserState::FAILED;
+        return;
+      }
+      length = length * 10 + static_cast<size_t>(digit - '0');
+    }
+    // Conflicting lengths are a request smuggling vector
+    if (this->contentLength_.has_value() && *this->contentLength_ != length) {
+      this->state_ = ParserState::FAILED;
+      return;
+    }
+    this->contentLength_ = length;
+
+  } else if (equalsIgnoreCase(key, "transfer-encoding")) {
+    this->chunked = containsIgnoreCase(value, "chunked");
+
+  } else if (equalsIgnoreCase(key, "connection")) {
+    if (containsIgnoreCase(value, "close"))
+      this->keepAlive_ = false;
+    else if (containsIgnoreCase(value, "keep-alive"))
+      this->keepAlive_ = true;
+  }
+
+  for (size_t index = 0; index < this->keys.size(); ++index) {
+    if (equalsIgnoreCase(this->keys[index], key))
+      this->values[index].emplace(value);
+  }
+}
+
+void HttpParser::parseChunkSize(std::string_view line) noexcept {
+  // Chunk extensions are ignored
+  line = trim(line.substr(0, line.find(';')));
+  if (line.empty()) {
+    this->state_ = ParserState::FAILED;
+    return;
+  }
+
+  size_t size = 0;
+  for (const auto digit: line) {
+    size_t value = 0;
+    if (digit >= '0' && digit <= '9') {
+      value = static_cast<size_t>(digit - '0');
+    } else if (toLower(digit) >= 'a' && toLower(digit) <= 'f') {
+      value = static_cast<size_t>(toLower(digit) - 'a' + 10);
+    } else {
+      this->state_ = ParserState::FAILED;
+      return;
+    }
+    if (size > std::numeric_limits<size_t>::max() / 16) {
+      this->state_ = ParserState::FAILED;
+      return;
+    }
+    size = size * 16 + value;
+  }
+
+  this->remaining = size;
+  this->state_ = size == 0 ? ParserState::TRAILER_LINE : ParserState::CHUNK_DATA;
+}
+
+auto HttpParser::deliver(const std::string_view body) noexcept -> bool {
+  this->bodyLength_ += body.length();
+  if (this->sink && !this->sink(body)) {
+    this->state_ = ParserState::FAILED;
+    return false;
+  }
+  return true;
+}
+
+auto HttpParser::feed(const std::string_view data) noexcept -> size_t {
+  return this->feed(data, false);
+}
+
+auto HttpParser::feedHeaders(const std::string_view data) noexcept -> size_t {
+  return this->feed(data, true);
+}
+
+auto HttpParser::feed(const std::string_view data, const bool headersOnly) noexcept -> size_t {
+  size_t offset = 0;
+  while (offset < data.length()) {
+    if (headersOnly && this->headersDone())
+      return offset;
+    const auto rest = data.substr(offset);
+
+    switch (this->state_) {
+    case ParserState::DONE:
+    case ParserState::FAILED:
+      return offset;
+
+    case ParserState::STATUS_LINE:
+    case ParserState::HEADER_LINE:
+    case ParserState::CHUNK_SIZE:
+    case ParserState::CHUNK_DATA_END:
+    case ParserState::TRAILER_LINE: {
+      size_t consumed = 0;
+      const auto maybeLine = this->feedLine(rest, consumed);
+      offset += consumed;
+      if (!maybeLine.has_value())
+        break;
+      const auto line = *maybeLine;
+
+      switch (this->state_) {
+      case ParserState::STATUS_LINE:
+        this->parseStatusLine(line);
+        break;
+      case ParserState::HEADER_LINE:
+        this->parseHeaderLine(line);
+        break;
+      case ParserState::CHUNK_SIZE:
+        this->parseChunkSize(line);
+        break;
+      case ParserState::CHUNK_DATA_END:
+        this->state_ = line.empty() ? ParserState::CHUNK_SIZE : ParserState::FAILED;
+        break;
+      case ParserState::TRAILER_LINE:
+        // Trailers are ignored
+        if (line.empty())
+          this->state_ = ParserState::DONE;
+        break;
+      case ParserState::BODY:
+      case ParserState::BODY_UNTIL_CLOSE:
+      case ParserState::CHUNK_DATA:
+      case ParserState::DONE:
+      case ParserState::FAILED:
+        break;
+      }
+      break;
+    }
+
+    case ParserState::BODY:
+    case ParserState::CHUNK_DATA: {
+      const auto size = std::min(this->remaining, rest.length());
+      offset += size;
+      if (!this->deliver(rest.substr(0, size)))
+        return offset;
+
+      this->remaining -= size;
+      if (this->remaining == 0) {
+        this->state_ = this->state_ == ParserState::BODY
+                     ? ParserState::DONE
+                     : ParserState::CHUNK_DATA_END;
+      }
+      break;
+    }
+
+    case ParserState::BODY_UNTIL_CLOSE:
+      offset += rest.length();
+      this->deliver(rest);
+      break;
+    }
+  }
+  return offset;
+}
+
+void HttpParser::finish() noexcept {
+  if (this->state_ == ParserState::BODY_UNTIL_CLOSE) {
+    this->state_ = ParserState::DONE;
+  } else if (this->state_ != ParserState::DONE) {
+    this->state_ = ParserState::FAILED;
+  }
+}
+} // namespace iop
@@ -2,16 +2,14 @@
 #include "core/utils.hpp"
 #include <string>
 #include "driver/device.hpp"
+#include "driver/thread.hpp"
 #include "driver/wifi.hpp"
 #include <umm_malloc/umm_heap_select.h>
 
 static bool initialized = false;
 static bool isTracing_ = false; 
-static bool shouldFlush_ = true;
-
-void iop::Log::shouldFlush(const bool flush) noexcept {
-  shouldFlush_ = flush;
-}
+/// Messages are written from here, without blocking the logger
+static iop::LogRing ring;
 
 auto iop::Log::isTracing() noexcept -> bool { 
   return isTracing_;
@@ -23,9 +21,29 @@ constexpr static iop::LogHook defaultHook(iop::LogHook::defaultViewPrinter,
                                       iop::LogHook::defaultFlusher);
 static iop::LogHook hook = defaultHook;
 
+static auto defaultLineTermination() -> iop::StaticString {
+  return iop::StaticString(F("\n"));
+}
+
 namespace iop {
 void IRAM_ATTR Log::setup(LogLevel level) noexcept { hook.setup(level); }
-void Log::flush() noexcept { if (shouldFlush_) hook.flush(); }
+void Log::flush() noexcept { hook.flush(); }
+auto Log::poll() noexcept -> size_t {
+#ifdef IOP_SERIAL
+  return ring.drain(logWrite);
+#else
+  return 0;
+#endif
+}
+auto Log::dropped() noexcept -> uint32_t { return ring.dropped(); }
+void Log::write(const std::string_view bytes) noexcept {
+#ifdef IOP_SERIAL
+  ring.push(bytes);
+  logPending();
+#else
+  (void)bytes;
+#endif
+}
 void IRAM_ATTR Log::print(const std::string_view view, const LogLevel level,
                                 const LogType kind) noexcept {
   if (level > LogLevel::TRACE)
@@ -78,11 +96,9 @@ void Log::log(const LogLevel &level, const StaticString &msg,
   if (this->level_ > level)
     return;
 
-  Log::flush();
   this->printLogType(logType, level);
   Log::print(msg, level, LogType::CONTINUITY);
   Log::print(lineTermination, level, LogType::END);
-  Log::flush();
 }
 
 void Log::log(const LogLevel &level, const std::string_view &msg,
@@ -91,11 +107,58 @@ void Log::log(const LogLevel &level, const std::string_view &msg,
   if (this->level_ > level)
     return;
 
-  Log::flush();
   this->printLogType(logType, level);
   Log::print(msg, level, LogType::CONTINUITY);
   Log::print(lineTermination, level, LogType::END);
-  Log::flush();
+}
+
+void Log::log(const LogLevel &level, const LogPart *parts, const size_t count) const noexcept {
+  if (this->level_ > level || level == LogLevel::NO_LOG || count == 0)
+    return;
+
+  // Hooks that encode whole messages themselves
+  if (hook.record != nullptr) {
+    hook.record(level, this->target_, parts, count);
+    return;
+  }
+
+  // Header, message and line termination
+  constexpr size_t maxParts = 32;
+  const auto isDefault = hook.viewPrint == LogHook::defaultViewPrinter &&
+                         hook.staticPrint == LogHook::defaultStaticPrinter;
+
+  // Custom hooks get the pieces, like they always did
+  if (!isDefault || count + 6 > maxParts) {
+    for (size_t index = 0; index < count; ++index) {
+      const auto last = index + 1 == count;
+      const auto type = index == 0 ? (last ? LogType::STARTEND : LogType::START)
+                                   : (last ? LogType::END : LogType::CONTINUITY);
+      const auto termination = last ? defaultLineTermination() : StaticString(F(""));
+      if (parts[index].kind == LogPart::Kind::FLASH) {
+        this->log(level, StaticString(FPSTR(parts[index].data)), type, termination);
+      } else if (parts[index].isNumber()) {
+        std::array<char, LogPart::maxNumberLength> number;
+        const auto length = parts[index].format(number.data());
+        this->log(level, std::string_view(number.data(), length), type, termination);
+      } else {
+        this->log(level, std::string_view(parts[index].data, parts[index].length), type, termination);
+      }
+    }
+    return;
+  }
+
+#ifdef IOP_SERIAL
+  std::array<LogPart, maxParts> record;
+  record[0] = F("[");
+  record[1] = this->levelToString(level);
+  record[2] = F("] ");
+  record[3] = this->target_;
+  record[4] = F(": ");
+  std::copy(parts, parts + count, record.begin() + 5);
+  record[count + 5] = defaultLineTermination();
+  ring.push(record.data(), count + 6);
+  logPending();
+#endif
 }
 
 auto Log::levelToString(const LogLevel level) const noexcept -> StaticString {
@@ -121,7 +184,9 @@ auto Log::levelToString(const LogLevel level) const noexcept -> StaticString {
 void IRAM_ATTR LogHook::defaultStaticPrinter(
     const StaticString str, const LogLevel level, const LogType type) noexcept {
 #ifdef IOP_SERIAL
-  logPrint(str);
+  const LogPart part(str);
+  ring.push(&part, 1);
+  logPending();
 #else
   (void)str;
 #endif
@@ -131,7 +196,8 @@ void IRAM_ATTR LogHook::defaultStaticPrinter(
 void IRAM_ATTR
 LogHook::defaultViewPrinter(const std::string_view str, const LogLevel level, const LogType type) noexcept {
 #ifdef IOP_SERIAL
-  logPrint(str);
+  ring.push(str);
+  logPending();
 #else
   (void)str;
 #endif
@@ -149,6 +215,16 @@ LogHook::defaultSetuper(const LogLevel level) noexcept {
 }
 void LogHook::defaultFlusher() noexcept {
 #ifdef IOP_SERIAL
+  // Another thread may be draining it, or a message may be half written. But
+  // if nothing drains for a while (ex: the serial stopped taking bytes, or a
+  // writer died mid message) the rest is given up on, instead of hanging
+  constexpr const iop::esp_time stallLimit = 100;
+  auto lastProgress = driver::thisThread.now();
+  while (!ring.isEmpty() && driver::thisThread.now() - lastProgress < stallLimit) {
+    // Doesn't yield, it may be called while panicking
+    if (ring.drain(logWrite) > 0)
+      lastProgress = driver::thisThread.now();
+  }
   logFlush();
 #endif
 }
@@ -157,13 +233,13 @@ LogHook::LogHook(LogHook const &other) noexcept
     : viewPrint(other.viewPrint), staticPrint(other.staticPrint),
       setup(other.setup), flush(other.flush),
       traceViewPrint(other.traceViewPrint),
-      traceStaticPrint(other.traceStaticPrint) {}
+      traceStaticPrint(other.traceStaticPrint), record(other.record) {}
 LogHook::LogHook(LogHook &&other) noexcept
     // NOLINTNEXTLINE cert-oop11-cpp cert-oop54-cpp *-move-constructor-init
     : viewPrint(other.viewPrint), staticPrint(other.staticPrint),
       setup(other.setup), flush(other.flush),
       traceViewPrint(other.traceViewPrint),
-      traceStaticPrint(other.traceStaticPrint) {}
+      traceStaticPrint(other.traceStaticPrint), record(other.record) {}
 auto LogHook::operator=(LogHook const &other) noexcept -> LogHook & {
   if (this == &other)
     return *this;
@@ -173,6 +249,7 @@ auto LogHook::operator=(LogHook const &other) noexcept -> LogHook & {
   this->flush = other.flush;
   this->traceViewPrint = other.traceViewPrint;
   this->traceStaticPrint = other.traceStaticPrint;
+  this->record = other.record;
   return *this;
 }
 auto LogHook::operator=(LogHook &&other) noexcept -> LogHook & {
@@ -184,7 +261,6 @@ Tracer::Tracer(CodePoint point) noexcept : point(std::move(point)) {
   if (!Log::isTracing())
     return;
 
-  Log::flush();
   Log::print(F("[TRACE] TRACER: Entering new scope, at line "), LogLevel::TRACE,
              LogType::START);
   Log::print(std::to_string(this->point.line()), LogLevel::TRACE, LogType::CONTINUITY);
@@ -209,13 +285,11 @@ Tracer::Tracer(CodePoint point) noexcept : point(std::move(point)) {
   Log::print(F(", Connection "), LogLevel::TRACE, LogType::CONTINUITY);
   Log::print(std::to_string(WiFi.status() == WL_CONNECTED), LogLevel::TRACE, LogType::CONTINUITY);
   Log::print(F("\n"), LogLevel::TRACE, LogType::END);
-  Log::flush();
 }
 Tracer::~Tracer() noexcept {
   if (!Log::isTracing())
     return;
 
-  Log::flush();
   Log::print(F("[TRACE] TRACER: Leaving scope, at line "), LogLevel::TRACE,
              LogType::START);
   Log::print(std::to_string(this->point.line()), LogLevel::TRACE,
@@ -225,13 +299,11 @@ Tracer::~Tracer() noexcept {
   Log::print(F(", at file "), LogLevel::TRACE, LogType::CONTINUITY);
   Log::print(this->point.file(), LogLevel::TRACE, LogType::CONTINUITY);
   Log::print(F("\n"), LogLevel::TRACE, LogType::END);
-  Log::flush();
 }
 
 void logMemory(const Log &logger) noexcept {
   IOP_TRACE();
   if (logger.level() > LogLevel::INFO) return;
-  Log::flush();
   Log::print(F("[INFO] "), LogLevel::INFO, LogType::START);
   Log::print(logger.target(), LogLevel::INFO, LogType::START);
   Log::print(F(": Free Stack "), LogLevel::INFO, LogType::CONTINUITY);
@@ -248,8 +320,9 @@ void logMemory(const Log &logger) noexcept {
     HeapSelectDram ephemeral;
     Log::print(std::to_string(driver::device.availableHeap()), LogLevel::INFO, LogType::CONTINUITY);
   }
+  Log::print(F(", Dropped Logs "), LogLevel::INFO, LogType::CONTINUITY);
+  Log::print(std::to_string(Log::dropped()), LogLevel::INFO, LogType::CONTINUITY);
   Log::print(F("\n"), LogLevel::TRACE, LogType::END);
-  Log::flush();
 }
 
 } // namespace iop
\ No newline at end of file
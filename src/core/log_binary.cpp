@@ -0,0 +1,151 @@
+#include "core/log_binary.hpp"
+
+#include <array>
+
+/// Must be unique in the firmware, and in the same section as `F()` strings
+static const char anchor_[] PROGMEM = "IOP_BINARY_LOG_ANCHOR";
+
+/// COBS encodes while it's written, so the frame isn't buffered twice. Frames
+/// are shorter than 254 bytes, so each zero just starts a new block
+class FrameWriter {
+  uint8_t *out;
+  size_t length;
+  size_t code;
+  /// Payload bytes that still fit
+  size_t room;
+
+public:
+  explicit FrameWriter(uint8_t *out) noexcept
+      : out(out), length(1), code(0), room(iop::BinaryLog::maxFrameSize - 2) {}
+
+  auto fits(const size_t bytes) const noexcept -> bool { return bytes <= this->room; }
+  auto available() const noexcept -> size_t { return this->room; }
+
+  void put(const uint8_t byte) noexcept {
+    this->room--;
+    if (byte == 0) {
+      this->out[this->code] = static_cast<uint8_t>(this->length - this->code);
+      this->code = this->length++;
+      return;
+    }
+    this->out[this->length++] = byte;
+  }
+
+  void varint(uint64_t value) noexcept {
+    while (value >= 0x80) {
+      this->put(static_cast<uint8_t>(value | 0x80));
+      value >>= 7;
+    }
+    this->put(static_cast<uint8_t>(value));
+  }
+
+  auto finish() noexcept -> size_t {
+    this->out[this->code] = static_cast<uint8_t>(this->length - this->code);
+    this->out[this->length++] = 0;
+    return this->length;
+  }
+};
+
+static auto varintSize(uint64_t value) noexcept -> size_t {
+  size_t size = 1;
+  while (value >= 0x80) {
+    value >>= 7;
+    size++;
+  }
+  return size;
+}
+
+static auto zigzag(const int64_t value) noexcept -> uint64_t {
+  return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+static auto interned(const char *progmem) noexcept -> uint64_t {
+  return zigzag(static_cast<int64_t>(reinterpret_cast<intptr_t>(progmem) - reinterpret_cast<intptr_t>(anchor_)));
+}
+
+/// False if it didn't fit, the rest of the message is skipped
+static auto encodePart(FrameWriter &writer, const iop::LogPart &part) noexcept -> bool {
+  using Tag = iop::BinaryLog::Tag;
+  uint64_t value = 0;
+  Tag tag = Tag::STRING;
+  switch (part.kind) {
+  case iop::LogPart::Kind::FLASH:
+    tag = Tag::INTERNED;
+    value = interned(part.data);
+    break;
+  case iop::LogPart::Kind::UNSIGNED:
+    tag = Tag::UNSIGNED;
+    value = part.length;
+    break;
+  case iop::LogPart::Kind::SIGNED:
+    tag = Tag::SIGNED;
+    value = zigzag(static_cast<std::make_signed_t<size_t>>(part.length));
+    break;
+  case iop::LogPart::Kind::RAM: {
+    if (!writer.fits(1 + varintSize(part.length)))
+      return false;
+    const auto length = std::min(part.length, writer.available() - 1 - varintSize(part.length));
+    writer.put(static_cast<uint8_t>(Tag::STRING));
+    writer.varint(length);
+    for (size_t index = 0; index < length; ++index)
+      writer.put(static_cast<uint8_t>(part.data[index]));
+    return length == part.length;
+  }
+  }
+
+  if (!writer.fits(1 + varintSize(value)))
+    return false;
+  writer.put(static_cast<uint8_t>(tag));
+  writer.varint(value);
+  return true;
+}
+
+namespace iop {
+auto BinaryLog::encode(const uint8_t header, const StaticString *target, const LogPart *parts,
+                       const size_t count, uint8_t *out) noexcept -> size_t {
+  FrameWriter writer(out);
+  writer.put(header);
+  if (target != nullptr)
+    writer.varint(interned(target->asCharPtr()));
+
+  for (size_t index = 0; index < count; ++index) {
+    if (!encodePart(writer, parts[index]))
+      break;
+  }
+  return writer.finish();
+}
+
+auto BinaryLog::anchor() noexcept -> const char * { return anchor_; }
+
+static void recordPrinter(const LogLevel level, const StaticString target,
+                          const LogPart *parts, const size_t count) noexcept {
+  std::array<uint8_t, BinaryLog::maxFrameSize> frame;
+  const auto header = static_cast<uint8_t>(BinaryLog::version << 4 | static_cast<uint8_t>(level));
+  const auto size = BinaryLog::encode(header, &target, parts, count, frame.data());
+  Log::write(std::string_view(reinterpret_cast<const char *>(frame.data()), size));
+}
+
+static void printPiece(const LogPart &part) noexcept {
+  std::array<uint8_t, BinaryLog::maxFrameSize> frame;
+  const auto header = static_cast<uint8_t>(BinaryLog::version << 4 | BinaryLog::pieceLevel);
+  const auto size = BinaryLog::encode(header, nullptr, &part, 1, frame.data());
+  Log::write(std::string_view(reinterpret_cast<const char *>(frame.data()), size));
+}
+
+static void viewPrinter(const std::string_view view, const LogLevel level, const LogType type) noexcept {
+  (void)level;
+  (void)type;
+  printPiece(LogPart(view));
+}
+
+static void staticPrinter(const StaticString str, const LogLevel level, const LogType type) noexcept {
+  (void)level;
+  (void)type;
+  printPiece(LogPart(str));
+}
+
+auto BinaryLog::hook() noexcept -> LogHook {
+  return LogHook(viewPrinter, staticPrinter, LogHook::defaultSetuper, LogHook::defaultFlusher,
+                 viewPrinter, staticPrinter, recordPrinter);
+}
+} // namespace iop
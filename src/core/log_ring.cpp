@@ -0,0 +1,136 @@
+#include "core/log_ring.hpp"
+
+#include <algorithm>
+
+namespace iop {
+LogRing::LogRing() noexcept
+    : buffer{0}, lengths(), reserved(0), consumed(0), written(0),
+      draining(false), dropped_(0) {
+  for (auto &length: this->lengths)
+    length.store(0, std::memory_order_relaxed);
+}
+
+auto LogPart::format(char *out) const noexcept -> size_t {
+  // Digits are written backwards, then moved to the start
+  std::array<char, maxNumberLength> digits;
+  size_t count = 0;
+  const auto negative = this->kind == Kind::SIGNED && static_cast<std::make_signed_t<size_t>>(this->length) < 0;
+  // Negated unsigned, so the minimum doesn't overflow
+  auto value = negative ? ~this->length + 1 : this->length;
+  do {
+    digits[count++] = static_cast<char>('0' + value % 10);
+    value /= 10;
+  } while (value > 0);
+
+  size_t length = 0;
+  if (negative)
+    out[length++] = '-';
+  while (count > 0)
+    out[length++] = digits[--count];
+  return length;
+}
+
+auto LogPart::textLength() const noexcept -> size_t {
+  if (!this->isNumber())
+    return this->length;
+  std::array<char, maxNumberLength> text;
+  return this->format(text.data());
+}
+
+void LogRing::copy(const uint32_t position, const LogPart &part) noexcept {
+  const auto offset = position % capacity;
+  std::array<char, LogPart::maxNumberLength> number;
+  const char *data = part.data;
+  auto length = part.length;
+  if (part.isNumber()) {
+    length = part.format(number.data());
+    data = number.data();
+  }
+
+  const auto first = std::min(length, capacity - offset);
+  if (part.kind == LogPart::Kind::FLASH) {
+    memmove_P(&this->buffer[offset], data, first);
+    memmove_P(&this->buffer[0], (data + first), length - first);
+  } else {
+    memcpy(&this->buffer[offset], data, first);
+    memcpy(&this->buffer[0], data + first, length - first);
+  }
+}
+
+auto LogRing::push(const LogPart *parts, const size_t count) noexcept -> bool {
+  size_t length = 0;
+  for (size_t index = 0; index < count; ++index)
+    length += parts[index].textLength();
+  if (length == 0)
+    return true;
+
+  const auto size = static_cast<uint32_t>((length + slotSize - 1) / slotSize * slotSize);
+  if (length > capacity) {
+    this->dropped_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  auto position = this->reserved.load(std::memory_order_relaxed);
+  do {
+    if (position + size - this->consumed.load(std::memory_order_acquire) > capacity) {
+      this->dropped_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+  } while (!this->reserved.compare_exchange_weak(position, position + size, std::memory_order_acq_rel, std::memory_order_relaxed));
+
+  auto cursor = position;
+  for (size_t index = 0; index < count; ++index) {
+    this->copy(cursor, parts[index]);
+    cursor += static_cast<uint32_t>(parts[index].textLength());
+  }
+
+  // Publishes the record
+  this->lengths[(position / slotSize) % slots].store(static_cast<uint16_t>(length), std::memory_order_release);
+  return true;
+}
+
+auto LogRing::push(const std::string_view message) noexcept -> bool {
+  const LogPart part(message);
+  return this->push(&part, 1);
+}
+
+auto LogRing::drain(const Writer writer) noexcept -> size_t {
+  if (this->draining.exchange(true, std::memory_order_acquire))
+    return 0;
+
+  size_t total = 0;
+  auto position = this->consumed.load(std::memory_order_relaxed);
+  while (true) {
+    auto &slot = this->lengths[(position / slotSize) % slots];
+    const size_t length = slot.load(std::memory_order_acquire);
+    // Either empty, or the oldest record is still being written
+    if (length == 0)
+      break;
+
+    const auto offset = (position + this->written) % capacity;
+    const auto contiguous = std::min(length - this->written, capacity - offset);
+    const auto wrote = writer(std::string_view(&this->buffer[offset], contiguous));
+    this->written += wrote;
+    total += wrote;
+    if (this->written < length) {
+      if (wrote < contiguous)
+        break;
+      // Wrapped around, the rest is at the start
+      continue;
+    }
+
+    const auto size = static_cast<uint32_t>((length + slotSize - 1) / slotSize * slotSize);
+    this->written = 0;
+    slot.store(0, std::memory_order_relaxed);
+    position += size;
+    this->consumed.store(position, std::memory_order_release);
+  }
+
+  this->draining.store(false, std::memory_order_release);
+  return total;
+}
+
+auto LogRing::isEmpty() const noexcept -> bool {
+  return this->consumed.load(std::memory_order_acquire) == this->reserved.load(std::memory_order_acquire);
+}
+} // namespace iop
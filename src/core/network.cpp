@@ -1,6 +1,24 @@
 #include "core/network.hpp"
 #include "core/utils.hpp"
 
+#include <vector>
+
+static iop::NetworkStats stats_ = {0, 0, 0, 0, 0, 0};
+static iop::RetryPolicy retryPolicy = iop::Network::defaultRetryPolicy;
+static iop::esp_time retryAfter_ = 0;
+/// One per endpoint, so a broken route doesn't stop the others
+static std::vector<std::pair<std::string, iop::CircuitBreaker>> breakers;
+
+static auto breakerFor(const iop::StaticString path) noexcept -> iop::CircuitBreaker & {
+  const auto key = path.toStdString();
+  for (auto &breaker: breakers) {
+    if (breaker.first == key)
+      return breaker.second;
+  }
+  breakers.emplace_back(key, iop::CircuitBreaker());
+  return breakers.back().second;
+}
+
 #ifdef IOP_ONLINE
 
 #include "driver/device.hpp"
@@ -8,19 +26,161 @@
 #include "driver/client.hpp"
 #include "core/panic.hpp"
 #include "core/cert_store.hpp"
+#include "core/header_block.hpp"
+#include "core/http_parser.hpp"
+#include "core/tls_session.hpp"
 #include "string.h"
 #include "loop.hpp"
 
+#include <memory>
+#include <new>
+
 constexpr static iop::UpgradeHook defaultHook(iop::UpgradeHook::defaultHook);
 
 static iop::UpgradeHook hook(defaultHook);
 static std::optional<iop::CertStore> maybeCertStore;
+static const uint8_t *const *pinnedDers = nullptr;
+static const uint16_t *pinnedSizes = nullptr;
+static uint8_t pinnedCount = 0;
+static iop::HeaderBlock headerBlock;
+static iop::ContentType acceptedContentType_ = iop::ContentType::JSON;
+static bool eventCodecAccepted_ = false;
+/// Seeded per device at setup, so the fleet doesn't retry in lockstep
+static iop::Random jitter(0);
+
+/// Where the monitor server is, parsed from its uri (scheme://host[:port])
+struct Endpoint {
+  std::string hostAndPort;
+  std::string host;
+  uint16_t port;
+};
+
+static auto endpointOf(const iop::StaticString uri_) noexcept -> Endpoint {
+  const auto uri = uri_.toStdString();
+  const auto hostStart = uri.find("://") + 3;
+  Endpoint endpoint = {uri.substr(hostStart), "", 0};
+  const auto colon = endpoint.hostAndPort.find(':');
+  endpoint.host = endpoint.hostAndPort.substr(0, colon);
+  endpoint.port = uri.find("https://") == 0 ? 443 : 80;
+  if (colon != endpoint.hostAndPort.npos)
+    endpoint.port = static_cast<uint16_t>(strtoul(endpoint.hostAndPort.c_str() + colon + 1, nullptr, 10));
+  return endpoint;
+}
+
+#ifdef IOP_SSL
+/// Resumed by later handshakes, and kept in RTC memory across soft reboots
+static BearSSL::Session tlsSession;
+static_assert(sizeof(br_ssl_session_parameters) <= iop::TlsSessionStore::capacity, "TLS session doesn't fit RTC slot");
+/// Unknown until the server answers the probe
+static std::optional<bool> maxFragmentLength;
+/// The probe fails the same way if the server is unreachable, it's only
+/// a definite no once a connection to it succeeds
+static bool maxFragmentLengthRefused = false;
+
+/// Called before opening a connection. BearSSL needs 16KB buffers unless the
+/// server agrees to send smaller records, that's probed once per boot (it's a
+/// connection of its own)
+static void prepareTls(const iop::Log &logger, const Endpoint &endpoint) noexcept {
+  if (maxFragmentLength.has_value())
+    return;
+
+  constexpr uint16_t bufferSize = 512;
+  auto &client = unused4KbSysStack.client();
+  maxFragmentLengthRefused = !client.probeMaxFragmentLength(endpoint.host.c_str(), endpoint.port, bufferSize);
+  if (!maxFragmentLengthRefused) {
+    maxFragmentLength = true;
+    client.setBufferSizes(bufferSize, bufferSize);
+    logger.debug(F("Max Fragment Length negotiated: "), std::to_string(bufferSize));
+  }
+}
+
+/// Called after a new connection was opened, its handshake updated the session
+static void persistTls(const iop::Log &logger, const Endpoint &endpoint) noexcept {
+  if (!maxFragmentLength.has_value() && maxFragmentLengthRefused) {
+    maxFragmentLength = false;
+    logger.warn(F("Server doesn't support Max Fragment Length Negotiation, using 16KB buffers"));
+  }
+
+  const auto *params = reinterpret_cast<const uint8_t *>(tlsSession.getSession());
+  iop::TlsSessionStore::store(endpoint.host, params, sizeof(br_ssl_session_parameters));
+}
+
+/// Kept while `trust` is pinned, the client points to them
+static std::optional<BearSSL::X509List> pinnedIssuers;
+static iop::TrustSelector trust;
+static_assert(BR_ERR_X509_OK == iop::TrustSelector::x509Errors, "BearSSL X509 errors moved");
+
+static void verifyTls(const iop::Log &logger) noexcept {
+  auto &client = unused4KbSysStack.client();
+  if (trust.pinned()) {
+    client.setTrustAnchors(&iop::unwrap_ref(pinnedIssuers, IOP_CTX()));
+    logger.debug(F("TLS verified by the pinned issuers"));
+  } else if (maybeCertStore.has_value()) {
+    client.setCertStore(&iop::unwrap_mut(maybeCertStore, IOP_CTX()));
+    logger.debug(F("TLS verified by the certificate chain"));
+  } else {
+    iop_panic(F("No CertStore nor pinned issuers, TLS can't be verified. Call Network::setCertStore"));
+  }
+}
+
+static void setupTlsVerification(const iop::Log &logger) noexcept {
+  // The client must not point to issuers that are freed
+  unused4KbSysStack.client().setTrustAnchors(nullptr);
+  pinnedIssuers.reset();
+  if (pinnedCount > 0)
+    pinnedIssuers.emplace();
+  for (uint8_t index = 0; index < pinnedCount; ++index) {
+    // Decoded like the CertStore does, straight from PROGMEM
+    // NOLINTNEXTLINE cppcoreguidelines-pro-bounds-pointer-arithmetic
+    const uint16_t size = pgm_read_word(&pinnedSizes[index]);
+    // NOLINTNEXTLINE cppcoreguidelines-pro-bounds-pointer-arithmetic
+    if (!iop::unwrap_mut(pinnedIssuers, IOP_CTX()).append(pinnedDers[index], size)) {
+      logger.error(F("Pinned issuer is invalid, validating the certificate chain"));
+      pinnedIssuers.reset();
+      break;
+    }
+  }
+  trust = iop::TrustSelector(pinnedIssuers.has_value());
+  verifyTls(logger);
+}
+
+/// Called when a new connection failed. If the pinned issuers refused the
+/// chain the server changed its CA, the whole bundle is used from then on
+/// (until reboot)
+static void connectionFailed(const iop::Log &logger) noexcept {
+  auto &client = unused4KbSysStack.client();
+  const auto error = client.getLastSSLError();
+  if (!trust.connectionFailed(error))
+    return;
+
+  logger.warn(F("Server's chain isn't issued by the pinned certificates, falling back to the CertStore. Error: "), std::to_string(error));
+  client.setTrustAnchors(nullptr);
+  pinnedIssuers.reset();
+  verifyTls(logger);
+}
+#else
+static void prepareTls(const iop::Log &logger, const Endpoint &endpoint) noexcept {
+  (void)logger;
+  (void)endpoint;
+}
+static void persistTls(const iop::Log &logger, const Endpoint &endpoint) noexcept {
+  (void)logger;
+  (void)endpoint;
+}
+static void connectionFailed(const iop::Log &logger) noexcept { (void)logger; }
+#endif
 
 namespace iop {
 void UpgradeHook::defaultHook() noexcept { IOP_TRACE(); }
 void Network::setCertStore(iop::CertStore &store) noexcept {
   maybeCertStore = std::make_optional(iop::CertStore(std::move(store)));
 }
+void Network::setPinnedIssuers(const uint8_t *const *ders, const uint16_t *sizes,
+                               const uint8_t count) noexcept {
+  pinnedDers = ders;
+  pinnedSizes = sizes;
+  pinnedCount = ders == nullptr || sizes == nullptr ? 0 : count;
+}
 void Network::setUpgradeHook(UpgradeHook scheduler) noexcept {
   hook = std::move(scheduler);
 }
@@ -52,18 +212,31 @@ auto Network::setup() const noexcept -> void {
     iop_panic(error.toStdString() + " " + this->uri().toStdString());
   }
 
-  unused4KbSysStack.http().setReuse(false);
+  // Keeps one connection to the monitor server, so only the first request
+  // pays for the handshake
+  unused4KbSysStack.http().setReuse(true);
+
+  const auto &md5 = driver::device.binaryMD5();
+  const auto &mac = driver::device.macAddress();
+  headerBlock.setup(std::string_view(md5.data(), md5.size()), std::string_view(mac.data(), mac.size()));
+  const auto macHash = iop::hashString(std::string_view(mac.data(), mac.size()));
+  jitter = iop::Random(static_cast<uint32_t>(macHash ^ (macHash >> 32) ^ driver::thisThread.now()));
 
-  const char *headers[] = {PSTR("LATEST_VERSION")};
-  unused4KbSysStack.http().collectHeaders(headers, 1);
+  const char *headers[] = {PSTR("LATEST_VERSION"), PSTR("ACCEPTED_CONTENT_TYPE"), PSTR("Retry-After")};
+  unused4KbSysStack.http().collectHeaders(headers, 3);
 
   unused4KbSysStack.client().setNoDelay(false);
   unused4KbSysStack.client().setSync(true);
 
 #ifdef IOP_SSL
-  //if (maybeCertStore.has_value())
-  //  unused4KbSysStack.client().setCertStore(&iop::unwrap_mut(maybeCertStore, IOP_CTX()));
-  unused4KbSysStack.client().setInsecure(); // TODO: remove this (what the frick)
+  setupTlsVerification(this->logger);
+
+  // Abbreviated handshakes, even for the first request after a soft reboot
+  const auto endpoint = endpointOf(this->uri());
+  auto *params = reinterpret_cast<uint8_t *>(tlsSession.getSession());
+  if (iop::TlsSessionStore::load(endpoint.host, params, sizeof(br_ssl_session_parameters)))
+    this->logger.debug(F("TLS session restored from RTC memory"));
+  unused4KbSysStack.client().setSession(&tlsSession);
 #endif
 
   WiFi.persistent(true);
@@ -110,11 +283,70 @@ static auto methodToString(const HttpMethod &method) noexcept
 
 auto Network::wifiClient() noexcept -> WiFiClient & { return unused4KbSysStack.client(); }
 
+auto Network::acceptedContentType() noexcept -> ContentType {
+  return acceptedContentType_;
+}
+
+auto Network::isContentTypeAccepted(const ContentType type) noexcept -> bool {
+  switch (type) {
+  case ContentType::JSON:
+    return true;
+  case ContentType::MSGPACK:
+    return acceptedContentType_ == ContentType::MSGPACK;
+  case ContentType::IOP_EVENTS:
+    return eventCodecAccepted_;
+  }
+  return false;
+}
+
+static auto deviceTelemetry() noexcept -> Telemetry {
+  return {
+      static_cast<uint32_t>(driver::device.availableStack()),
+      static_cast<uint32_t>(driver::device.availableHeap()),
+      static_cast<uint32_t>(driver::device.biggestHeapBlock()),
+      static_cast<uint32_t>(driver::device.vcc()),
+      static_cast<uint32_t>(driver::thisThread.now()),
+  };
+}
+
+static void handleResponseHeaders(const Log &logger, const std::string_view upgrade,
+                                  const std::string_view accepted) noexcept {
+  // Handle system upgrade request
+  const auto md5 = std::string_view(driver::device.binaryMD5().data(), 32);
+  if (upgrade.length() > 0 && upgrade.substr(0, 32) != md5) {
+    logger.info(F("Scheduled upgrade"));
+    hook.schedule();
+  }
+
+  // Binary bodies are only sent if the server tells us it understands them
+  if (accepted.length() > 0) {
+    const auto msgpack = Network::contentTypeToString(ContentType::MSGPACK).toStdString();
+    acceptedContentType_ = accepted.find(msgpack) != accepted.npos
+                         ? ContentType::MSGPACK : ContentType::JSON;
+    const auto events = Network::contentTypeToString(ContentType::IOP_EVENTS).toStdString();
+    eventCodecAccepted_ = accepted.find(events) != accepted.npos;
+  }
+}
+
+static auto isFailure(const NetworkStatus status) noexcept -> bool {
+  return status == NetworkStatus::CONNECTION_ISSUES || status == NetworkStatus::BROKEN_SERVER;
+}
+
+/// The server is shedding load, the endpoint is left alone for as long as it
+/// asked. Or for `RetryPolicy::openFor`, if it didn't say
+static void throttle(const Log &logger, const StaticString path, const std::string_view retryAfter) noexcept {
+  stats_.throttled++;
+  retryAfter_ = iop::parseRetryAfter(retryAfter, Network::maxRetryAfter).value_or(retryPolicy.openFor);
+  breakerFor(path).defer(driver::thisThread.now(), retryAfter_);
+  logger.warn(F("Server is throttling "), path, F(", deferred for "), std::to_string(retryAfter_), F("ms"));
+}
+
 // Returns Response if it can understand what the server sent, int is the raw
 // response given by ESP8266HTTPClient
-auto Network::httpRequest(const HttpMethod method_,
+auto Network::httpRequest(const HttpMethod method,
                           const std::optional<std::string_view> &token, StaticString path,
-                          const std::optional<std::string_view> &data) const noexcept
+                          std::optional<std::reference_wrapper<BodyStream>> body,
+                          const ContentType type, PayloadSink sink) const noexcept
     -> std::variant<Response, int> const & {
   IOP_TRACE();
   Network::setup();
@@ -124,6 +356,46 @@ auto Network::httpRequest(const HttpMethod method_,
     return unused4KbSysStack.response();
   }
 
+  if (Network::isBusy()) {
+    this->logger.warn(F("Asynchronous request in flight, try again later"));
+    unused4KbSysStack.response() = Response(NetworkStatus::CONNECTION_ISSUES);
+    return unused4KbSysStack.response();
+  }
+
+  // Synchronous requests aren't retried here, it would block the loop. Their
+  // callers try again later, but not while the endpoint is known to be down
+  auto &breaker = breakerFor(path);
+  if (!breaker.allow(retryPolicy, driver::thisThread.now())) {
+    stats_.shortCircuits++;
+    this->logger.warn(F("Endpoint is down, request short-circuited: "), path);
+    unused4KbSysStack.response() = Response(breaker.deferred() ? NetworkStatus::THROTTLED : NetworkStatus::CONNECTION_ISSUES);
+    return unused4KbSysStack.response();
+  }
+
+  // Serializing per chunk is quadratic on the body size, so bodies the heap
+  // can afford are serialized once
+  if (body.has_value() && !body->get().buffer(driver::device.biggestHeapBlock() / 2))
+    this->logger.warn(F("Body doesn't fit the heap, serializing it per chunk: "), body->get().size());
+
+  const auto &response = this->attemptRequest(method, token, path, body, type, std::move(sink));
+  // Unexpected codes are a broken server too
+  const auto *answer = std::get_if<Response>(&response);
+  if (answer != nullptr && answer->status == NetworkStatus::THROTTLED) {
+    // Deferred by `throttle`
+  } else if (answer == nullptr || isFailure(answer->status)) {
+    breaker.failure(retryPolicy, driver::thisThread.now());
+  } else {
+    breaker.success();
+  }
+  return response;
+}
+
+auto Network::attemptRequest(const HttpMethod method_,
+                             const std::optional<std::string_view> &token, StaticString path,
+                             std::optional<std::reference_wrapper<BodyStream>> body,
+                             const ContentType type, PayloadSink sink) const noexcept
+    -> std::variant<Response, int> const & {
+  IOP_TRACE();
   #ifdef IOP_DESKTOP
   const auto uri = this->uri().toStdString() + path.asCharPtr();
   #else
@@ -131,16 +403,8 @@ auto Network::httpRequest(const HttpMethod method_,
   #endif
   const auto method = iop::unwrap_ref(methodToString(method_), IOP_CTX());
 
-  std::string_view data_;
-  if (data.has_value())
-    data_ = iop::unwrap_ref(data, IOP_CTX());
-
-  this->logger.info(method, F(" to "), this->uri(), path, F(", data length: "), std::to_string(data_.length()));
-
-  // TODO: this may log sensitive information, network logging is currently
-  // capped at info because of that, right
-  if (data.has_value())
-    this->logger.debug(iop::unwrap_ref(data, IOP_CTX()));
+  const auto length = body.has_value() ? body->get().size() : 0;
+  this->logger.info(method, F(" to "), this->uri(), path, F(", data length: "), length);
 
   if (token.has_value()) {
     const auto tok = iop::unwrap_ref(token, IOP_CTX());
@@ -156,27 +420,22 @@ auto Network::httpRequest(const HttpMethod method_,
   unused4KbSysStack.http().setTimeout(oneMinuteMs);
 
   logMemory(this->logger);
-  // Currently only JSON is supported
-  if (data.has_value())
-    unused4KbSysStack.http().addHeader(F("Content-Type"), F("application/json"));
+  if (body.has_value())
+    unused4KbSysStack.http().addHeader(F("Content-Type"), Network::contentTypeToString(type).get());
 
   // Authentication headers, identifies device and detects updates, perf
-  // monitoring
-  {
-    auto str = String();
-    str.concat(driver::device.binaryMD5().begin(), 32);
-    unused4KbSysStack.http().addHeader(F("VERSION"), str);
-
-    str.clear();
-    str.concat(driver::device.macAddress().begin(), 17);
-    unused4KbSysStack.http().addHeader(F("MAC_ADDRESS"), str);
-  }
- 
-  unused4KbSysStack.http().addHeader(F("FREE_STACK"), std::to_string(driver::device.availableStack()).c_str());
-  unused4KbSysStack.http().addHeader(F("FREE_HEAP"), std::to_string(driver::device.availableHeap()).c_str());
-  unused4KbSysStack.http().addHeader(F("BIGGEST_FREE_BLOCK"), std::to_string(driver::device.biggestHeapBlock()).c_str());
-  unused4KbSysStack.http().addHeader(F("VCC"), std::to_string(driver::device.vcc()).c_str());
-  unused4KbSysStack.http().addHeader(F("TIME_RUNNING"), std::to_string(driver::thisThread.now()).c_str());
+  // monitoring. Serialized at setup, only the telemetry changes
+  unused4KbSysStack.http().addHeaderBlock(headerBlock.update(deviceTelemetry()));
+
+  // Closed connections are detected here, failed requests close them
+  const auto reused = unused4KbSysStack.http().connected();
+  // Asynchronous requests leave the connection without sync writes
+  if (reused)
+    Network::wifiClient().setSync(true);
+
+  const auto endpoint = endpointOf(this->uri());
+  if (!reused)
+    prepareTls(this->logger, endpoint);
 
   this->logger.debug(F("Begin"));
   if (!unused4KbSysStack.http().begin(Network::wifiClient(), uri)) {
@@ -185,51 +444,495 @@ auto Network::httpRequest(const HttpMethod method_,
     return unused4KbSysStack.response();
   }
   this->logger.trace(F("Began HTTP connection"));
-
-  const auto *const data__ = reinterpret_cast<const uint8_t *>(data_.begin());
+  if (!reused)
+    stats_.connections++;
+  stats_.requests++;
 
   this->logger.debug(F("Making HTTP request"));
-  const auto code =
-      unused4KbSysStack.http().sendRequest(method.toStdString().c_str(), data__, data_.length());
+  // Bodies too big for the heap are serialized straight into the
+  // connection, in chunks
+  const auto code = body.has_value()
+      ? unused4KbSysStack.http().sendRequest(method.toStdString().c_str(), &body->get(), length)
+      : unused4KbSysStack.http().sendRequest(method.toStdString().c_str(), static_cast<const uint8_t *>(nullptr), 0);
   this->logger.debug(F("Made HTTP request")); 
 
-  // Handle system upgrade request
-  const auto upgrade = unused4KbSysStack.http().header(PSTR("LATEST_VERSION"));
-  if (upgrade.length() > 0 && memcmp(upgrade.c_str(), driver::device.binaryMD5().data(), 32) != 0) {
-    this->logger.info(F("Scheduled upgrade"));
-    hook.schedule();
+  // The server may close an idle connection while we reuse it. The failure
+  // closed it, so the retry opens a new one (and can't retry again)
+  const auto lost = code == HTTPC_ERROR_CONNECTION_LOST || code == HTTPC_ERROR_NOT_CONNECTED ||
+                    code == HTTPC_ERROR_SEND_HEADER_FAILED || code == HTTPC_ERROR_SEND_PAYLOAD_FAILED;
+  if (reused && lost) {
+    this->logger.debug(F("Kept alive connection was closed by the server, reconnecting"));
+    stats_.reconnections++;
+    unused4KbSysStack.http().end();
+    if (body.has_value())
+      body->get().rewind();
+    return this->attemptRequest(method_, token, path, body, type, std::move(sink));
   }
+  if (!reused && code > 0)
+    persistTls(this->logger, endpoint);
+  if (!reused && code == HTTPC_ERROR_CONNECTION_FAILED)
+    connectionFailed(this->logger);
+
+  const auto upgrade = unused4KbSysStack.http().header(PSTR("LATEST_VERSION"));
+  const auto accepted = unused4KbSysStack.http().header(PSTR("ACCEPTED_CONTENT_TYPE"));
+  handleResponseHeaders(this->logger, iop::to_view(upgrade), iop::to_view(accepted));
+  const auto retryAfter = unused4KbSysStack.http().header(PSTR("Retry-After"));
+
+  this->logger.debug(F("Connections opened: "), stats_.connections,
+                    F(", requests sent: "), stats_.requests);
 
   const auto rawStatus = this->rawStatus(code);
   const auto rawStatusStr = Network::rawStatusToString(rawStatus);
 
-  this->logger.info(F("Response code ("), std::to_string(code), F("): "), rawStatusStr);
+  this->logger.info(F("Response code ("), code, F("): "), rawStatusStr);
 
-  constexpr const int32_t maxPayloadSizeAcceptable = 2048;
-  if (unused4KbSysStack.http().getSize() > maxPayloadSizeAcceptable) {
-    unused4KbSysStack.http().end();
-    const auto lengthStr = std::to_string(unused4KbSysStack.http().getSize());
-    this->logger.error(F("Payload from server was too big: "), lengthStr);
-    unused4KbSysStack.response() = Response(NetworkStatus::BROKEN_SERVER);
-    return unused4KbSysStack.response();
+  // The body is streamed into the caller's sink as it's read, so it's never
+  // stored in between. And oversized ones are refused before they are read
+  size_t payloadLength = 0;
+  if (code > 0) {
+    constexpr const size_t maxPayloadSizeAcceptable = 2048;
+    PayloadStream payload(std::move(sink), maxPayloadSizeAcceptable);
+    const auto written = unused4KbSysStack.http().writeToStream(&payload);
+    if (payload.refused()) {
+      unused4KbSysStack.http().end();
+      this->logger.error(F("Payload from server was refused, too big? Read: "), std::to_string(payload.length()));
+      unused4KbSysStack.response() = Response(NetworkStatus::BROKEN_SERVER);
+      return unused4KbSysStack.response();
+    }
+    if (written < 0) {
+      unused4KbSysStack.http().end();
+      this->logger.warn(F("Unable to read payload: "), std::to_string(written));
+      unused4KbSysStack.response() = Response(NetworkStatus::CONNECTION_ISSUES);
+      return unused4KbSysStack.response();
+    }
+    payloadLength = payload.length();
+    this->logger.debug(F("Payload length: "), payloadLength);
   }
 
   // We have to simplify the errors reported by this API (but they are logged)
   const auto maybeApiStatus = this->apiStatus(rawStatus);
+  if (maybeApiStatus == NetworkStatus::THROTTLED)
+    throttle(this->logger, path, iop::to_view(retryAfter));
   if (maybeApiStatus.has_value()) {
-    // The payload is always downloaded, since we check for its size and the
-    // origin is trusted. If it's there it's supposed to be there.
-    auto payload = unused4KbSysStack.http().getString();
     unused4KbSysStack.http().end();
-    this->logger.debug(F("Payload (") , std::to_string(payload.length()), F("): "), iop::to_view(payload));
-    // TODO: every response occupies 2x the size because we convert String -> std::string
-    unused4KbSysStack.response() = Response(iop::unwrap_ref(maybeApiStatus, IOP_CTX()), std::string(payload.c_str()));
+    unused4KbSysStack.response() = Response(iop::unwrap_ref(maybeApiStatus, IOP_CTX()), payloadLength);
     return unused4KbSysStack.response();
   }
   unused4KbSysStack.http().end();
   unused4KbSysStack.response() = code;
   return unused4KbSysStack.response();
 }
+
+/// The asynchronous request in flight. Only allocated while there is one
+struct InFlight {
+  uint32_t id;
+  Network network;
+  Log logger;
+  StaticString path;
+  RequestDeadlines deadlines;
+  RequestPhase phase;
+  esp_time phaseStart;
+  /// Attempts already failed
+  uint8_t attempt;
+  esp_time backoff;
+
+  Endpoint endpoint;
+  /// Head and body, serialized once. Sent again as is when retried
+  std::unique_ptr<uint8_t[]> data;
+  size_t headLength;
+  size_t length;
+  size_t sent;
+
+  HttpParser parser;
+  PayloadStream payload;
+  std::array<char, 128> readBuffer;
+  size_t pendingStart;
+  size_t pendingLength;
+  /// Response bytes received, in this connection
+  size_t received;
+  bool reused;
+  bool retried;
+
+  InFlight(uint32_t id, const Network &network, Log logger, StaticString path,
+           RequestDeadlines deadlines, Endpoint endpoint, std::unique_ptr<uint8_t[]> data,
+           size_t headLength, size_t length, PayloadSink sink) noexcept
+      : id(id), network(network), logger(std::move(logger)), path(path), deadlines(deadlines),
+        phase(RequestPhase::CONNECT), phaseStart(driver::thisThread.now()), attempt(0), backoff(0),
+        endpoint(std::move(endpoint)), data(std::move(data)), headLength(headLength),
+        length(length), sent(0), parser(nullptr),
+        payload(std::move(sink), 2048), readBuffer{0}, pendingStart(0),
+        pendingLength(0), received(0), reused(false), retried(false) {}
+};
+
+static std::unique_ptr<InFlight> inFlight;
+static uint32_t lastRequestId = 0;
+
+static void enter(InFlight &request, const RequestPhase phase) noexcept {
+  request.phase = phase;
+  request.phaseStart = driver::thisThread.now();
+}
+
+static auto deadlineOf(const InFlight &request) noexcept -> esp_time {
+  switch (request.phase) {
+  case RequestPhase::CONNECT:
+    return request.deadlines.connect;
+  case RequestPhase::SEND:
+    return request.deadlines.send;
+  case RequestPhase::AWAIT_HEADERS:
+    return request.deadlines.headers;
+  case RequestPhase::READ_BODY:
+    return request.deadlines.body;
+  case RequestPhase::BACKOFF:
+    return request.backoff;
+  case RequestPhase::DONE:
+    break;
+  }
+  return 0;
+}
+
+/// Prepares to send the request again, from the start
+static void restart(InFlight &request, const RequestPhase phase) noexcept {
+  request.sent = 0;
+  request.pendingLength = 0;
+  request.parser.reset();
+  enter(request, phase);
+}
+
+/// Kept alive connections may have been closed by the server while idle, the
+/// request is retried once in a new connection. Only if nothing was received
+static auto retryInNewConnection(InFlight &request) noexcept -> bool {
+  if (!request.reused || request.retried || request.received > 0)
+    return false;
+
+  request.logger.debug(F("Kept alive connection was closed by the server, reconnecting"));
+  stats_.reconnections++;
+  Network::wifiClient().stop();
+  request.retried = true;
+  restart(request, RequestPhase::CONNECT);
+  return true;
+}
+
+/// Failed requests are sent again after a backoff, while the retry budget
+/// lasts and the endpoint isn't considered down. Not if part of the response
+/// reached the sink, it can't be taken back
+static auto retryLater(InFlight &request) noexcept -> bool {
+  if (request.attempt + 1 >= retryPolicy.attempts)
+    return false;
+  if (request.payload.refused() || request.payload.length() > 0)
+    return false;
+  if (!breakerFor(request.path).allow(retryPolicy, driver::thisThread.now()))
+    return false;
+
+  request.backoff = backoffDelay(retryPolicy, request.attempt, jitter);
+  request.attempt++;
+  stats_.retries++;
+  request.logger.warn(F("Request failed, retrying in "), std::to_string(request.backoff), F("ms"));
+  // The failure may have left the connection in an unknown state
+  Network::wifiClient().stop();
+  request.retried = false;
+  restart(request, RequestPhase::BACKOFF);
+  return true;
+}
+
+/// Writes as much as the connection takes right now
+static auto writeSome(WiFiClient &client, const uint8_t *data, const size_t length) noexcept -> size_t {
+  const auto room = static_cast<size_t>(client.availableForWrite());
+  if (room == 0)
+    return 0;
+  return client.write(data, std::min(room, length));
+}
+
+/// Returns the status code (or a negative HTTPC error) when it's finished.
+/// None if it would block
+static auto advance(InFlight &request) noexcept -> std::optional<int> {
+  auto &client = Network::wifiClient();
+  const auto &logger = request.logger;
+
+  while (true) {
+    const auto elapsed = driver::thisThread.now() - request.phaseStart;
+    const auto bounded = request.phase != RequestPhase::CONNECT && request.phase != RequestPhase::BACKOFF;
+    if (bounded && elapsed > deadlineOf(request)) {
+      logger.warn(F("Request timed out at phase "), std::to_string(static_cast<int>(request.phase)));
+      client.stop();
+      return HTTPC_ERROR_READ_TIMEOUT;
+    }
+
+    switch (request.phase) {
+    case RequestPhase::CONNECT:
+      request.received = 0;
+      request.reused = client.connected();
+      if (request.reused) {
+        // Leftovers of a previous response would be mistaken for this one
+        while (client.available() > 0 && client.read(reinterpret_cast<uint8_t *>(request.readBuffer.data()), request.readBuffer.size()) > 0) {}
+      } else {
+        // The only phase that blocks, there is no asynchronous connect (nor TLS handshake)
+        prepareTls(logger, request.endpoint);
+        client.setTimeout(request.deadlines.connect);
+        if (!client.connect(request.endpoint.host.c_str(), request.endpoint.port)) {
+          logger.warn(F("Failed to connect to "), request.endpoint.host);
+          connectionFailed(logger);
+          return HTTPC_ERROR_CONNECTION_FAILED;
+        }
+        persistTls(logger, request.endpoint);
+        stats_.connections++;
+      }
+      // Sync writes wait for the server's ACK, these return once they are
+      // copied to the TCP stack
+      client.setSync(false);
+      stats_.requests++;
+      enter(request, RequestPhase::SEND);
+      break;
+
+    case RequestPhase::SEND: {
+      if (!client.connected()) {
+        if (retryInNewConnection(request))
+          break;
+        return request.sent < request.headLength ? HTTPC_ERROR_SEND_HEADER_FAILED : HTTPC_ERROR_SEND_PAYLOAD_FAILED;
+      }
+
+      while (request.sent < request.length) {
+        const auto written = writeSome(client, request.data.get() + request.sent, request.length - request.sent);
+        if (written == 0)
+          return std::nullopt;
+        request.sent += written;
+      }
+      enter(request, RequestPhase::AWAIT_HEADERS);
+      break;
+    }
+
+    case RequestPhase::AWAIT_HEADERS:
+    case RequestPhase::READ_BODY: {
+      if (request.pendingLength > 0 && request.phase == RequestPhase::READ_BODY) {
+        // Body read together with the headers
+        request.parser.feed(std::string_view(request.readBuffer.data() + request.pendingStart, request.pendingLength));
+        request.pendingLength = 0;
+      } else if (client.available() > 0) {
+        const auto size = client.read(reinterpret_cast<uint8_t *>(request.readBuffer.data()), request.readBuffer.size());
+        if (size > 0) {
+          request.received += static_cast<size_t>(size);
+          const std::string_view data(request.readBuffer.data(), static_cast<size_t>(size));
+          if (request.phase == RequestPhase::AWAIT_HEADERS) {
+            request.pendingStart = request.parser.feedHeaders(data);
+            request.pendingLength = data.length() - request.pendingStart;
+          } else {
+            request.parser.feed(data);
+          }
+        }
+      } else if (!client.connected()) {
+        request.parser.finish();
+      } else {
+        return std::nullopt;
+      }
+
+      if (request.parser.failed()) {
+        client.stop();
+        if (request.payload.refused())
+          return HTTPC_ERROR_STREAM_WRITE;
+        if (request.received == 0 && retryInNewConnection(request))
+          break;
+        if (request.received == 0 || request.phase == RequestPhase::READ_BODY)
+          return HTTPC_ERROR_CONNECTION_LOST;
+        logger.error(F("Bad server response, state: "), std::to_string(static_cast<int>(request.parser.state())));
+        return HTTPC_ERROR_NO_HTTP_SERVER;
+      }
+
+      if (request.phase == RequestPhase::AWAIT_HEADERS && request.parser.headersDone()) {
+        const auto upgrade = request.parser.header("LATEST_VERSION").value_or("");
+        const auto accepted = request.parser.header("ACCEPTED_CONTENT_TYPE").value_or("");
+        handleResponseHeaders(logger, upgrade, accepted);
+        enter(request, RequestPhase::READ_BODY);
+      }
+
+      if (request.parser.done()) {
+        if (!request.parser.keepAlive())
+          client.stop();
+        enter(request, RequestPhase::DONE);
+        return static_cast<int>(request.parser.status());
+      }
+      break;
+    }
+
+    case RequestPhase::BACKOFF:
+      if (elapsed < deadlineOf(request))
+        return std::nullopt;
+      enter(request, RequestPhase::CONNECT);
+      break;
+
+    case RequestPhase::DONE:
+      return static_cast<int>(request.parser.status());
+    }
+  }
+}
+
+static auto outcome(InFlight &request, const int code) noexcept -> NetworkStatus {
+  const auto &network = request.network;
+  const auto &logger = request.logger;
+  if (request.payload.refused()) {
+    logger.error(F("Payload from server was refused, too big? Read: "), std::to_string(request.payload.length()));
+    return NetworkStatus::BROKEN_SERVER;
+  }
+
+  const auto rawStatus = network.rawStatus(code);
+  logger.info(F("Response code ("), code, F("): "), Network::rawStatusToString(rawStatus));
+
+  // We have to simplify the errors reported by this API (but they are logged)
+  const auto maybeApiStatus = network.apiStatus(rawStatus);
+  if (!maybeApiStatus.has_value()) {
+    logger.error(F("Unexpected response code: "), std::to_string(code));
+    return NetworkStatus::BROKEN_SERVER;
+  }
+  return iop::unwrap_ref(maybeApiStatus, IOP_CTX());
+}
+
+auto Network::isBusy() noexcept -> bool {
+  return inFlight != nullptr;
+}
+
+void Network::cancelPending() noexcept {
+  IOP_TRACE();
+  if (inFlight == nullptr)
+    return;
+  // The connection is in an unknown state
+  Network::wifiClient().stop();
+  inFlight.reset();
+}
+
+auto Network::httpPostAsync(const std::string_view token, const StaticString path,
+                            BodyStream body, const ContentType type, PayloadSink sink,
+                            const RequestDeadlines deadlines) const noexcept
+    -> PendingRequest {
+  IOP_TRACE();
+  Network::setup();
+
+  if (!Network::isConnected())
+    return PendingRequest::finished(NetworkStatus::CONNECTION_ISSUES);
+  if (Network::isBusy()) {
+    this->logger.warn(F("Another request is in flight, try again later"));
+    return PendingRequest::finished(NetworkStatus::CONNECTION_ISSUES);
+  }
+  auto &breaker = breakerFor(path);
+  if (!breaker.allow(retryPolicy, driver::thisThread.now())) {
+    stats_.shortCircuits++;
+    this->logger.warn(F("Endpoint is down, request short-circuited: "), path);
+    return PendingRequest::finished(breaker.deferred() ? NetworkStatus::THROTTLED : NetworkStatus::CONNECTION_ISSUES);
+  }
+
+  auto endpoint = endpointOf(this->uri());
+  const auto bodyLength = body.size();
+  this->logger.info(F("POST to "), this->uri(), path, F(", data length: "), bodyLength);
+
+  std::string head;
+  head += "POST ";
+  head += path.toStdString();
+  head += " HTTP/1.1\r\nHost: ";
+  head += endpoint.hostAndPort;
+  head += "\r\nUser-Agent: ESP8266HTTPClient\r\nConnection: keep-alive\r\nContent-Type: ";
+  head += Network::contentTypeToString(type).toStdString();
+  head += "\r\nContent-Length: ";
+  head += std::to_string(bodyLength);
+  head += "\r\nAuthorization: Basic ";
+  head += token;
+  head += "\r\n";
+  head += headerBlock.update(deviceTelemetry());
+  head += "\r\n";
+
+  // Serialized once, so the body may refer to the caller's memory and isn't
+  // serialized again per chunk. The request is held in full until it's done
+  const auto length = head.length() + bodyLength;
+  std::unique_ptr<uint8_t[]> data;
+  if (length <= driver::device.biggestHeapBlock() / 2)
+    data.reset(new (std::nothrow) uint8_t[length]);
+  if (data == nullptr) {
+    this->logger.warn(F("Request doesn't fit the heap, giving up: "), length);
+    return PendingRequest::finished(NetworkStatus::CONNECTION_ISSUES);
+  }
+  memcpy(data.get(), head.data(), head.length());
+  if (bodyLength > 0 && body.read(data.get() + head.length(), bodyLength) != static_cast<int>(bodyLength)) {
+    this->logger.error(F("Body stream ended early, expected: "), bodyLength);
+    return PendingRequest::finished(NetworkStatus::CLIENT_BUFFER_OVERFLOW);
+  }
+
+  const auto id = ++lastRequestId;
+  inFlight = std::make_unique<InFlight>(id, *this, this->logger, path, deadlines, std::move(endpoint),
+                                        std::move(data), head.length(), length, std::move(sink));
+  auto &request = *inFlight;
+  // Stored in the heap, so the sink can refer to it
+  request.parser.setSink([&request](const std::string_view piece) {
+    return request.payload.write(reinterpret_cast<const uint8_t *>(piece.data()), piece.length()) == piece.length();
+  });
+  request.parser.collect("LATEST_VERSION");
+  request.parser.collect("ACCEPTED_CONTENT_TYPE");
+  request.parser.collect("Retry-After");
+
+  logMemory(this->logger);
+  return PendingRequest(id);
+}
+
+PendingRequest::PendingRequest(const uint32_t id) noexcept
+    : id(id), status_(), payloadLength_(0) {}
+
+auto PendingRequest::finished(const NetworkStatus status) noexcept -> PendingRequest {
+  PendingRequest request(0);
+  request.status_ = status;
+  return request;
+}
+
+auto PendingRequest::phase() const noexcept -> RequestPhase {
+  if (this->status_.has_value() || inFlight == nullptr || inFlight->id != this->id)
+    return RequestPhase::DONE;
+  return inFlight->phase;
+}
+
+auto PendingRequest::poll() noexcept -> std::optional<NetworkStatus> {
+  if (this->status_.has_value())
+    return this->status_;
+
+  // Cancelled by `Network::cancelPending`
+  if (inFlight == nullptr || inFlight->id != this->id) {
+    this->status_ = NetworkStatus::CONNECTION_ISSUES;
+    return this->status_;
+  }
+
+  auto &request = *inFlight;
+  const auto code = advance(request);
+  if (!code.has_value())
+    return std::nullopt;
+
+  const auto status = outcome(request, iop::unwrap_ref(code, IOP_CTX()));
+  auto &breaker = breakerFor(request.path);
+  if (status == NetworkStatus::THROTTLED) {
+    throttle(request.logger, request.path, request.parser.header("Retry-After").value_or(""));
+  } else if (isFailure(status)) {
+    breaker.failure(retryPolicy, driver::thisThread.now());
+    if (retryLater(request))
+      return std::nullopt;
+  } else {
+    breaker.success();
+  }
+
+  this->payloadLength_ = request.payload.length();
+  this->status_ = status;
+  inFlight.reset();
+  return this->status_;
+}
+
+auto PendingRequest::wait() noexcept -> NetworkStatus {
+  IOP_TRACE();
+  while (true) {
+    const auto status = this->poll();
+    if (status.has_value())
+      return iop::unwrap_ref(status, IOP_CTX());
+    driver::thisThread.yield();
+  }
+}
+
+void PendingRequest::cancel() noexcept {
+  IOP_TRACE();
+  if (!this->status_.has_value() && inFlight != nullptr && inFlight->id == this->id)
+    Network::cancelPending();
+  if (!this->status_.has_value())
+    this->status_ = NetworkStatus::CONNECTION_ISSUES;
+}
 #else
 #include "driver/thread.hpp"
 #include "driver/wifi.hpp"
@@ -246,35 +949,113 @@ auto Network::isConnected() noexcept -> bool {
   IOP_TRACE();
   return true;
 }
+auto Network::acceptedContentType() noexcept -> ContentType {
+  return ContentType::JSON;
+}
+auto Network::isContentTypeAccepted(const ContentType type) noexcept -> bool {
+  return type == ContentType::JSON;
+}
 auto Network::httpRequest(const HttpMethod method,
                           const std::optional<std::string_view> &token, std::string_view path,
-                          const std::optional<std::string_view> &data) const noexcept
+                          std::optional<std::reference_wrapper<BodyStream>> body,
+                          const ContentType type, PayloadSink sink) const noexcept
     -> std::variant<Response, int> const &
   (void)*this;
   (void)token;
   (void)method;
   (void)std::move(path);
-  (void)data;
+  (void)body;
+  (void)type;
+  (void)sink;
   IOP_TRACE();
   return Response(NetworkStatus::OK);
 }
+auto Network::isBusy() noexcept -> bool { return false; }
+void Network::cancelPending() noexcept { IOP_TRACE(); }
+auto Network::httpPostAsync(const std::string_view token, const StaticString path,
+                            BodyStream body, const ContentType type, PayloadSink sink,
+                            const RequestDeadlines deadlines) const noexcept
+    -> PendingRequest {
+  (void)*this;
+  (void)token;
+  (void)path;
+  (void)body;
+  (void)type;
+  (void)sink;
+  (void)deadlines;
+  IOP_TRACE();
+  return PendingRequest::finished(NetworkStatus::OK);
+}
+PendingRequest::PendingRequest(const uint32_t id) noexcept
+    : id(id), status_(), payloadLength_(0) {}
+auto PendingRequest::finished(const NetworkStatus status) noexcept -> PendingRequest {
+  PendingRequest request(0);
+  request.status_ = status;
+  return request;
+}
+auto PendingRequest::phase() const noexcept -> RequestPhase { return RequestPhase::DONE; }
+auto PendingRequest::poll() noexcept -> std::optional<NetworkStatus> {
+  return this->status_.value_or(NetworkStatus::OK);
+}
+auto PendingRequest::wait() noexcept -> NetworkStatus {
+  return this->status_.value_or(NetworkStatus::OK);
+}
+void PendingRequest::cancel() noexcept {}
 #endif
 
+auto Network::stats() noexcept -> NetworkStats {
+  return stats_;
+}
+
+void Network::setRetryPolicy(const RetryPolicy policy) noexcept {
+  retryPolicy = policy;
+}
+
+auto Network::circuitState(const StaticString path) noexcept -> CircuitState {
+  return breakerFor(path).state();
+}
+
+auto Network::retryAfter() noexcept -> esp_time {
+  return retryAfter_;
+}
+
 auto Network::httpPost(std::string_view token, const StaticString path,
-                       std::string_view data) const noexcept
+                       std::string_view data, const ContentType type) const noexcept
+    -> std::variant<Response, int> const & {
+  IOP_TRACE();
+  auto body = BodyStream::fromView(data);
+  return this->httpPost(token, path, body, type);
+}
+
+auto Network::httpPost(std::string_view token, const StaticString path,
+                       BodyStream &body, const ContentType type,
+                       PayloadSink sink) const noexcept
     -> std::variant<Response, int> const & {
   IOP_TRACE();
   return this->httpRequest(HttpMethod::POST, std::make_optional(std::move(token)),
-                           path,
-                           std::make_optional(std::move(data)));
+                           path, std::make_optional(std::ref(body)), type, std::move(sink));
 }
 
-auto Network::httpPost(StaticString path, std::string_view data) const noexcept
+auto Network::httpPost(StaticString path, BodyStream &body, PayloadSink sink) const noexcept
     -> std::variant<Response, int> const & {
   IOP_TRACE();
   return this->httpRequest(HttpMethod::POST, std::optional<std::string_view>(),
-                           path,
-                           std::make_optional(std::move(data)));
+                           path, std::make_optional(std::ref(body)), ContentType::JSON,
+                           std::move(sink));
+}
+
+auto Network::contentTypeToString(const ContentType type) noexcept
+    -> StaticString {
+  IOP_TRACE();
+  switch (type) {
+  case ContentType::JSON:
+    return F("application/json");
+  case ContentType::MSGPACK:
+    return F("application/msgpack");
+  case ContentType::IOP_EVENTS:
+    return F("application/vnd.iop.events");
+  }
+  return F("application/json");
 }
 
 auto Network::rawStatusToString(const RawStatus &status) noexcept
@@ -301,6 +1082,10 @@ auto Network::rawStatusToString(const RawStatus &status) noexcept
     return F("SERVER_ERROR");
   case RawStatus::FORBIDDEN:
     return F("FORBIDDEN");
+  case RawStatus::TOO_MANY_REQUESTS:
+    return F("TOO_MANY_REQUESTS");
+  case RawStatus::SERVICE_UNAVAILABLE:
+    return F("SERVICE_UNAVAILABLE");
   case RawStatus::UNKNOWN:
     return F("UNKNOWN");
   }
@@ -316,6 +1101,10 @@ auto Network::rawStatus(const int code) const noexcept -> RawStatus {
     return RawStatus::SERVER_ERROR;
   case HTTP_CODE_FORBIDDEN:
     return RawStatus::FORBIDDEN;
+  case HTTP_CODE_TOO_MANY_REQUESTS:
+    return RawStatus::TOO_MANY_REQUESTS;
+  case HTTP_CODE_SERVICE_UNAVAILABLE:
+    return RawStatus::SERVICE_UNAVAILABLE;
   case HTTPC_ERROR_CONNECTION_FAILED:
     return RawStatus::CONNECTION_FAILED;
   case HTTPC_ERROR_SEND_HEADER_FAILED:
@@ -354,6 +1143,8 @@ auto Network::apiStatusToString(const NetworkStatus &status) noexcept
     return F("CLIENT_BUFFER_OVERFLOW");
   case NetworkStatus::BROKEN_SERVER:
     return F("BROKEN_SERVER");
+  case NetworkStatus::THROTTLED:
+    return F("THROTTLED");
   case NetworkStatus::OK:
     return F("OK");
   case NetworkStatus::FORBIDDEN:
@@ -394,6 +1185,13 @@ auto Network::apiStatus(const RawStatus &raw) const noexcept
     ret.emplace(NetworkStatus::CONNECTION_ISSUES);
     break;
 
+  case RawStatus::TOO_MANY_REQUESTS:
+  case RawStatus::SERVICE_UNAVAILABLE:
+    this->logger.warn(F("Server is overloaded. Code: "),
+                      std::to_string(static_cast<int>(raw)));
+    ret.emplace(NetworkStatus::THROTTLED);
+    break;
+
   case RawStatus::OK:
     ret.emplace(NetworkStatus::OK);
     break;
@@ -422,22 +1220,21 @@ Network::Network(StaticString uri, const LogLevel &logLevel) noexcept
 }
 
 Response::Response(const NetworkStatus &status) noexcept
-    : status(status), payload(std::optional<std::string>()) {
+    : payloadLength(0), status(status) {
   IOP_TRACE();
 }
-Response::Response(const NetworkStatus &status, std::string payload) noexcept
-    : status(status), payload(payload) {
+Response::Response(const NetworkStatus &status, const size_t payloadLength) noexcept
+    : payloadLength(payloadLength), status(status) {
   IOP_TRACE();
 }
 Response::Response(Response &&resp) noexcept
-    : status(resp.status), payload(std::optional<std::string>()) {
+    : payloadLength(resp.payloadLength), status(resp.status) {
   IOP_TRACE();
-  this->payload.swap(resp.payload);
 }
 auto Response::operator=(Response &&resp) noexcept -> Response & {
   IOP_TRACE();
   this->status = resp.status;
-  this->payload.swap(resp.payload);
+  this->payloadLength = resp.payloadLength;
   return *this;
 }
 
@@ -449,6 +1246,5 @@ Response::~Response() noexcept {
   Log::print(F("~Response("), LogLevel::TRACE, LogType::START);
   Log::print(str.get(), LogLevel::TRACE, LogType::CONTINUITY);
   Log::print(F(")\n"), LogLevel::TRACE, LogType::END);
-  Log::flush();
 }
 } // namespace iop
\ No newline at end of file
@@ -62,6 +62,7 @@ void PanicHook::defaultEntry(std::string_view const &msg,
                 F(" of file "), point.file(), F(" inside "), point.func(),
                 F(": "), msg);
     iop::logMemory(iop::panicLogger());
+    iop::Log::flush();
     driver::device.deepSleep(0);
     driver::thisThread.panic_();
   }
@@ -75,6 +76,8 @@ void PanicHook::defaultHalt(std::string_view const &msg,
   (void)msg;
   (void)point;
   IOP_TRACE();
+  // Logs are written asynchronously, the panic must reach the serial first
+  iop::Log::flush();
   driver::device.deepSleep(0);
   driver::thisThread.panic_();
 }
@@ -0,0 +1,92 @@
+#include "core/retry.hpp"
+
+#include <algorithm>
+
+namespace iop {
+Random::Random(const uint32_t seed) noexcept : state(seed == 0 ? 0x9E3779B9 : seed) {}
+
+auto Random::next() noexcept -> uint32_t {
+  this->state ^= this->state << 13;
+  this->state ^= this->state >> 17;
+  this->state ^= this->state << 5;
+  return this->state;
+}
+
+auto Random::upTo(const uint32_t bound) noexcept -> uint32_t {
+  if (bound == UINT32_MAX)
+    return this->next();
+  return this->next() % (bound + 1);
+}
+
+auto backoffDelay(const RetryPolicy &policy, const uint8_t retry, Random &random) noexcept -> esp_time {
+  // Doubling stops at the cap, so it never overflows
+  esp_time cap = policy.baseDelay;
+  for (uint8_t index = 0; index < retry && cap < policy.maxDelay; ++index)
+    cap *= 2;
+  cap = std::min(cap, policy.maxDelay);
+  return random.upTo(static_cast<uint32_t>(cap));
+}
+
+auto parseRetryAfter(std::string_view value, const esp_time max) noexcept -> std::optional<esp_time> {
+  while (!value.empty() && value.front() == ' ')
+    value.remove_prefix(1);
+  while (!value.empty() && value.back() == ' ')
+    value.remove_suffix(1);
+  if (value.empty())
+    return std::nullopt;
+
+  esp_time seconds = 0;
+  for (const auto digit: value) {
+    if (digit < '0' || digit > '9')
+      return std::nullopt;
+    // Saturates, the cap applies anyway
+    if (seconds <= max / 1000)
+      seconds = seconds * 10 + static_cast<esp_time>(digit - '0');
+  }
+  return seconds > max / 1000 ? max : seconds * 1000;
+}
+
+CircuitBreaker::CircuitBreaker() noexcept
+    : state_(CircuitState::CLOSED), failures(0), openedAt(0), deferredFor(0) {}
+
+auto CircuitBreaker::allow(const RetryPolicy &policy, const esp_time now) noexcept -> bool {
+  switch (this->state_) {
+  case CircuitState::CLOSED:
+    return true;
+
+  case CircuitState::OPEN:
+  case CircuitState::HALF_OPEN:
+    // A probe whose outcome never came (ex: cancelled) is replaced by another
+    if (now - this->openedAt < (this->deferredFor > 0 ? this->deferredFor : policy.openFor))
+      return false;
+    this->state_ = CircuitState::HALF_OPEN;
+    this->openedAt = now;
+    return true;
+  }
+  return true;
+}
+
+void CircuitBreaker::success() noexcept {
+  this->state_ = CircuitState::CLOSED;
+  this->failures = 0;
+  this->deferredFor = 0;
+}
+
+void CircuitBreaker::failure(const RetryPolicy &policy, const esp_time now) noexcept {
+  if (this->failures < UINT8_MAX)
+    this->failures++;
+
+  if (this->state_ == CircuitState::HALF_OPEN || this->failures >= policy.failureThreshold) {
+    this->state_ = CircuitState::OPEN;
+    this->openedAt = now;
+    this->deferredFor = 0;
+  }
+}
+
+void CircuitBreaker::defer(const esp_time now, const esp_time delay) noexcept {
+  this->state_ = CircuitState::OPEN;
+  this->openedAt = now;
+  // Zero would mean `RetryPolicy::openFor`
+  this->deferredFor = delay > 0 ? delay : 1;
+}
+} // namespace iop
@@ -0,0 +1,70 @@
+#include "core/tls_session.hpp"
+#include "core/string.hpp"
+#include "driver/device.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstring>
+
+constexpr static uint32_t magic = 0x544C5331; // TLS1
+
+struct Slot {
+  uint32_t magic;
+  uint32_t hostHash;
+  uint32_t length;
+  std::array<uint8_t, iop::TlsSessionStore::capacity> data;
+  uint32_t checksum;
+};
+static_assert(sizeof(Slot) % 4 == 0, "RTC memory is accessed in 4 byte blocks");
+
+static auto hostHashOf(const std::string_view host) noexcept -> uint32_t {
+  return static_cast<uint32_t>(iop::hashString(host));
+}
+
+static auto checksumOf(const Slot &slot) noexcept -> uint32_t {
+  const auto *bytes = reinterpret_cast<const char *>(&slot);
+  return static_cast<uint32_t>(iop::hashString(std::string_view(bytes, offsetof(Slot, checksum))));
+}
+
+static auto read(Slot &slot) noexcept -> bool {
+  return driver::device.rtcRead(iop::TlsSessionStore::rtcOffset, reinterpret_cast<uint32_t *>(&slot), sizeof(Slot));
+}
+
+namespace iop {
+auto TlsSessionStore::load(const std::string_view host, uint8_t *data, const size_t size) noexcept -> bool {
+  Slot slot;
+  if (!read(slot))
+    return false;
+  if (slot.magic != magic || slot.checksum != checksumOf(slot))
+    return false;
+  if (slot.hostHash != hostHashOf(host) || slot.length != size || size > capacity)
+    return false;
+
+  memcpy(data, slot.data.data(), size);
+  return true;
+}
+
+void TlsSessionStore::store(const std::string_view host, const uint8_t *data, const size_t size) noexcept {
+  if (size > capacity)
+    return;
+
+  Slot slot;
+  memset(&slot, 0, sizeof(Slot));
+  slot.magic = magic;
+  slot.hostHash = hostHashOf(host);
+  slot.length = static_cast<uint32_t>(size);
+  memcpy(slot.data.data(), data, size);
+  slot.checksum = checksumOf(slot);
+
+  Slot current;
+  if (read(current) && memcmp(&current, &slot, sizeof(Slot)) == 0)
+    return;
+  driver::device.rtcWrite(TlsSessionStore::rtcOffset, reinterpret_cast<const uint32_t *>(&slot), sizeof(Slot));
+}
+
+void TlsSessionStore::clear() noexcept {
+  Slot slot;
+  memset(&slot, 0, sizeof(Slot));
+  driver::device.rtcWrite(TlsSessionStore::rtcOffset, reinterpret_cast<const uint32_t *>(&slot), sizeof(Slot));
+}
+} // namespace iop
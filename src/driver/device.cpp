@@ -8,6 +8,7 @@ namespace driver {
 
 #ifdef IOP_DESKTOP
 #include <stdint.h>
+#include <cstring>
 #include <thread>
 
 namespace driver {
@@ -44,6 +45,21 @@ iop::MacAddress & Device::macAddress() const noexcept {
   mac.fill('A');
   return mac;
 }
+// Only lives as long as the process, like the real one only lives until
+// power is lost
+static std::array<uint32_t, 128> rtcMemory = {0};
+auto Device::rtcRead(const uint32_t offset, uint32_t *data, const size_t size) const noexcept -> bool {
+  if (offset * 4 + size > rtcMemory.size() * 4)
+    return false;
+  memcpy(data, rtcMemory.data() + offset, size);
+  return true;
+}
+auto Device::rtcWrite(const uint32_t offset, const uint32_t *data, const size_t size) const noexcept -> bool {
+  if (offset * 4 + size > rtcMemory.size() * 4)
+    return false;
+  memcpy(rtcMemory.data() + offset, data, size);
+  return true;
+}
 }
 #define sprintf_P sprintf
 #else
@@ -114,6 +130,13 @@ iop::MacAddress & Device::macAddress() const noexcept {
   sprintf_P(mac.data(), fmt, buff[0], buff[1], buff[2], buff[3], buff[4], buff[5]);
   return mac;
 }
+auto Device::rtcRead(const uint32_t offset, uint32_t *data, const size_t size) const noexcept -> bool {
+  return ESP.rtcUserMemoryRead(offset, data, size);
+}
+auto Device::rtcWrite(const uint32_t offset, const uint32_t *data, const size_t size) const noexcept -> bool {
+  // The core's signature isn't const correct, it only reads from it
+  return ESP.rtcUserMemoryWrite(offset, const_cast<uint32_t *>(data), size);
+}
 }
 
 #endif
\ No newline at end of file
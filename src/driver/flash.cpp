@@ -2,6 +2,12 @@
 
 namespace driver {
     Flash flash;
+    FlashSectors flashSectors;
+
+static auto inBounds(const size_t count, const size_t sector, const size_t offset, const size_t size) noexcept -> bool {
+    return sector < count && offset + size <= FlashSectors::sectorSize &&
+           offset % 4 == 0 && size % 4 == 0;
+}
 }
 
 #ifdef IOP_DESKTOP
@@ -11,6 +17,7 @@ namespace driver {
 #include <new>
 #include <cstdlib>
 #include <fcntl.h>
+#include <cstring>
 
 namespace driver {
 // This driver is horrible, please fix this
@@ -70,9 +77,65 @@ uint8_t * Flash::asMut() noexcept {
     iop_assert(this->buffer, F("Allocation failed"));
     return this->buffer;
 }
+
+// Written through, like a real flash
+static void persistSectors(const uint8_t *buffer, const size_t size) noexcept {
+    const auto fd = ::open("sectors.dat", O_WRONLY | O_CREAT, 0777);
+    iop_assert(fd != -1, F("Unable to open file"));
+    if (::write(fd, buffer, size) == -1) {
+      iop_panic(std::to_string(errno) + ": " + strerror(errno));
+    }
+    iop_assert(::close(fd) != -1, F("Close failed"));
+}
+
+void FlashSectors::setup(const size_t count) noexcept {
+    IOP_TRACE();
+    delete[] this->buffer;
+    this->buffer = nullptr;
+    this->count_ = 0;
+    if (count == 0) return;
+
+    this->buffer = new (std::nothrow) uint8_t[count * sectorSize];
+    iop_assert(this->buffer, F("Allocation failed"));
+    std::memset(this->buffer, 0xFF, count * sectorSize);
+    this->count_ = count;
+
+    const auto fd = ::open("sectors.dat", O_RDONLY);
+    if (fd != -1) {
+        if (::read(fd, this->buffer, count * sectorSize) == -1)
+            std::memset(this->buffer, 0xFF, count * sectorSize);
+        close(fd);
+    }
+}
+auto FlashSectors::read(const size_t sector, const size_t offset, void *out, const size_t size) const noexcept -> bool {
+    IOP_TRACE();
+    if (!inBounds(this->count_, sector, offset, size)) return false;
+    std::memcpy(out, this->buffer + sector * sectorSize + offset, size);
+    return true;
+}
+auto FlashSectors::write(const size_t sector, const size_t offset, const void *data, const size_t size) noexcept -> bool {
+    IOP_TRACE();
+    if (!inBounds(this->count_, sector, offset, size)) return false;
+    const auto *bytes = static_cast<const uint8_t *>(data);
+    for (size_t index = 0; index < size; ++index)
+        this->buffer[sector * sectorSize + offset + index] &= bytes[index];
+    persistSectors(this->buffer, this->count_ * sectorSize);
+    return true;
+}
+auto FlashSectors::erase(const size_t sector) noexcept -> bool {
+    IOP_TRACE();
+    if (sector >= this->count_) return false;
+    std::memset(this->buffer + sector * sectorSize, 0xFF, sectorSize);
+    persistSectors(this->buffer, this->count_ * sectorSize);
+    return true;
+}
 }
 #else
 #include "EEPROM.h"
+#include "Esp.h"
+#include "flash_hal.h"
+
+#include <algorithm>
 
 static EEPROMClass EEPROM;
 
@@ -96,5 +159,25 @@ uint8_t const * Flash::asRef() const noexcept {
 uint8_t * Flash::asMut() noexcept {
     return EEPROM.getDataPtr();
 }
+
+static auto sectorAddress(const size_t sector) noexcept -> uint32_t {
+    return static_cast<uint32_t>(FS_PHYS_ADDR + sector * FlashSectors::sectorSize);
+}
+
+void FlashSectors::setup(const size_t count) noexcept {
+    this->count_ = std::min<size_t>(count, FS_PHYS_SIZE / sectorSize);
+}
+auto FlashSectors::read(const size_t sector, const size_t offset, void *out, const size_t size) const noexcept -> bool {
+    if (!inBounds(this->count_, sector, offset, size)) return false;
+    return ESP.flashRead(sectorAddress(sector) + offset, static_cast<uint32_t *>(out), size);
+}
+auto FlashSectors::write(const size_t sector, const size_t offset, const void *data, const size_t size) noexcept -> bool {
+    if (!inBounds(this->count_, sector, offset, size)) return false;
+    return ESP.flashWrite(sectorAddress(sector) + offset, static_cast<const uint32_t *>(data), size);
+}
+auto FlashSectors::erase(const size_t sector) noexcept -> bool {
+    if (sector >= this->count_) return false;
+    return ESP.flashEraseSector(sectorAddress(sector) / sectorSize);
+}
 }
 #endif
\ No newline at end of file
@@ -2,34 +2,52 @@
 #include "core/log.hpp"
 
 #ifdef IOP_DESKTOP
-#include <iostream>
-#include "core/panic.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
 
-#include <pthread.h>
-static pthread_mutex_t lock;
+/// Drains the log buffer, so loggers never wait for stdout
+static void writer() noexcept {
+    while (true) {
+        if (iop::Log::poll() == 0) {
+            fflush(stdout);
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+}
+
+static void flushAtExit() noexcept { iop::Log::flush(); }
+
+static std::once_flag writerStarted;
+static void startWriter() noexcept {
+    std::call_once(writerStarted, [] {
+        std::thread(writer).detach();
+        std::atexit(flushAtExit);
+    });
+}
 
 void logSetup(const iop::LogLevel &level) noexcept {
-    iop_assert(pthread_mutex_init(&lock, NULL) == 0, F("Mutex init failed"));
+    (void)level;
+    startWriter();
 }
-void logPrint(const std::string_view msg) noexcept {
-    pthread_mutex_lock(&lock);
-    std::cout << msg;
-    pthread_mutex_unlock(&lock);
+auto logWrite(const std::string_view msg) noexcept -> size_t {
+    return fwrite(msg.data(), 1, msg.length(), stdout);
 }
-void logPrint(const iop::StaticString msg) noexcept {
-    pthread_mutex_lock(&lock);
-    std::cout << msg.asCharPtr();
-    pthread_mutex_unlock(&lock);
+void logPending() noexcept {
+    // Logging may happen before setup
+    startWriter();
 }
 void logFlush() noexcept { 
-    pthread_mutex_lock(&lock);
-    std::cout << std::flush;
-    pthread_mutex_unlock(&lock);
+    fflush(stdout);
 }
 #else
 #include "Arduino.h"
 #include "core/log.hpp"
 
+#include <algorithm>
+
 HardwareSerial Serial(UART0);
 
 void logSetup(const iop::LogLevel &level) noexcept {
@@ -43,13 +61,18 @@ void logSetup(const iop::LogLevel &level) noexcept {
     while (!Serial && millis() < end)
         yield();
 }
-void logPrint(const iop::StaticString msg) noexcept {
-    Serial.print(msg.get());
+auto logWrite(const std::string_view msg) noexcept -> size_t {
+    // Only what fits in the UART TX FIFO, so it never spins
+    const auto room = static_cast<size_t>(Serial.availableForWrite());
+    if (room == 0)
+        return 0;
+    return Serial.write(reinterpret_cast<const uint8_t*>(msg.data()), std::min(room, msg.length()));
 }
-void logPrint(const std::string_view msg) noexcept {
-    Serial.write(reinterpret_cast<const uint8_t*>(msg.begin()), msg.length());
+void logPending() noexcept {
+    // The event loop drains the rest, as the FIFO empties
+    iop::Log::poll();
 }
 void logFlush() noexcept {
     Serial.flush();
 }
-#endif
\ No newline at end of file
+#endif
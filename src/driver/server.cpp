@@ -226,15 +226,12 @@ void HttpServer::handleClient() noexcept {
       continue;
 
     logger().debug(F("Route: "), conn.currentRoute);
-    iop::Log::shouldFlush(false);
     if (this->router.count(conn.currentRoute) != 0) {
       this->router.at(conn.currentRoute)(conn, *logger);
     } else {
       logger().debug(F("Route not found"));
       this->notFoundHandler(conn, *logger);
     }
-    iop::Log::shouldFlush(true);
-    logger().flush();
     break;
   }
 
@@ -5,6 +5,11 @@
 #include "driver/flash.hpp"
 #include "core/panic.hpp"
 
+#include <algorithm>
+#include <array>
+
+// ESP8266's EEPROM is emulated in a flash sector, mirrored in RAM. So it only
+// keeps the credentials, the event queue has its own sectors
 constexpr const uint16_t EEPROM_SIZE = 512;
 
 // If another type is to be written to flash be carefull not to mess with what
@@ -27,7 +32,12 @@ const uint16_t authTokenIndex = wifiConfigIndex + wifiConfigSize;
 static_assert(authTokenIndex + authTokenSize < EEPROM_SIZE,
               "EEPROM too small to store needed credentials");
 
-auto Flash::setup() noexcept -> void { driver::flash.setup(EEPROM_SIZE); }
+static void setupEventQueue() noexcept;
+
+auto Flash::setup() noexcept -> void {
+  driver::flash.setup(EEPROM_SIZE);
+  setupEventQueue();
+}
 
 static bool cachedAuthToken = false;
 auto Flash::readAuthToken() const noexcept -> std::optional<std::reference_wrapper<const AuthToken>> {
@@ -175,6 +185,208 @@ void Flash::writeWifiConfig(const WifiCredentials &config) const noexcept {
   driver::flash.put(wifiConfigIndex + 1 + 32, config.password);
   driver::flash.commit();
 }
+
+// Each sector is a header followed by fixed slots, written in place: first
+// the event, then its state. States only clear bits, so events are removed
+// without erasing anything. A sector is only erased when the writer wraps
+// around to it, once every `eventSlotsPerSector` events
+constexpr const uint8_t eventQueueSectors = 2;
+// Bumped whenever EventStorage's layout changes, so old queues are dropped
+constexpr const uint32_t eventSectorMagic = 0x494F5001;
+
+struct EventSectorHeader {
+  uint32_t magic;
+  /// Grows every time a sector is taken, the oldest sector has the lowest
+  uint32_t sequence;
+};
+
+constexpr const uint32_t freeSlot = 0xFFFFFFFF;
+constexpr const uint32_t queuedSlot = 0x0000FFFF;
+constexpr const uint32_t removedSlot = 0;
+
+struct EventSlot {
+  uint32_t state;
+  EventStorage event;
+};
+static_assert(sizeof(EventStorage) % 4 == 0 && sizeof(EventSlot) % 4 == 0,
+              "Flash is written in words");
+
+constexpr const uint16_t eventSlotsPerSector =
+    (driver::FlashSectors::sectorSize - sizeof(EventSectorHeader)) / sizeof(EventSlot);
+
+/// Where the queue is, rebuilt from flash at setup
+struct EventQueue {
+  std::array<EventSectorHeader, eventQueueSectors> headers;
+  /// Newest sector, none until the first event
+  std::optional<uint8_t> writeSector;
+  uint16_t writeSlot;
+  uint16_t length;
+};
+static EventQueue queue = {{}, std::nullopt, 0, 0};
+/// Slots returned by the last `peekEvents`, `sector * eventSlotsPerSector + slot`
+static std::vector<uint16_t> peeked;
+constexpr const uint16_t droppedSlot = UINT16_MAX;
+
+static auto slotOffset(const uint16_t slot) noexcept -> size_t {
+  return sizeof(EventSectorHeader) + slot * sizeof(EventSlot);
+}
+
+static auto isValid(const uint8_t sector) noexcept -> bool {
+  return queue.headers.at(sector).magic == eventSectorMagic;
+}
+
+static auto slotState(const uint8_t sector, const uint16_t slot) noexcept -> uint32_t {
+  uint32_t state = removedSlot;
+  driver::flashSectors.read(sector, slotOffset(slot), &state, sizeof(state));
+  return state;
+}
+
+/// Slots written so far, the ones after it were never touched
+static auto usedSlots(const uint8_t sector) noexcept -> uint16_t {
+  if (queue.writeSector == sector)
+    return queue.writeSlot;
+  return isValid(sector) ? eventSlotsPerSector : 0;
+}
+
+/// Valid sectors, oldest first
+static auto sectorsInOrder() noexcept -> std::vector<uint8_t> {
+  std::vector<uint8_t> sectors;
+  for (uint8_t sector = 0; sector < driver::flashSectors.count(); ++sector) {
+    if (isValid(sector))
+      sectors.push_back(sector);
+  }
+  std::sort(sectors.begin(), sectors.end(), [](const uint8_t a, const uint8_t b) {
+    return queue.headers.at(a).sequence < queue.headers.at(b).sequence;
+  });
+  return sectors;
+}
+
+static void setupEventQueue() noexcept {
+  IOP_TRACE();
+  driver::flashSectors.setup(eventQueueSectors);
+  queue = {{}, std::nullopt, 0, 0};
+  peeked.clear();
+
+  for (uint8_t sector = 0; sector < driver::flashSectors.count(); ++sector) {
+    auto &header = queue.headers.at(sector);
+    if (!driver::flashSectors.read(sector, 0, &header, sizeof(header)))
+      header = {0, 0};
+  }
+
+  for (const auto sector: sectorsInOrder()) {
+    queue.writeSector = sector;
+    queue.writeSlot = 0;
+    for (uint16_t slot = 0; slot < eventSlotsPerSector; ++slot) {
+      EventSlot stored;
+      driver::flashSectors.read(sector, slotOffset(slot), &stored, sizeof(stored));
+      if (stored.state == queuedSlot)
+        queue.length++;
+
+      // Interrupted writes leave the event without its state, those slots
+      // can't be written again either
+      const auto *bytes = reinterpret_cast<const uint8_t *>(&stored);
+      if (std::any_of(bytes, bytes + sizeof(stored), [](const uint8_t byte) { return byte != 0xFF; }))
+        queue.writeSlot = static_cast<uint16_t>(slot + 1);
+    }
+  }
+}
+
+/// Takes the sector after the newest. If it still has events the queue is
+/// full, they are dropped
+static void advanceEventQueue(const iop::Log &logger) noexcept {
+  IOP_TRACE();
+  uint32_t sequence = 0;
+  for (uint8_t sector = 0; sector < driver::flashSectors.count(); ++sector) {
+    if (isValid(sector))
+      sequence = std::max(sequence, queue.headers.at(sector).sequence);
+  }
+  const auto next = static_cast<uint8_t>(queue.writeSector.has_value()
+      ? (iop::unwrap_ref(queue.writeSector, IOP_CTX()) + 1) % driver::flashSectors.count()
+      : 0);
+
+  uint16_t dropped = 0;
+  for (uint16_t slot = 0; slot < usedSlots(next); ++slot) {
+    if (slotState(next, slot) == queuedSlot)
+      dropped++;
+  }
+  if (dropped > 0) {
+    logger.warn(F("Event queue is full, dropping oldest events: "), dropped);
+    queue.length = static_cast<uint16_t>(queue.length - dropped);
+  }
+  // They may be in flight, their removal is ignored
+  for (auto &id: peeked) {
+    if (id != droppedSlot && id / eventSlotsPerSector == next)
+      id = droppedSlot;
+  }
+
+  driver::flashSectors.erase(next);
+  const EventSectorHeader header = {eventSectorMagic, sequence + 1};
+  driver::flashSectors.write(next, 0, &header, sizeof(header));
+  queue.headers.at(next) = header;
+  queue.writeSector = next;
+  queue.writeSlot = 0;
+}
+
+void Flash::enqueueEvent(const EventStorage &event) const noexcept {
+  IOP_TRACE();
+  if (driver::flashSectors.count() == 0) {
+    this->logger.error(F("No flash sectors for the event queue, event lost"));
+    return;
+  }
+
+  if (!queue.writeSector.has_value() || queue.writeSlot == eventSlotsPerSector)
+    advanceEventQueue(this->logger);
+
+  // The state is written last, so interrupted writes aren't mistaken for events
+  const auto sector = iop::unwrap_ref(queue.writeSector, IOP_CTX());
+  const auto slot = queue.writeSlot++;
+  driver::flashSectors.write(sector, slotOffset(slot) + sizeof(uint32_t), &event, sizeof(event));
+  driver::flashSectors.write(sector, slotOffset(slot), &queuedSlot, sizeof(queuedSlot));
+  queue.length++;
+
+  this->logger.debug(F("Enqueued event, queue length: "), queue.length);
+}
+
+auto Flash::peekEvents(const uint16_t max) const noexcept -> std::vector<Event> {
+  IOP_TRACE();
+  peeked.clear();
+  std::vector<Event> events;
+  events.reserve(std::min(queue.length, max));
+  for (const auto sector: sectorsInOrder()) {
+    for (uint16_t slot = 0; slot < usedSlots(sector) && events.size() < max; ++slot) {
+      EventSlot stored;
+      driver::flashSectors.read(sector, slotOffset(slot), &stored, sizeof(stored));
+      if (stored.state != queuedSlot)
+        continue;
+
+      events.emplace_back(stored.event);
+      peeked.push_back(static_cast<uint16_t>(sector * eventSlotsPerSector + slot));
+    }
+  }
+  return events;
+}
+
+void Flash::removeEvents(const std::vector<bool> &delivered) const noexcept {
+  IOP_TRACE();
+  const auto length = std::min(delivered.size(), peeked.size());
+  for (size_t index = 0; index < length; ++index) {
+    const auto id = peeked.at(index);
+    if (!delivered.at(index) || id == droppedSlot)
+      continue;
+
+    // A single word written, no erase. So removals are persisted right away
+    const auto sector = static_cast<uint8_t>(id / eventSlotsPerSector);
+    const auto slot = static_cast<uint16_t>(id % eventSlotsPerSector);
+    driver::flashSectors.write(sector, slotOffset(slot), &removedSlot, sizeof(removedSlot));
+    queue.length--;
+  }
+  peeked.clear();
+}
+
+auto Flash::queuedEvents() const noexcept -> uint16_t {
+  IOP_TRACE();
+  return queue.length;
+}
 #endif
 
 #ifdef IOP_FLASH_DISABLED
@@ -208,4 +420,25 @@ void Flash::writeWifiConfig(const WifiCredentials &config) const noexcept {
   IOP_TRACE();
   (void)config;
 }
+void Flash::enqueueEvent(const EventStorage &event) const noexcept {
+  (void)*this;
+  IOP_TRACE();
+  (void)event;
+}
+auto Flash::peekEvents(const uint16_t max) const noexcept -> std::vector<Event> {
+  (void)*this;
+  IOP_TRACE();
+  (void)max;
+  return std::vector<Event>();
+}
+void Flash::removeEvents(const std::vector<bool> &delivered) const noexcept {
+  (void)*this;
+  IOP_TRACE();
+  (void)delivered;
+}
+auto Flash::queuedEvents() const noexcept -> uint16_t {
+  (void)*this;
+  IOP_TRACE();
+  return 0;
+}
 #endif
\ No newline at end of file
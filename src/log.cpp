@@ -19,90 +19,193 @@ static iop::LogHook hook(viewPrinter, staticPrinter, setuper, flusher);
 namespace network_logger {
   void setup() noexcept {
     iop::Log::setHook(hook);
-    iop::Log::setup(logLevel);
+    iop::Log::setup(config::logLevel);
   }
 }
 
+/// Messages at this level or above are sent to the server
+constexpr static iop::LogLevel networkLevel = iop::LogLevel::WARN;
+/// Messages that don't fit are dropped (and counted) until a batch is sent
+constexpr static size_t maxBatchSize = 2048;
+/// A batch is sent once it has this many bytes, or once its oldest message
+/// is this old, or right away if it has a CRIT message
+constexpr static size_t flushSize = 1024;
+constexpr static uint32_t flushAge = 60 * 1000;
+/// Batches refused before being sent (ex: offline) are tried again after this
+constexpr static uint32_t retryDelay = 10 * 1000;
+
+/// Budget of log bytes sent each window, batches wait for the next window
+/// when it's spent
 class ByteRate {
-  uint64_t nextReset{0};
-  size_t lastBytesPerMinute{0};
+  constexpr static size_t minutes = 5;
+  constexpr static uint32_t window = minutes * 1000 * 60;
+  constexpr static size_t budget = 16 * 1024;
+
+  iop::esp_time nextReset{0};
   size_t bytes{0};
 
+  void resetIfNeeded() noexcept {
+    const auto now = driver::thisThread.now();
+    if (now < this->nextReset)
+      return;
+    this->nextReset = now + window;
+    this->bytes = 0;
+  }
+
 public:
   ByteRate() noexcept = default;
 
-  void resetIfNeeded() noexcept {
-    constexpr const size_t minutes = 5;
-    constexpr const uint32_t fiveMin = minutes * 1000 * 60;
-    this->nextReset = driver::thisThread.now() + fiveMin;
-    this->lastBytesPerMinute = this->bytes / minutes;
-    this->bytes = 0;
+  auto allows(const size_t bytes) noexcept -> bool {
+    this->resetIfNeeded();
+    return this->bytes + bytes <= budget;
   }
 
   void addBytes(size_t bytes) noexcept {
     this->resetIfNeeded();
     this->bytes += bytes;
   }
-
-  auto bytesPerMinute() const noexcept -> size_t {
-    return this->lastBytesPerMinute;
-  }
 };
 
 static ByteRate byteRate;
+/// Whole messages only, the one being written starts at `messageStart`
 static std::string currentLog;
-
-// TODO(pc): allow gradually sending bytes wifiClient->write(...) instead of
-// buffering the log before sending We can use the already in place system of
-// variadic templates to avoid this buffer
-// TODO(pc): use ByteRate to allow grouping messages before sending, or reuse
-// the TCP connection to many
+static size_t messageStart = 0;
+static size_t messages = 0;
+static iop::esp_time oldestMessage = 0;
+static bool urgent = false;
+/// The rest of the message being written doesn't fit, it's dropped
+static bool droppingMessage = false;
+/// Messages lost since the last batch was sent, reported at its start
+static uint32_t dropped = 0;
+/// Messages of the batch in flight, they are lost if it fails
+static size_t inFlight = 0;
 
 static bool logNetwork = true;
-void reportLog() noexcept {
-  if (!logNetwork || !currentLog.length())
+static std::optional<iop::PendingRequest> pendingLog;
+static iop::esp_time nextAttempt = 0;
+
+static void append(const std::string_view str, const iop::LogLevel level, const iop::LogType kind) noexcept {
+  if (!logNetwork || level < networkLevel)
+    return;
+
+  // Loggers print each part of a message with its own (empty) END, only the
+  // line termination ends the message
+  const auto starts = kind == iop::LogType::START || kind == iop::LogType::STARTEND;
+  const auto ends = kind == iop::LogType::STARTEND || (kind == iop::LogType::END && !str.empty() && str.back() == '\n');
+  if (starts) {
+    messageStart = currentLog.length();
+    droppingMessage = false;
+  }
+
+  if (!droppingMessage && currentLog.length() + str.length() > maxBatchSize) {
+    currentLog.resize(messageStart);
+    droppingMessage = true;
+    dropped++;
+  }
+  if (droppingMessage)
+    return;
+
+  currentLog += str;
+  if (ends) {
+    if (messages++ == 0)
+      oldestMessage = driver::thisThread.now();
+    urgent = urgent || level >= iop::LogLevel::CRIT;
+    messageStart = currentLog.length();
+  }
+}
+
+static auto shouldSend() noexcept -> bool {
+  if (messageStart == 0 || pendingLog.has_value() || driver::thisThread.now() < nextAttempt)
+    return false;
+  return urgent || messageStart >= flushSize || driver::thisThread.now() - oldestMessage >= flushAge;
+}
+
+/// Sends the complete messages buffered, if it's time and the budget allows
+static void reportLog() noexcept {
+  // Only one request is in flight, this one would be refused
+  if (!shouldSend() || iop::Network::isBusy())
     return;
 
   const auto maybeToken = unused4KbSysStack.loop().flash().readAuthToken();
-  if (maybeToken.has_value()) {
-    logNetwork = false;
-    unused4KbSysStack.loop().api().registerLog(iop::unwrap_ref(maybeToken, IOP_CTX()), currentLog);
-    logNetwork = true;
+  if (!maybeToken.has_value())
+    return;
+
+  std::string batch;
+  if (dropped > 0)
+    batch = std::to_string(dropped) + " log messages dropped\n";
+  batch += std::string_view(currentLog).substr(0, messageStart);
+  if (!byteRate.allows(batch.length()))
+    return;
+
+  logNetwork = false;
+  // The request copies the log
+  auto request = unused4KbSysStack.loop().api().registerLog(iop::unwrap_ref(maybeToken, IOP_CTX()), batch);
+  logNetwork = true;
+
+  // Refused before being sent, the batch is kept for later. Unless it's a
+  // mocked request, that finishes OK right away
+  if (request.phase() == iop::RequestPhase::DONE && request.poll() != iop::NetworkStatus::OK) {
+    nextAttempt = driver::thisThread.now() + retryDelay;
+    return;
+  }
+  pendingLog = std::move(request);
+  byteRate.addBytes(batch.length());
+
+  // A message may be halfway written
+  currentLog.erase(0, messageStart);
+  messageStart = 0;
+  inFlight = messages;
+  messages = 0;
+  urgent = false;
+  dropped = 0;
+}
+
+namespace network_logger {
+  void poll() noexcept {
+    if (pendingLog.has_value()) {
+      logNetwork = false;
+      const auto status = iop::unwrap_mut(pendingLog, IOP_CTX()).poll();
+      logNetwork = true;
+      if (!status.has_value())
+        return;
+
+      if (*status != iop::NetworkStatus::OK)
+        dropped += static_cast<uint32_t>(inFlight);
+      inFlight = 0;
+      pendingLog.reset();
+    }
+    reportLog();
   }
-  currentLog.clear();
 }
 
 static void staticPrinter(const iop::StaticString str,
                           const iop::LogLevel level,
                           const iop::LogType kind) noexcept {
   iop::LogHook::defaultStaticPrinter(str, level, kind);
-
-  const auto charArray = str.asCharPtr();
-  if (logNetwork && level >= iop::LogLevel::CRIT) {
-    currentLog += charArray;
-    byteRate.addBytes(strlen_P(charArray));
-    if (kind == iop::LogType::END || kind == iop::LogType::STARTEND)
-      reportLog();
-  }
+  // Copied out of PROGMEM only when it's going to be sent
+  if (logNetwork && level >= networkLevel)
+    append(str.toStdString(), level, kind);
 }
 static void viewPrinter(const std::string_view str, const iop::LogLevel level, const iop::LogType kind) noexcept {
   iop::LogHook::defaultViewPrinter(str, level, kind);
-
-  if (logNetwork && level >= iop::LogLevel::CRIT) {
-    currentLog += str;
-    byteRate.addBytes(str.length());
-    if (kind == iop::LogType::END || kind == iop::LogType::STARTEND)
-      reportLog();
-  }
+  append(str, level, kind);
 }
 static void flusher() noexcept { iop::LogHook::defaultFlusher(); }
 static void setuper(iop::LogLevel level) noexcept {
   iop::LogHook::defaultSetuper(level);
 }
 #else
+#ifdef IOP_BINARY_LOG
+#include "core/log_binary.hpp"
+#endif
+
 namespace network_logger {
   void setup() noexcept {
+#ifdef IOP_BINARY_LOG
+    iop::Log::setHook(iop::BinaryLog::hook());
+#endif
     iop::Log::setup(config::logLevel);
   }
+  void poll() noexcept {}
 }
 #endif
@@ -1,5 +1,7 @@
 #include "loop.hpp" 
 
+#include <algorithm>
+
 void EventLoop::setup() noexcept {
     IOP_TRACE();
 
@@ -8,9 +10,15 @@ void EventLoop::setup() noexcept {
 
     Flash::setup();
     reset::setup();
+    config::sensors(this->sensors);
     this->sensors.setup();
     this->api().setup();
     this->credentialsServer.setup();
+
+    // Same hash as the access point's SSID
+    this->stagger = Stagger(iop::hashString(iop::to_view(driver::device.macAddress())));
+    this->nextMeasurement = this->stagger.next(driver::thisThread.now(), this->policy.interval());
+    this->logger.debug(F("Upload phase: "), std::to_string(this->stagger.phase(this->policy.interval())), F("ms"));
     this->logger.info(F("Setup finished"));
 }
 
@@ -40,9 +48,57 @@ void EventLoop::loop() noexcept {
     if (isConnected && hasAuthToken)
         this->credentialsServer.close();
 
+    // A site that lost the connection regains it at once, so the queues
+    // aren't drained together
+    if (isConnected && !this->wasConnected)
+        this->nextEventQueueDrain = std::max(this->nextEventQueueDrain, this->stagger.afterReconnect(now));
+    this->wasConnected = isConnected;
+
+    // Each sensor is measured on its own interval, a bit each iteration, so
+    // nothing else is blocked while they settle
+    this->sensors.poll();
+
+    // Before the network logger can take the connection again
+    if (this->deferred.has_value() && hasAuthToken && !iop::Network::isBusy()) {
+      const auto summary = std::move(iop::unwrap_mut(this->deferred, IOP_CTX()));
+      this->deferred.reset();
+      this->handleMeasurements(iop::unwrap_ref(authToken, IOP_CTX()), summary);
+    }
+
+    // Requests are advanced a bit each iteration, so nothing waits for them
+    network_logger::poll();
+    // As does the serial output
+    iop::Log::poll();
+    if (this->upload.has_value())
+      this->handleUpload();
+    if (this->drain.has_value())
+      this->handleDrain();
+
     if (!hasAuthToken) {
         this->handleCredentials();
 
+    } else if (this->nextMeasurement <= now) {
+        // Measurements happen even when offline, they are queued in flash
+        if (isConnected)
+          this->nextHandleConnectionLost = 0;
+
+        // The policy also decides the length of the next window
+        const auto summary = this->sensors.take();
+        const auto mustUpload = this->policy.evaluate(summary, now);
+        // Windows end at the device's phase, so the fleet doesn't upload together
+        this->nextMeasurement = this->stagger.next(now, this->policy.interval());
+
+        if (summary.empty()) {
+          // No-op, no sensor was sampled
+
+        } else if (mustUpload) {
+          this->handleMeasurements(iop::unwrap_ref(authToken, IOP_CTX()), summary);
+
+        } else {
+          this->logger.debug(F("Readings inside deadbands, upload skipped"));
+        }
+        //this->logger.info(std::to_string(ESP.getVcc())); // TODO: remove this
+
     } else if (!isConnected) {
         // If connection is lost frequently we open the credentials server, to
         // allow replacing the wifi credentials. Since we only remove it
@@ -62,12 +118,11 @@ void EventLoop::loop() noexcept {
         // No-op, we must just wait
         }
 
-    } else if (this->nextMeasurement <= now) {
+    } else if (this->nextEventQueueDrain <= now && this->flash().queuedEvents() > 0 && !this->drain.has_value() && !iop::Network::isBusy()) {
+        // Sends one batch of queued events at a time, polled by the loop
         this->nextHandleConnectionLost = 0;
-        this->nextMeasurement = now + config::interval;
-        this->handleMeasurements(iop::unwrap_ref(authToken, IOP_CTX()));
-        //this->logger.info(std::to_string(ESP.getVcc())); // TODO: remove this
-        
+        this->handleEventQueue(iop::unwrap_ref(authToken, IOP_CTX()));
+
     } else if (this->nextYieldLog <= now) {
         this->nextHandleConnectionLost = 0;
         constexpr const uint16_t tenSeconds = 10000;
@@ -116,6 +171,7 @@ void EventLoop::handleInterrupt(const InterruptEvent event,
         // Already logged at the network level
         case iop::NetworkStatus::CONNECTION_ISSUES:
         case iop::NetworkStatus::BROKEN_SERVER:
+        case iop::NetworkStatus::THROTTLED:
           // Nothing to be done besides retrying later
 
         case iop::NetworkStatus::OK: // Cool beans
@@ -165,14 +221,48 @@ void EventLoop::handleCredentials() noexcept {
       this->flash().writeAuthToken(iop::unwrap_ref(maybeToken, IOP_CTX()));
 }
 
-void EventLoop::handleMeasurements(const AuthToken &token) noexcept {
+void EventLoop::handleMeasurements(const AuthToken &token, const Summary &summary) noexcept {
     IOP_TRACE();
 
     this->logger.debug(F("Handle Measurements"));
 
-    const auto measurements = sensors.measure();
-    const auto status = this->api().registerEvent(token, measurements);
+    // A newer window can't wait, the one deferred is queued before it
+    if (this->deferred.has_value()) {
+      this->flash().enqueueEvent(iop::unwrap_ref(this->deferred, IOP_CTX()).toEvent().storage);
+      this->deferred.reset();
+    }
+
+    // Queued events must be delivered first, to keep the order. Flash slots
+    // are small, so only the means are queued. Same if the previous window
+    // is still being uploaded
+    if (!iop::Network::isConnected() || this->flash().queuedEvents() > 0 || this->upload.has_value()) {
+      this->flash().enqueueEvent(summary.toEvent().storage);
+      return;
+    }
+
+    // Another request is in flight (ex: network logs), it would be refused.
+    // Sent once it's done, instead of losing the statistics to the queue
+    if (iop::Network::isBusy()) {
+      this->logger.debug(F("Network is busy, summary upload deferred"));
+      this->deferred = summary;
+      return;
+    }
+
+    this->uploading = summary.toEvent().storage;
+    this->upload = this->api().registerSummary(token, summary);
+    // It may be finished already (ex: the payload didn't fit)
+    this->handleUpload();
+}
+
+void EventLoop::handleUpload() noexcept {
+    IOP_TRACE();
+
+    const auto maybeStatus = iop::unwrap_mut(this->upload, IOP_CTX()).poll();
+    if (!maybeStatus.has_value())
+      return;
+    this->upload.reset();
 
+    const auto status = iop::unwrap_ref(maybeStatus, IOP_CTX());
     switch (status) {
     case iop::NetworkStatus::FORBIDDEN:
       this->logger.error(F("Unable to send measurements"));
@@ -181,18 +271,115 @@ void EventLoop::handleMeasurements(const AuthToken &token) noexcept {
       return;
 
     case iop::NetworkStatus::CLIENT_BUFFER_OVERFLOW:
-      this->logger.error(F("Unable to send measurements"));
-      iop_panic(F("Api::registerEvent internal buffer overflow"));
+      // Many sensors may not fit the summary document. Its means still fit a
+      // queued event, which is sent later in a document of its own
+      this->logger.error(F("Summary doesn't fit a payload, queueing its means"));
+      this->flash().enqueueEvent(this->uploading);
+      return;
+
+    case iop::NetworkStatus::THROTTLED:
+      // Queued, the queue is drained once the server takes requests again
+      this->nextEventQueueDrain = driver::thisThread.now() + iop::Network::retryAfter();
+      this->flash().enqueueEvent(this->uploading);
+      return;
 
     // Already logged at the Network level
     case iop::NetworkStatus::BROKEN_SERVER:
     case iop::NetworkStatus::CONNECTION_ISSUES:
-      // Nothing to be done besides retrying later
+      // Stored to be sent when the server is reachable again
+      this->flash().enqueueEvent(this->uploading);
+      return;
 
     case iop::NetworkStatus::OK: // Cool beans
       return;
     }
 
-    this->logger.error(F("Unexpected status, EventLoop::handleMeasurements: "),
+    this->logger.error(F("Unexpected status, EventLoop::handleUpload: "),
+                       iop::Network::apiStatusToString(status));
+}
+
+void EventLoop::handleEventQueue(const AuthToken &token) noexcept {
+    IOP_TRACE();
+
+    const auto events = this->flash().peekEvents(this->api().eventBatchSize());
+    if (events.empty())
+      return;
+
+    this->logger.debug(F("Sending queued events: "), std::to_string(events.size()),
+                       F(" of "), std::to_string(this->flash().queuedEvents()));
+
+    this->draining = static_cast<uint16_t>(events.size());
+    this->drain = this->api().registerEvents(token, events);
+    // It may be finished already (ex: the payload didn't fit)
+    this->handleDrain();
+}
+
+void EventLoop::handleDrain() noexcept {
+    IOP_TRACE();
+
+    const auto maybeStatus = iop::unwrap_mut(this->drain, IOP_CTX()).poll();
+    if (!maybeStatus.has_value())
+      return;
+    this->drain.reset();
+
+    // Events that fail stay in the queue, we retry them later
+    constexpr const uint32_t oneMinute = 60 * 1000;
+
+    auto status = iop::unwrap_ref(maybeStatus, IOP_CTX());
+    if (status == iop::NetworkStatus::OK) {
+      const auto result = this->api().eventStatuses(this->draining);
+      if (iop::is_ok(result)) {
+        const auto &statuses = iop::unwrap_ok_ref(result, IOP_CTX());
+
+        // Rejected events are dropped too, otherwise they would be refused
+        // forever and block the events queued after them
+        std::vector<bool> done;
+        done.reserve(statuses.size());
+        size_t rejected = 0, retry = 0;
+        for (const auto &event: statuses) {
+          rejected += event == EventStatus::REJECTED;
+          retry += event == EventStatus::RETRY;
+          done.push_back(event != EventStatus::RETRY);
+        }
+
+        if (rejected > 0)
+          this->logger.error(F("Server rejected queued events, dropping them: "), std::to_string(rejected));
+        if (retry > 0) {
+          this->logger.warn(F("Server refused some queued events: "), std::to_string(retry));
+          this->nextEventQueueDrain = driver::thisThread.now() + oneMinute;
+        }
+
+        this->flash().removeEvents(done);
+        return;
+      }
+
+      // The answer didn't make sense, the whole batch is retried
+      status = iop::unwrap_err_ref(result, IOP_CTX());
+    }
+
+    switch (status) {
+    case iop::NetworkStatus::FORBIDDEN:
+      this->logger.error(F("Unable to send queued events"));
+      this->logger.warn(F("Auth token was refused, deleting it"));
+      this->flash().removeAuthToken();
+      return;
+
+    case iop::NetworkStatus::CLIENT_BUFFER_OVERFLOW:
+      this->logger.error(F("Unable to send queued events"));
+      iop_panic(F("Api::registerEvents internal buffer overflow"));
+
+    case iop::NetworkStatus::THROTTLED:
+      this->nextEventQueueDrain = driver::thisThread.now() + std::max<iop::esp_time>(oneMinute, iop::Network::retryAfter());
+      return;
+
+    // Already logged at the Network level
+    case iop::NetworkStatus::BROKEN_SERVER:
+    case iop::NetworkStatus::CONNECTION_ISSUES:
+    case iop::NetworkStatus::OK: // Unreachable, OK has per event statuses
+      this->nextEventQueueDrain = driver::thisThread.now() + oneMinute;
+      return;
+    }
+
+    this->logger.error(F("Unexpected status, EventLoop::handleDrain: "),
                        iop::Network::apiStatusToString(status));
 }
\ No newline at end of file
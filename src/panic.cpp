@@ -26,6 +26,7 @@ void upgrade() noexcept {
   // Already logged at the network level
   case iop::NetworkStatus::CONNECTION_ISSUES:
   case iop::NetworkStatus::BROKEN_SERVER:
+  case iop::NetworkStatus::THROTTLED:
     // Nothing to be done besides retrying later
 
   case iop::NetworkStatus::OK: // Cool beans, triggered if no updates are
@@ -59,7 +60,10 @@ auto reportPanic(const std::string_view &msg, const iop::StaticString &file,
       func,
   };
 
-  const auto status = unused4KbSysStack.loop().api().reportPanic(token, panicData);
+  // Nobody will poll the loop's request anymore, and it holds the connection
+  iop::Network::cancelPending();
+  // There is no loop to return to, so we wait
+  const auto status = unused4KbSysStack.loop().api().reportPanic(token, panicData).wait();
 
   switch (status) {
   case iop::NetworkStatus::FORBIDDEN:
@@ -79,6 +83,7 @@ auto reportPanic(const std::string_view &msg, const iop::StaticString &file,
     return false;
 
   case iop::NetworkStatus::CONNECTION_ISSUES:
+  case iop::NetworkStatus::THROTTLED:
     // Nothing to be done besides retrying later
     return false;
 
@@ -0,0 +1,106 @@
+#include "policy.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+constexpr const uint16_t keyCount = measureVariants * maxSensorsPerMeasure;
+
+static auto keyOf(const ReadingSummary &reading) noexcept -> std::optional<uint16_t> {
+  const auto measure = static_cast<uint8_t>(reading.measure);
+  if (measure >= measureVariants || reading.sensor >= maxSensorsPerMeasure)
+    return std::nullopt;
+  return measure * maxSensorsPerMeasure + reading.sensor;
+}
+
+/// How many deadbands the value moved, infinity if it started or stopped failing
+static auto normalizedChange(const float from, const float to, const float deadband) noexcept -> float {
+  if (std::isnan(from) && std::isnan(to))
+    return 0;
+  if (std::isnan(from) || std::isnan(to))
+    return std::numeric_limits<float>::infinity();
+
+  const auto change = std::abs(to - from);
+  if (deadband <= 0)
+    return change > 0 ? std::numeric_limits<float>::infinity() : 0;
+  return change / deadband;
+}
+
+UploadPolicy::UploadPolicy(PolicyConfig config) noexcept
+    : config(config), interval_(config.minInterval), lastUpload(),
+      reported(keyCount, std::numeric_limits<float>::quiet_NaN()),
+      previous(keyCount, std::numeric_limits<float>::quiet_NaN()) {
+  IOP_TRACE();
+}
+
+auto UploadPolicy::evaluate(const Summary &summary, const iop::esp_time now) noexcept -> bool {
+  IOP_TRACE();
+
+  auto mustUpload = !this->lastUpload.has_value() ||
+                    now - iop::unwrap_ref(this->lastUpload, IOP_CTX()) >= this->config.heartbeat;
+  // Unknown until a sensor is seen in two windows
+  std::optional<float> fastestChange;
+
+  for (const auto &reading: summary.readings) {
+    const auto maybeKey = keyOf(reading);
+    if (!maybeKey.has_value())
+      continue;
+    const auto key = iop::unwrap_ref(maybeKey, IOP_CTX());
+    const auto deadband = this->config.deadbands.at(static_cast<uint8_t>(reading.measure));
+
+    // Never uploaded counts as NaN, so a new sensor is always uploaded
+    if (normalizedChange(this->reported[key], reading.mean, deadband) > 1)
+      mustUpload = true;
+
+    // A sensor without a previous window doesn't tell the rate of change
+    if (!std::isnan(this->previous[key]) || std::isnan(reading.mean)) {
+      const auto change = normalizedChange(this->previous[key], reading.mean, deadband);
+      fastestChange = std::max(fastestChange.value_or(0), change);
+    }
+    this->previous[key] = reading.mean;
+  }
+
+  if (!fastestChange.has_value()) {
+    // No-op, keeps the window
+
+  } else if (iop::unwrap_ref(fastestChange, IOP_CTX()) > 1) {
+    this->interval_ = std::max(this->interval_ / 2, this->config.minInterval);
+
+  } else if (iop::unwrap_ref(fastestChange, IOP_CTX()) < 0.5F) {
+    this->interval_ = std::min(this->interval_ * 2, this->config.maxInterval);
+  }
+
+  if (mustUpload) {
+    this->lastUpload = now;
+    for (const auto &reading: summary.readings) {
+      const auto maybeKey = keyOf(reading);
+      if (maybeKey.has_value())
+        this->reported[iop::unwrap_ref(maybeKey, IOP_CTX())] = reading.mean;
+    }
+  }
+  return mustUpload;
+}
+
+Stagger::Stagger(const uint64_t deviceHash) noexcept
+    : deviceHash(deviceHash), random(static_cast<uint32_t>(deviceHash ^ (deviceHash >> 32))) {
+  IOP_TRACE();
+}
+
+auto Stagger::phase(const iop::esp_time interval) const noexcept -> iop::esp_time {
+  if (interval == 0)
+    return 0;
+  return static_cast<iop::esp_time>(this->deviceHash % interval);
+}
+
+auto Stagger::next(const iop::esp_time now, const iop::esp_time interval) const noexcept -> iop::esp_time {
+  if (interval == 0)
+    return now;
+  // Uptime, devices that booted together share it
+  const auto windowStart = now - now % interval;
+  const auto end = windowStart + this->phase(interval);
+  return end > now ? end : end + interval;
+}
+
+auto Stagger::afterReconnect(const iop::esp_time now) noexcept -> iop::esp_time {
+  return now + this->random.upTo(Stagger::reconnectSpread);
+}
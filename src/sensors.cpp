@@ -1,86 +1,380 @@
 #include "sensors.hpp"
 #include "utils.hpp"
 
-#ifdef IOP_SENSORS
-void Sensors::setup() noexcept {
-  IOP_TRACE();
-  gpio::gpio.mode(this->soilResistivityPower, gpio::Mode::OUTPUT);
-  this->airTempAndHumiditySensor.begin();
-  this->soilTemperatureSensor.begin();
-}
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+static iop::Log logger(iop::LogLevel::WARN, F("SENSORS"));
+
+// The analog pin is shared by every soil resistivity probe
+static const SoilResistivitySensor *analogOwner = nullptr;
 
 /// Handles low level access to hardware connected devices
 namespace measurement {
-auto soilTemperatureCelsius(DallasTemperature &sensor) noexcept -> float;
-auto airTemperatureCelsius(DHT &dht) noexcept -> float;
-auto airHumidityPercentage(DHT &dht) noexcept -> float;
-auto airHeatIndexCelsius(DHT &dht) noexcept -> float;
-auto soilResistivityRaw(gpio::Pin power) noexcept -> uint16_t;
+void soilResistivityPower(gpio::Pin power, bool on) noexcept;
+auto soilResistivityRaw() noexcept -> uint16_t;
 } // namespace measurement
 
-auto Sensors::measure() noexcept -> Event {
+/// Sensor indexes are stored in a nibble, bigger ones would be truncated
+static auto isValidIndex(const uint8_t sensor) noexcept -> bool {
+  if (sensor < maxSensorsPerMeasure)
+    return true;
+  logger.error(F("Sensor index doesn't fit, it's ignored: "), sensor);
+  return false;
+}
+
+/// Probes that get a sensor index, the ones past the limit would be truncated
+static auto fittingProbes(const uint8_t firstSensor, const uint8_t probes) noexcept -> uint8_t {
+  const size_t fit = firstSensor < maxSensorsPerMeasure ? maxSensorsPerMeasure - firstSensor : 0;
+  if (probes > fit)
+    logger.error(F("Soil temperature probes past the last sensor index are ignored: "), probes - fit);
+  return static_cast<uint8_t>(std::min<size_t>(probes, fit));
+}
+
+void Sensors::add(std::shared_ptr<SensorDriver> driver,
+                  const iop::esp_time interval) noexcept {
   IOP_TRACE();
-  return Event(
-      (EventStorage){
-          .airTemperatureCelsius = measurement::airTemperatureCelsius(
-              this->airTempAndHumiditySensor),
-          .airHumidityPercentage = measurement::airHumidityPercentage(
-              this->airTempAndHumiditySensor),
-          .airHeatIndexCelsius =
-              measurement::airHeatIndexCelsius(this->airTempAndHumiditySensor),
-          .soilResistivityRaw =
-              measurement::soilResistivityRaw(this->soilResistivityPower),
-          .soilTemperatureCelsius =
-              measurement::soilTemperatureCelsius(this->soilTemperatureSensor),
-      });
+  // Every sensor has at least one reading
+  if (this->drivers.size() >= maxEventReadings) {
+    logger.error(F("Too many sensors, their readings don't fit an event"));
+    return;
+  }
+  this->drivers.push_back((Entry){
+      .driver = std::move(driver),
+      .interval = interval,
+      .next = 0,
+      .measuring = false,
+  });
 }
 
-namespace measurement {
-auto soilTemperatureCelsius(DallasTemperature &sensor) noexcept -> float {
+void Sensors::setup() noexcept {
+  IOP_TRACE();
+  uint8_t total = 0;
+  auto entry = this->drivers.begin();
+  while (entry != this->drivers.end()) {
+    entry->driver->setup();
+
+    const auto readings = entry->driver->readings();
+    if (readings == 0) {
+      logger.warn(F("Sensor has nothing to measure, it's ignored"));
+      entry = this->drivers.erase(entry);
+      continue;
+    }
+    // Readings past the limit would be silently dropped from every event
+    if (total + readings > maxEventReadings) {
+      logger.error(F("Sensor readings don't fit an event, it's ignored: "), readings);
+      entry = this->drivers.erase(entry);
+      continue;
+    }
+    total = static_cast<uint8_t>(total + readings);
+    ++entry;
+  }
+}
+
+void Sensors::poll() noexcept {
+  IOP_TRACE();
+  const auto now = driver::thisThread.now();
+  for (auto &entry: this->drivers) {
+    if (!entry.measuring) {
+      if (entry.next > now || !entry.driver->start(now))
+        continue;
+      entry.measuring = true;
+      entry.next = now + entry.interval;
+    }
+
+    const auto readings = entry.driver->poll(now);
+    if (!readings.has_value())
+      continue;
+    entry.measuring = false;
+
+    for (const auto &reading: iop::unwrap_ref(readings, IOP_CTX()))
+      this->aggregator.add(reading);
+  }
+}
+
+auto Sensors::take() noexcept -> Summary {
+  IOP_TRACE();
+  return this->aggregator.take();
+}
+
+SoilResistivitySensor::SoilResistivitySensor(
+    const gpio::Pin power, const SoilResistivityConfig config,
+    const uint8_t sensor) noexcept
+    : power(power), config(config), sensor(sensor), state(State::IDLE),
+      nextStep(0), taken(0), sum(0) {
+  IOP_TRACE();
+  // Averaging no samples makes no sense
+  this->config.samples = std::max<uint8_t>(this->config.samples, 1);
+}
+
+void SoilResistivitySensor::setup() noexcept {
+  IOP_TRACE();
+  gpio::gpio.mode(this->power, gpio::Mode::OUTPUT);
+}
+
+auto SoilResistivitySensor::readings() const noexcept -> uint8_t {
+  return isValidIndex(this->sensor) ? 1 : 0;
+}
+
+auto SoilResistivitySensor::start(const iop::esp_time now) noexcept -> bool {
+  IOP_TRACE();
+  if (analogOwner != nullptr && analogOwner != this)
+    return false;
+  analogOwner = this;
+
+  measurement::soilResistivityPower(this->power, true);
+  this->state = State::SETTLING;
+  this->nextStep = now + this->config.settle;
+  this->taken = 0;
+  this->sum = 0;
+  return true;
+}
+
+auto SoilResistivitySensor::poll(const iop::esp_time now) noexcept
+    -> std::optional<std::vector<Reading>> {
+  IOP_TRACE();
+  if (this->state == State::IDLE || this->nextStep > now)
+    return std::optional<std::vector<Reading>>();
+
+  // Only one reading per poll, so other work can happen between them
+  this->state = State::SAMPLING;
+  this->sum += measurement::soilResistivityRaw();
+  this->taken++;
+
+  if (this->taken < this->config.samples) {
+    this->nextStep = now + this->config.sampleInterval;
+    return std::optional<std::vector<Reading>>();
+  }
+
+  measurement::soilResistivityPower(this->power, false);
+  this->state = State::IDLE;
+  analogOwner = nullptr;
+
+  const auto value = static_cast<uint16_t>(this->sum / this->taken);
+  return std::vector<Reading>({
+      (Reading){Measure::SOIL_RESISTIVITY_RAW, this->sensor, static_cast<float>(value)},
+  });
+}
+
+#ifdef IOP_SENSORS
+DhtSensor::DhtSensor(const gpio::Pin pin, const uint8_t version,
+                     const uint8_t sensor) noexcept
+    : dht(static_cast<uint8_t>(pin), version), sensor(sensor) {
+  IOP_TRACE();
+}
+
+void DhtSensor::setup() noexcept {
+  IOP_TRACE();
+  this->dht.begin();
+}
+
+auto DhtSensor::start(const iop::esp_time now) noexcept -> bool {
   IOP_TRACE();
-  // Blocks until reading is done
-  sensor.requestTemperatures();
-  // Accessing by index is bad. It's slow, we should store the sensor's address
-  // and use it
-  return sensor.getTempCByIndex(0);
+  (void)now;
+  return true;
 }
 
-auto airTemperatureCelsius(DHT &dht) noexcept -> float {
+auto DhtSensor::poll(const iop::esp_time now) noexcept
+    -> std::optional<std::vector<Reading>> {
   IOP_TRACE();
-  return dht.readTemperature();
+  (void)now;
+  return std::vector<Reading>({
+      (Reading){Measure::AIR_TEMPERATURE_CELSIUS, this->sensor, this->dht.readTemperature()},
+      (Reading){Measure::AIR_HUMIDITY_PERCENTAGE, this->sensor, this->dht.readHumidity()},
+      (Reading){Measure::AIR_HEAT_INDEX_CELSIUS, this->sensor, this->dht.computeHeatIndex()},
+  });
+}
+
+auto DhtSensor::readings() const noexcept -> uint8_t {
+  return isValidIndex(this->sensor) ? 3 : 0;
 }
 
-auto airHumidityPercentage(DHT &dht) noexcept -> float {
+// DS18B20 ROM addresses start with their family code, so they are never zeroed
+constexpr static std::array<uint8_t, 8> noProbe = {0};
+
+SoilTemperatureSensor::SoilTemperatureSensor(const gpio::Pin pin,
+                                             const uint8_t resolution,
+                                             const uint8_t firstSensor,
+                                             const uint8_t probes) noexcept
+    : bus(static_cast<uint8_t>(pin)), dallas(&this->bus),
+      resolution(std::clamp<uint8_t>(resolution, 9, 12)),
+      firstSensor(firstSensor),
+      addresses(fittingProbes(firstSensor, probes), noProbe), searching(true),
+      converting(false), readyAt(0) {
   IOP_TRACE();
-  return dht.readHumidity();
 }
 
-auto airHeatIndexCelsius(DHT &dht) noexcept -> float {
+void SoilTemperatureSensor::setup() noexcept {
   IOP_TRACE();
-  return dht.computeHeatIndex();
+  // We wait for the conversion ourselves, in the event loop
+  this->dallas.setWaitForConversion(false);
+  this->search();
 }
 
-auto soilResistivityRaw(const gpio::Pin power) noexcept -> uint16_t {
+void SoilTemperatureSensor::search() noexcept {
   IOP_TRACE();
-  digitalWrite(static_cast<uint8_t>(power), static_cast<uint8_t>(gpio::Data::HIGH));
-  delay(2000); // NOLINT *-avoid-magic-numbers
-  uint16_t value1 = analogRead(A0);
-  delay(500); // NOLINT *-avoid-magic-numbers
-  uint16_t value2 = analogRead(A0);
-  delay(500); // NOLINT *-avoid-magic-numbers
-  uint16_t value = (value1 + value2 + analogRead(A0)) / 3;
-  digitalWrite(static_cast<uint8_t>(power), static_cast<uint8_t>(gpio::Data::LOW));
-  return value;
+  this->dallas.begin();
+
+  const auto count = this->dallas.getDeviceCount();
+  for (uint8_t index = 0; index < count; ++index) {
+    std::array<uint8_t, 8> address = {0};
+    if (!this->dallas.getAddress(address.data(), index)) {
+      logger.warn(F("Unable to get address of soil temperature probe "), std::to_string(index));
+      continue;
+    }
+
+    // Known probes keep their sensor index, new ones take the first free
+    auto slot = std::find(this->addresses.begin(), this->addresses.end(), address);
+    if (slot == this->addresses.end())
+      slot = std::find(this->addresses.begin(), this->addresses.end(), noProbe);
+    if (slot == this->addresses.end()) {
+      logger.warn(F("Soil temperature probe has no sensor index left, it's ignored: "), std::to_string(index));
+      continue;
+    }
+    *slot = address;
+    // A probe that lost power also lost its resolution
+    this->dallas.setResolution(address.data(), this->resolution);
+  }
+  logger.info(F("Soil temperature probes found: "), std::to_string(count));
+
+  const auto known = std::find_if(this->addresses.begin(), this->addresses.end(),
+                                  [](const std::array<uint8_t, 8> &address) { return address != noProbe; });
+  this->searching = known == this->addresses.end();
+}
+
+auto SoilTemperatureSensor::readings() const noexcept -> uint8_t {
+  return static_cast<uint8_t>(this->addresses.size());
+}
+
+auto SoilTemperatureSensor::start(const iop::esp_time now) noexcept -> bool {
+  IOP_TRACE();
+  if (this->searching)
+    this->search();
+
+  // Broadcast, every probe in the bus converts at the same time
+  this->dallas.requestTemperatures();
+  this->converting = true;
+  this->readyAt = now + this->dallas.millisToWaitForConversion(this->resolution);
+  return true;
+}
+
+auto SoilTemperatureSensor::poll(const iop::esp_time now) noexcept
+    -> std::optional<std::vector<Reading>> {
+  IOP_TRACE();
+  if (!this->converting || this->readyAt > now)
+    return std::optional<std::vector<Reading>>();
+  this->converting = false;
+
+  std::vector<Reading> readings;
+  readings.reserve(this->addresses.size());
+  for (uint8_t index = 0; index < this->addresses.size(); ++index) {
+    auto celsius = std::numeric_limits<float>::quiet_NaN();
+    if (this->addresses[index] != noProbe)
+      celsius = this->dallas.getTempC(this->addresses[index].data());
+    if (celsius == DEVICE_DISCONNECTED_C) {
+      logger.warn(F("Soil temperature probe disconnected: "), std::to_string(index));
+      celsius = std::numeric_limits<float>::quiet_NaN();
+      this->searching = true;
+    }
+    const auto sensor = static_cast<uint8_t>(this->firstSensor + index);
+    readings.push_back((Reading){Measure::SOIL_TEMPERATURE_CELSIUS, sensor, celsius});
+  }
+  return readings;
+}
+
+namespace measurement {
+void soilResistivityPower(const gpio::Pin power, const bool on) noexcept {
+  IOP_TRACE();
+  const auto data = on ? gpio::Data::HIGH : gpio::Data::LOW;
+  digitalWrite(static_cast<uint8_t>(power), static_cast<uint8_t>(data));
+}
+
+auto soilResistivityRaw() noexcept -> uint16_t {
+  IOP_TRACE();
+  return analogRead(A0);
 }
 } // namespace measurement
 #else
-void Sensors::setup() noexcept {
+DhtSensor::DhtSensor(const gpio::Pin pin, const uint8_t version,
+                     const uint8_t sensor) noexcept
+    : sensor(sensor) {
+  IOP_TRACE();
+  (void)pin;
+  (void)version;
+}
+void DhtSensor::setup() noexcept {
+  IOP_TRACE();
+  (void)*this;
+}
+auto DhtSensor::start(const iop::esp_time now) noexcept -> bool {
   IOP_TRACE();
   (void)*this;
+  (void)now;
+  return true;
+}
+auto DhtSensor::poll(const iop::esp_time now) noexcept
+    -> std::optional<std::vector<Reading>> {
+  IOP_TRACE();
+  (void)now;
+  return std::vector<Reading>({
+      (Reading){Measure::AIR_TEMPERATURE_CELSIUS, this->sensor, 0},
+      (Reading){Measure::AIR_HUMIDITY_PERCENTAGE, this->sensor, 0},
+      (Reading){Measure::AIR_HEAT_INDEX_CELSIUS, this->sensor, 0},
+  });
+}
+auto DhtSensor::readings() const noexcept -> uint8_t {
+  return isValidIndex(this->sensor) ? 3 : 0;
+}
+
+SoilTemperatureSensor::SoilTemperatureSensor(const gpio::Pin pin,
+                                             const uint8_t resolution,
+                                             const uint8_t firstSensor,
+                                             const uint8_t probes) noexcept
+    : resolution(resolution), firstSensor(firstSensor),
+      addresses(fittingProbes(firstSensor, probes)), searching(false),
+      converting(false), readyAt(0) {
+  IOP_TRACE();
+  (void)pin;
 }
-auto Sensors::measure() noexcept -> Event {
+void SoilTemperatureSensor::setup() noexcept {
   IOP_TRACE();
   (void)*this;
-  return Event((EventStorage){0});
 }
-#endif
\ No newline at end of file
+auto SoilTemperatureSensor::start(const iop::esp_time now) noexcept -> bool {
+  IOP_TRACE();
+  this->converting = true;
+  this->readyAt = now;
+  return true;
+}
+auto SoilTemperatureSensor::poll(const iop::esp_time now) noexcept
+    -> std::optional<std::vector<Reading>> {
+  IOP_TRACE();
+  if (!this->converting || this->readyAt > now)
+    return std::optional<std::vector<Reading>>();
+  this->converting = false;
+
+  std::vector<Reading> readings;
+  readings.reserve(this->addresses.size());
+  for (uint8_t index = 0; index < this->addresses.size(); ++index) {
+    const auto sensor = static_cast<uint8_t>(this->firstSensor + index);
+    readings.push_back((Reading){Measure::SOIL_TEMPERATURE_CELSIUS, sensor, 0});
+  }
+  return readings;
+}
+auto SoilTemperatureSensor::readings() const noexcept -> uint8_t {
+  return static_cast<uint8_t>(this->addresses.size());
+}
+
+namespace measurement {
+void soilResistivityPower(const gpio::Pin power, const bool on) noexcept {
+  IOP_TRACE();
+  (void)power;
+  (void)on;
+}
+auto soilResistivityRaw() noexcept -> uint16_t {
+  IOP_TRACE();
+  return 0;
+}
+} // namespace measurement
+#endif
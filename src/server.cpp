@@ -338,6 +338,7 @@ auto CredentialsServer::authenticate(std::string_view username,
     // Already logged at the Network level
     case iop::NetworkStatus::CONNECTION_ISSUES:
     case iop::NetworkStatus::BROKEN_SERVER:
+    case iop::NetworkStatus::THROTTLED:
       // Nothing to be done besides retrying later
       return std::optional<AuthToken>();
 
@@ -59,3 +59,44 @@ auto base64Encode(const uint8_t *in, const size_t size) noexcept -> std::string
   return out;
 }
 } // namespace utils
+
+static auto readingKey(const Measure measure, const uint8_t sensor) noexcept -> uint8_t {
+  return static_cast<uint8_t>((static_cast<uint8_t>(measure) << 4) | (sensor & 0x0F));
+}
+
+auto Event::at(const uint8_t index) const noexcept -> Reading {
+  const auto key = this->storage.keys.at(index);
+  return (Reading) {
+    .measure = static_cast<Measure>(key >> 4),
+    .sensor = static_cast<uint8_t>(key & 0x0F),
+    .value = this->storage.values.at(index),
+  };
+}
+
+auto Event::set(const Reading reading) noexcept -> bool {
+  IOP_TRACE();
+  const auto key = readingKey(reading.measure, reading.sensor);
+  for (uint8_t index = 0; index < this->storage.length; ++index) {
+    if (this->storage.keys.at(index) != key)
+      continue;
+    this->storage.values.at(index) = reading.value;
+    return true;
+  }
+
+  if (this->storage.length >= maxEventReadings)
+    return false;
+  this->storage.keys.at(this->storage.length) = key;
+  this->storage.values.at(this->storage.length) = reading.value;
+  this->storage.length++;
+  return true;
+}
+
+auto Event::find(const Measure measure, const uint8_t sensor) const noexcept
+    -> std::optional<float> {
+  const auto key = readingKey(measure, sensor);
+  for (uint8_t index = 0; index < this->storage.length; ++index) {
+    if (this->storage.keys.at(index) == key)
+      return this->storage.values.at(index);
+  }
+  return std::optional<float>();
+}
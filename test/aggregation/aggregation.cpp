@@ -0,0 +1,83 @@
+#include "aggregation.hpp"
+
+#include <unity.h>
+#include <cmath>
+#include <limits>
+
+void empty() {
+    RunningStats stats;
+    TEST_ASSERT_EQUAL(0, stats.count());
+    TEST_ASSERT(std::isnan(stats.mean()));
+    TEST_ASSERT(std::isnan(stats.min()));
+    TEST_ASSERT(std::isnan(stats.max()));
+    TEST_ASSERT_EQUAL_FLOAT(0, stats.stddev());
+}
+
+void statistics() {
+    RunningStats stats;
+    for (const auto sample: {2.0F, 4.0F, 4.0F, 4.0F, 5.0F, 5.0F, 7.0F, 9.0F})
+        stats.add(sample);
+
+    TEST_ASSERT_EQUAL(8, stats.count());
+    TEST_ASSERT_EQUAL_FLOAT(5, stats.mean());
+    TEST_ASSERT_EQUAL_FLOAT(2, stats.min());
+    TEST_ASSERT_EQUAL_FLOAT(9, stats.max());
+    // Sample standard deviation: sqrt(32 / 7)
+    TEST_ASSERT_FLOAT_WITHIN(0.0001F, 2.13809F, stats.stddev());
+}
+
+void failures() {
+    RunningStats stats;
+    stats.add(std::numeric_limits<float>::quiet_NaN());
+    stats.add(10);
+    stats.add(std::numeric_limits<float>::quiet_NaN());
+    TEST_ASSERT_EQUAL(1, stats.count());
+    TEST_ASSERT_EQUAL(2, stats.failures());
+    TEST_ASSERT_EQUAL_FLOAT(10, stats.mean());
+}
+
+// Naive sum of squares would lose every digit here
+void largeOffset() {
+    RunningStats stats;
+    for (uint32_t index = 0; index < 1000; ++index)
+        stats.add(1000000.0F + static_cast<float>(index % 2));
+    TEST_ASSERT_FLOAT_WITHIN(0.01F, 1000000.5F, stats.mean());
+    TEST_ASSERT_FLOAT_WITHIN(0.001F, 0.50025F, stats.stddev());
+}
+
+void windows() {
+    Aggregator aggregator;
+    aggregator.add(Reading{Measure::SOIL_TEMPERATURE_CELSIUS, 0, 20});
+    aggregator.add(Reading{Measure::SOIL_TEMPERATURE_CELSIUS, 1, 30});
+    aggregator.add(Reading{Measure::SOIL_TEMPERATURE_CELSIUS, 0, 22});
+
+    const auto first = aggregator.take();
+    TEST_ASSERT_EQUAL(2, first.readings.size());
+    TEST_ASSERT_EQUAL(0, first.readings[0].sensor);
+    TEST_ASSERT_EQUAL(2, first.readings[0].count);
+    TEST_ASSERT_EQUAL_FLOAT(21, first.readings[0].mean);
+    TEST_ASSERT_EQUAL(1, first.readings[1].sensor);
+    TEST_ASSERT_EQUAL_FLOAT(30, first.readings[1].mean);
+
+    const auto event = first.toEvent();
+    TEST_ASSERT_EQUAL(2, event.size());
+    TEST_ASSERT_EQUAL_FLOAT(21, *event.find(Measure::SOIL_TEMPERATURE_CELSIUS, 0));
+
+    // New window, sensors without samples are left out
+    aggregator.add(Reading{Measure::SOIL_TEMPERATURE_CELSIUS, 1, 31});
+    const auto second = aggregator.take();
+    TEST_ASSERT_EQUAL(1, second.readings.size());
+    TEST_ASSERT_EQUAL_FLOAT(31, second.readings[0].mean);
+    TEST_ASSERT(aggregator.take().empty());
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(empty);
+    RUN_TEST(statistics);
+    RUN_TEST(failures);
+    RUN_TEST(largeOffset);
+    RUN_TEST(windows);
+    UNITY_END();
+    return 0;
+}
@@ -0,0 +1,333 @@
+#include "api.hpp"
+#include "codec.hpp"
+#include "core/cert_store.hpp"
+#include "core/header_block.hpp"
+#include "core/http_parser.hpp"
+#include "core/log.hpp"
+#include "core/log_binary.hpp"
+#include "core/log_ring.hpp"
+
+#include <unity.h>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Desktop microbenchmarks, they only report numbers. Not part of the unit
+// tests, run them with `pio test -e benchmark`
+
+using Clock = std::chrono::steady_clock;
+
+static void report(const std::string &text) {
+    iop::Log::print((text + "\n").c_str(), iop::LogLevel::INFO, iop::LogType::STARTEND);
+}
+
+static auto nanosPer(const Clock::duration elapsed, const double count) -> std::string {
+    const auto nanos = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    return std::to_string(nanos / count) + "ns";
+}
+
+static auto makeEvent(const float airTemperature, const float airHumidity,
+                      const float airHeatIndex, const float soilResistivity,
+                      const float soilTemperature) -> Event {
+    Event event;
+    event.set((Reading){Measure::AIR_TEMPERATURE_CELSIUS, 0, airTemperature});
+    event.set((Reading){Measure::AIR_HUMIDITY_PERCENTAGE, 0, airHumidity});
+    event.set((Reading){Measure::AIR_HEAT_INDEX_CELSIUS, 0, airHeatIndex});
+    event.set((Reading){Measure::SOIL_RESISTIVITY_RAW, 0, soilResistivity});
+    event.set((Reading){Measure::SOIL_TEMPERATURE_CELSIUS, 0, soilTemperature});
+    return event;
+}
+
+// Slow drift, like a real day of measurements
+static auto batch() -> std::vector<Event> {
+    std::vector<Event> events;
+    for (uint16_t index = 0; index < 32; ++index) {
+        events.push_back(makeEvent(
+            23.4F + static_cast<float>(index % 5) * 0.1F,
+            61.2F - static_cast<float>(index) * 0.1F,
+            24.1F + static_cast<float>(index % 3) * 0.1F,
+            static_cast<float>(712 + index % 4),
+            19.8F));
+    }
+    return events;
+}
+
+void eventEncoding() {
+    constexpr uint32_t iterations = 100000;
+    const auto event = makeEvent(23.4F, 61.2F, 24.1F, 712, 19.8F);
+    std::array<char, 256> buffer;
+    StaticJsonDocument<256> doc;
+
+    const auto timed = [&](const bool msgpack) {
+        const auto start = Clock::now();
+        for (uint32_t index = 0; index < iterations; ++index) {
+            doc.clear();
+            Api::fillEvent(doc.to<JsonObject>(), event);
+            if (msgpack) {
+                serializeMsgPack(doc, buffer.data(), buffer.max_size());
+            } else {
+                serializeJson(doc, buffer.data(), buffer.max_size());
+            }
+        }
+        return Clock::now() - start;
+    };
+    const auto json = timed(false);
+    const auto jsonBytes = measureJson(doc);
+    const auto msgpack = timed(true);
+    report("Event encoding: json " + std::to_string(jsonBytes) + " bytes, " + nanosPer(json, iterations)
+           + ". msgpack " + std::to_string(measureMsgPack(doc)) + " bytes, " + nanosPer(msgpack, iterations));
+}
+
+void eventCodec() {
+    constexpr uint32_t iterations = 10000;
+    const EventCodec codec;
+    const auto events = batch();
+
+    size_t capacity = JSON_ARRAY_SIZE(events.size());
+    for (const auto &event: events)
+        capacity += Api::eventJsonSize(event);
+    DynamicJsonDocument doc(capacity);
+    auto array = doc.to<JsonArray>();
+    for (const auto &event: events)
+        Api::fillEvent(array.createNestedObject(), event);
+    report("Batch of " + std::to_string(events.size()) + " events: json " + std::to_string(measureJson(doc))
+           + " bytes, msgpack " + std::to_string(measureMsgPack(doc)) + " bytes, delta "
+           + std::to_string(codec.encode(events).size()) + " bytes");
+
+    size_t decoded = 0;
+    const auto start = Clock::now();
+    for (uint32_t index = 0; index < iterations; ++index) {
+        const auto encoded = codec.encode(events);
+        decoded += EventCodec::decode(encoded.data(), encoded.size())->size();
+    }
+    report("Delta codec round-trip: " + nanosPer(Clock::now() - start, static_cast<double>(decoded)) + " per event");
+}
+
+void httpParser() {
+    constexpr uint32_t iterations = 200000;
+    std::string raw = "HTTP/1.1 200 OK\r\nServer: iop\r\nDate: Sat, 17 Oct 2026 10:00:00 GMT\r\n"
+                      "LATEST_VERSION: 0123456789abcdef0123456789abcdef\r\n"
+                      "ACCEPTED_CONTENT_TYPE: application/msgpack, application/vnd.iop.events\r\n"
+                      "Content-Length: 256\r\n\r\n";
+    raw.append(256, 'x');
+
+    size_t bodyLength = 0;
+    iop::HttpParser parser([&bodyLength](std::string_view piece) { bodyLength += piece.length(); return true; });
+    parser.collect("LATEST_VERSION");
+    parser.collect("ACCEPTED_CONTENT_TYPE");
+
+    const auto start = Clock::now();
+    for (uint32_t index = 0; index < iterations; ++index) {
+        parser.reset();
+        // Like a socket read of 64 bytes at a time
+        for (size_t offset = 0; offset < raw.length(); offset += 64)
+            parser.feed(std::string_view(raw).substr(offset, 64));
+    }
+    const auto seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    const auto megabytes = static_cast<double>(raw.length()) * iterations / 1000000.0;
+    report("HTTP parser: " + std::to_string(megabytes / seconds) + "MB/s");
+}
+
+static void line(std::string &head, const char *key, const std::string &value) {
+    head += key;
+    head += ": ";
+    head += value;
+    head += "\r\n";
+}
+
+void headerBlock() {
+    constexpr uint32_t iterations = 200000;
+    const std::string md5 = "0123456789abcdef0123456789abcdef";
+    const std::string mac = "AA:BB:CC:DD:EE:FF";
+    const auto telemetryAt = [](const uint32_t index) -> iop::Telemetry {
+        return {3000 + index % 512, 40000 - index % 4096, 20000 + index % 1024, 3300, index * 180};
+    };
+    std::string head;
+    head.reserve(512);
+
+    // Every header formatted per request, like it used to
+    auto start = Clock::now();
+    for (uint32_t index = 0; index < iterations; ++index) {
+        head.clear();
+        const auto telemetry = telemetryAt(index);
+        line(head, "VERSION", md5);
+        line(head, "MAC_ADDRESS", mac);
+        line(head, "FREE_STACK", std::to_string(telemetry.freeStack));
+        line(head, "FREE_HEAP", std::to_string(telemetry.freeHeap));
+        line(head, "BIGGEST_FREE_BLOCK", std::to_string(telemetry.biggestFreeBlock));
+        line(head, "VCC", std::to_string(telemetry.vcc));
+        line(head, "TIME_RUNNING", std::to_string(telemetry.timeRunning));
+    }
+    const auto formatted = Clock::now() - start;
+
+    iop::HeaderBlock block;
+    block.setup(md5, mac);
+    start = Clock::now();
+    for (uint32_t index = 0; index < iterations; ++index) {
+        head.clear();
+        head += block.update(telemetryAt(index));
+    }
+    report("Request headers: formatted " + nanosPer(formatted, iterations) + ", precomputed block "
+           + nanosPer(Clock::now() - start, iterations));
+}
+
+using Hash = std::array<uint8_t, iop::CertList::hashSize>;
+
+static auto randomHash(uint32_t &state) -> Hash {
+    Hash hash;
+    for (auto &byte: hash) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        byte = static_cast<uint8_t>(state);
+    }
+    return hash;
+}
+
+void certLookup() {
+    constexpr uint32_t lookups = 200000;
+    // A bundle the size of Mozilla's, like `build/preBuildCertificates.py` generates it
+    std::vector<Hash> hashes;
+    uint32_t state = 0xC0FFEE;
+    for (uint16_t index = 0; index < 150; ++index)
+        hashes.push_back(randomHash(state));
+    std::sort(hashes.begin(), hashes.end());
+
+    std::vector<const uint8_t *> indexes;
+    std::vector<uint16_t> sizes;
+    for (const auto &hash: hashes) {
+        indexes.push_back(hash.data());
+        sizes.push_back(900);
+    }
+    std::array<uint16_t, iop::CertList::bucketCount> buckets;
+    for (uint16_t byte = 0; byte < 256; ++byte) {
+        const auto first = std::find_if(hashes.begin(), hashes.end(), [byte](const Hash &hash) { return hash[0] >= byte; });
+        buckets[byte] = static_cast<uint16_t>(first - hashes.begin());
+    }
+    buckets[256] = static_cast<uint16_t>(hashes.size());
+    const iop::CertList list(indexes.data(), indexes.data(), sizes.data(), buckets.data(), static_cast<uint16_t>(hashes.size()));
+
+    // Half are in the bundle, like a handshake looks up every issuer in the chain
+    std::vector<Hash> queries;
+    for (uint32_t index = 0; index < 1024; ++index)
+        queries.push_back(index % 2 == 0 ? hashes[(index * 37) % hashes.size()] : randomHash(state));
+
+    // How `CertStore::findHashedTA` used to look certificates up
+    size_t found = 0;
+    auto start = Clock::now();
+    for (uint32_t index = 0; index < lookups; ++index) {
+        const auto *hash = queries[index % queries.size()].data();
+        for (uint16_t cert = 0; cert < list.count(); ++cert) {
+            if (memcmp(hash, list.cert(cert).index, iop::CertList::hashSize) == 0) {
+                found++;
+                break;
+            }
+        }
+    }
+    const auto linear = Clock::now() - start;
+
+    start = Clock::now();
+    for (uint32_t index = 0; index < lookups; ++index)
+        found += list.find(queries[index % queries.size()].data()).has_value();
+    report("Trust anchor lookup: linear scan " + nanosPer(linear, lookups) + ", sorted index "
+           + nanosPer(Clock::now() - start, lookups) + " (" + std::to_string(found) + " found)");
+}
+
+static auto discard(const std::string_view data) -> size_t { return data.length(); }
+
+// Five fragments each taking the lock, like the desktop printer did, against
+// a single record
+void logRing() {
+    constexpr uint32_t count = 200000;
+    static iop::LogRing ring;
+    std::string sink;
+    std::mutex lock;
+
+    auto start = Clock::now();
+    for (uint32_t index = 0; index < count; ++index) {
+        const iop::StaticString fragments[] = {F("["), F("INFO"), F("] "), F("loop: "), F("Measurement taken\n")};
+        for (const auto &fragment: fragments) {
+            std::lock_guard<std::mutex> guard(lock);
+            sink += fragment.asCharPtr();
+        }
+        if (sink.length() > 4096)
+            sink.clear();
+    }
+    const auto locked = Clock::now() - start;
+
+    start = Clock::now();
+    for (uint32_t index = 0; index < count; ++index) {
+        const iop::LogPart parts[] = {F("["), F("INFO"), F("] "), F("loop: "), F("Measurement taken\n")};
+        ring.push(parts, 5);
+        if (index % 16 == 0)
+            ring.drain(discard);
+    }
+    report("Log message: locked fragments " + nanosPer(locked, count) + ", ring " + nanosPer(Clock::now() - start, count));
+}
+
+// Formatting and copying the text, against encoding the frame
+void logBinary() {
+    constexpr uint32_t rounds = 20000;
+    static iop::LogRing ring;
+    std::array<uint8_t, iop::BinaryLog::maxFrameSize> frame;
+    const std::string path("/v1/event");
+    // Common lines of a measurement cycle
+    const std::vector<std::vector<iop::LogPart>> messages = {
+        {F("POST to "), F("https://iop-monitor-server.tk:4001"), path, F(", data length: "), 128U},
+        {F("Connections opened: "), 3U, F(", requests sent: "), 57U},
+        {F("Response code ("), 200, F("): "), F("OK")},
+        {F("Kept alive connection was closed by the server, reconnecting")},
+        {F("Measurement taken, next in "), 180000U, F("ms")},
+        {F("Server doesn't support Max Fragment Length Negotiation, using 16KB buffers")},
+    };
+    const iop::StaticString target(F("NETWORK"));
+    const auto header = static_cast<uint8_t>(iop::BinaryLog::version << 4 | static_cast<uint8_t>(iop::LogLevel::INFO));
+
+    size_t textBytes = 0;
+    auto start = Clock::now();
+    for (uint32_t round = 0; round < rounds; ++round) {
+        for (const auto &parts: messages) {
+            std::array<iop::LogPart, 16> record;
+            record[0] = F("[INFO] NETWORK: ");
+            std::copy(parts.begin(), parts.end(), record.begin() + 1);
+            record[parts.size() + 1] = "\n";
+            for (size_t index = 0; index < parts.size() + 2; ++index)
+                textBytes += record[index].textLength();
+            ring.push(record.data(), parts.size() + 2);
+        }
+        ring.drain(discard);
+    }
+    const auto text = Clock::now() - start;
+
+    size_t binaryBytes = 0;
+    start = Clock::now();
+    for (uint32_t round = 0; round < rounds; ++round) {
+        for (const auto &parts: messages) {
+            const auto size = iop::BinaryLog::encode(header, &target, parts.data(), parts.size(), frame.data());
+            binaryBytes += size;
+            ring.push(std::string_view(reinterpret_cast<const char *>(frame.data()), size));
+        }
+        ring.drain(discard);
+    }
+    const auto lines = static_cast<double>(rounds * messages.size());
+    report("Log line: text " + std::to_string(static_cast<double>(textBytes) / lines) + " bytes, " + nanosPer(text, lines)
+           + ". Binary " + std::to_string(static_cast<double>(binaryBytes) / lines) + " bytes, "
+           + nanosPer(Clock::now() - start, lines));
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(eventEncoding);
+    RUN_TEST(eventCodec);
+    RUN_TEST(httpParser);
+    RUN_TEST(headerBlock);
+    RUN_TEST(certLookup);
+    RUN_TEST(logRing);
+    RUN_TEST(logBinary);
+    UNITY_END();
+    return 0;
+}
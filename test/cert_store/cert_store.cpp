@@ -0,0 +1,259 @@
+#include "core/cert_store.hpp"
+#include "core/log.hpp"
+
+#include <unity.h>
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Desktop tests of the trust anchor lookup over a bundle the size of
+// Mozilla's, against the linear scan it replaced. And of the decoded anchors
+// cache, with its hit rate and heap churn
+
+constexpr static uint16_t bundleSize = 150;
+
+using Hash = std::array<uint8_t, iop::CertList::hashSize>;
+
+struct Bundle {
+    std::vector<Hash> hashes;
+    std::vector<const uint8_t *> indexes;
+    std::vector<const uint8_t *> certs;
+    std::vector<uint16_t> sizes;
+    std::array<uint16_t, iop::CertList::bucketCount> buckets;
+};
+
+static auto randomHash(uint32_t &state) -> Hash {
+    Hash hash;
+    for (auto &byte: hash) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        byte = static_cast<uint8_t>(state);
+    }
+    return hash;
+}
+
+// Like `build/preBuildCertificates.py` generates it
+static auto bundle() -> Bundle {
+    Bundle bundle;
+    uint32_t state = 0xC0FFEE;
+    for (uint16_t index = 0; index < bundleSize; ++index)
+        bundle.hashes.push_back(randomHash(state));
+    // Cross signed roots share the issuer
+    bundle.hashes.push_back(bundle.hashes[17]);
+    std::stable_sort(bundle.hashes.begin(), bundle.hashes.end());
+
+    for (const auto &hash: bundle.hashes) {
+        bundle.indexes.push_back(hash.data());
+        // The certificate is only handed to BearSSL, any address will do
+        bundle.certs.push_back(hash.data());
+        bundle.sizes.push_back(static_cast<uint16_t>(900 + bundle.sizes.size()));
+    }
+    for (uint16_t byte = 0; byte < 256; ++byte) {
+        const auto first = std::find_if(bundle.hashes.begin(), bundle.hashes.end(), [byte](const Hash &hash) { return hash[0] >= byte; });
+        bundle.buckets[byte] = static_cast<uint16_t>(first - bundle.hashes.begin());
+    }
+    bundle.buckets[256] = static_cast<uint16_t>(bundle.hashes.size());
+    return bundle;
+}
+
+static auto listOf(const Bundle &bundle) -> iop::CertList {
+    return iop::CertList(bundle.certs.data(), bundle.indexes.data(), bundle.sizes.data(),
+                         bundle.buckets.data(), static_cast<uint16_t>(bundle.hashes.size()));
+}
+
+// How `CertStore::findHashedTA` used to look certificates up
+static auto linear(const iop::CertList &list, const uint8_t *hash) -> std::optional<iop::Cert> {
+    for (uint16_t index = 0; index < list.count(); ++index) {
+        const auto cert = list.cert(index);
+        if (memcmp(hash, cert.index, iop::CertList::hashSize) == 0)
+            return cert;
+    }
+    return std::nullopt;
+}
+
+void sameAsLinear() {
+    const auto data = bundle();
+    const auto list = listOf(data);
+
+    for (const auto &hash: data.hashes) {
+        const auto found = list.find(hash.data());
+        TEST_ASSERT_TRUE(found.has_value());
+        // Equal hashes resolve to the first one, like the scan
+        TEST_ASSERT_TRUE(found->index == linear(list, hash.data())->index);
+    }
+
+    uint32_t state = 42;
+    for (uint32_t index = 0; index < 10000; ++index) {
+        auto hash = randomHash(state);
+        TEST_ASSERT_FALSE(list.find(hash.data()).has_value());
+        // Right next to existing hashes
+        hash = data.hashes[index % data.hashes.size()];
+        hash[31] ^= 1;
+        TEST_ASSERT_EQUAL(linear(list, hash.data()).has_value(), list.find(hash.data()).has_value());
+    }
+
+    Hash first = {0};
+    Hash last;
+    last.fill(0xFF);
+    TEST_ASSERT_FALSE(list.find(first.data()).has_value());
+    TEST_ASSERT_FALSE(list.find(last.data()).has_value());
+}
+
+// Like BearSSL does it: lookup, validate, free
+static auto handshake(br_x509_minimal_context &ctx, const Hash &hash) -> bool {
+    auto copy = hash;
+    const auto *anchor = ctx.trust_anchor_dynamic(ctx.trust_anchor_dynamic_ctx, copy.data(), copy.size());
+    if (anchor == nullptr)
+        return false;
+    TEST_ASSERT_EQUAL(iop::CertList::hashSize, anchor->dn.len);
+    TEST_ASSERT_EQUAL_MEMORY(hash.data(), anchor->dn.data, hash.size());
+    ctx.trust_anchor_dynamic_free(ctx.trust_anchor_dynamic_ctx, anchor);
+    return true;
+}
+
+void cacheHitRate() {
+    const auto data = bundle();
+    constexpr uint32_t handshakes = 1000;
+
+    // The monitor server always resolves to the same root
+    iop::CertStore uncached(listOf(data));
+    uncached.setCacheSize(0);
+    br_x509_minimal_context ctx;
+    uncached.installCertStore(&ctx);
+    for (uint32_t index = 0; index < handshakes; ++index)
+        TEST_ASSERT_TRUE(handshake(ctx, data.hashes[42]));
+    TEST_ASSERT_EQUAL(0, uncached.cacheStats().hits);
+    TEST_ASSERT_EQUAL(uncached.cacheStats().allocatedBytes, uncached.cacheStats().freedBytes);
+
+    iop::CertStore cached(listOf(data));
+    cached.installCertStore(&ctx);
+    for (uint32_t index = 0; index < handshakes; ++index) {
+        TEST_ASSERT_TRUE(handshake(ctx, data.hashes[42]));
+        // Unknown issuers are looked up too, they don't decode anything
+        TEST_ASSERT_FALSE(handshake(ctx, Hash{0}));
+    }
+    const auto stats = cached.cacheStats();
+    TEST_ASSERT_EQUAL(1, stats.misses);
+    TEST_ASSERT_EQUAL(handshakes - 1, stats.hits);
+    TEST_ASSERT_EQUAL(0, stats.freedBytes);
+    TEST_ASSERT_TRUE(stats.allocatedBytes * 100 < uncached.cacheStats().allocatedBytes);
+}
+
+void cacheEviction() {
+    const auto data = bundle();
+    iop::CertStore store(listOf(data));
+    br_x509_minimal_context ctx;
+    store.installCertStore(&ctx);
+    // Each certificate is between 900 and 1050 bytes, two fit
+    store.setCacheSize(2200);
+
+    TEST_ASSERT_TRUE(handshake(ctx, data.hashes[1]));
+    TEST_ASSERT_TRUE(handshake(ctx, data.hashes[2]));
+    TEST_ASSERT_TRUE(handshake(ctx, data.hashes[1]));
+    TEST_ASSERT_EQUAL(0, store.cacheStats().evictions);
+
+    // The least recently used goes
+    TEST_ASSERT_TRUE(handshake(ctx, data.hashes[3]));
+    TEST_ASSERT_EQUAL(1, store.cacheStats().evictions);
+    TEST_ASSERT_TRUE(handshake(ctx, data.hashes[1]));
+    TEST_ASSERT_EQUAL(2, store.cacheStats().hits);
+    TEST_ASSERT_TRUE(handshake(ctx, data.hashes[2]));
+    TEST_ASSERT_EQUAL(4, store.cacheStats().misses);
+
+    // Anchors in use aren't evicted, even if the cache is over its size
+    auto first = data.hashes[5];
+    auto second = data.hashes[6];
+    auto third = data.hashes[7];
+    const auto *a = ctx.trust_anchor_dynamic(ctx.trust_anchor_dynamic_ctx, first.data(), first.size());
+    const auto *b = ctx.trust_anchor_dynamic(ctx.trust_anchor_dynamic_ctx, second.data(), second.size());
+    const auto *c = ctx.trust_anchor_dynamic(ctx.trust_anchor_dynamic_ctx, third.data(), third.size());
+    TEST_ASSERT_EQUAL_MEMORY(first.data(), a->dn.data, first.size());
+    TEST_ASSERT_EQUAL_MEMORY(second.data(), b->dn.data, second.size());
+    ctx.trust_anchor_dynamic_free(ctx.trust_anchor_dynamic_ctx, a);
+    ctx.trust_anchor_dynamic_free(ctx.trust_anchor_dynamic_ctx, b);
+    ctx.trust_anchor_dynamic_free(ctx.trust_anchor_dynamic_ctx, c);
+
+    const auto stats = store.cacheStats();
+    TEST_ASSERT_TRUE(stats.allocatedBytes - stats.freedBytes <= 2200);
+    TEST_ASSERT_TRUE(handshake(ctx, data.hashes[7]));
+    TEST_ASSERT_EQUAL(stats.hits + 1, store.cacheStats().hits);
+}
+
+void cacheInvalidation() {
+    const auto data = bundle();
+    iop::CertStore store(listOf(data));
+    br_x509_minimal_context ctx;
+    store.installCertStore(&ctx);
+
+    TEST_ASSERT_TRUE(handshake(ctx, data.hashes[9]));
+    TEST_ASSERT_TRUE(handshake(ctx, data.hashes[9]));
+    TEST_ASSERT_EQUAL(1, store.cacheStats().hits);
+
+    // A new bundle may not have it
+    auto other = data;
+    other.buckets.fill(0);
+    store.setCertList(listOf(other));
+    TEST_ASSERT_FALSE(handshake(ctx, data.hashes[9]));
+    const auto stats = store.cacheStats();
+    TEST_ASSERT_EQUAL(stats.allocatedBytes, stats.freedBytes);
+
+    // Moving the store keeps its anchors
+    store.setCertList(listOf(data));
+    TEST_ASSERT_TRUE(handshake(ctx, data.hashes[9]));
+    iop::CertStore moved(std::move(store));
+    moved.installCertStore(&ctx);
+    TEST_ASSERT_TRUE(handshake(ctx, data.hashes[9]));
+    TEST_ASSERT_EQUAL(2, moved.cacheStats().hits);
+
+    // Anchors in use outlive the list, until BearSSL frees them
+    auto hash = data.hashes[9];
+    const auto *anchor = ctx.trust_anchor_dynamic(ctx.trust_anchor_dynamic_ctx, hash.data(), hash.size());
+    moved.setCertList(listOf(data));
+    TEST_ASSERT_EQUAL_MEMORY(hash.data(), anchor->dn.data, hash.size());
+    TEST_ASSERT_TRUE(moved.cacheStats().allocatedBytes > moved.cacheStats().freedBytes);
+    // Not looked up anymore, it's decoded again from the new list
+    TEST_ASSERT_TRUE(handshake(ctx, data.hashes[9]));
+    TEST_ASSERT_EQUAL(3, moved.cacheStats().hits);
+    TEST_ASSERT_EQUAL(3, moved.cacheStats().misses);
+    const auto evictions = moved.cacheStats().evictions;
+    ctx.trust_anchor_dynamic_free(ctx.trust_anchor_dynamic_ctx, anchor);
+    TEST_ASSERT_EQUAL(evictions + 1, moved.cacheStats().evictions);
+    TEST_ASSERT_TRUE(handshake(ctx, data.hashes[9]));
+    TEST_ASSERT_EQUAL(4, moved.cacheStats().hits);
+}
+
+void pinnedFallback() {
+    // BearSSL's BR_ERR_IO and BR_ERR_X509_NOT_TRUSTED
+    constexpr int io = 31;
+    constexpr int notTrusted = iop::TrustSelector::x509Errors + 30;
+
+    // Unreachable servers say nothing about their chain
+    iop::TrustSelector trust(true);
+    TEST_ASSERT_FALSE(trust.connectionFailed(0));
+    TEST_ASSERT_FALSE(trust.connectionFailed(io));
+    TEST_ASSERT_TRUE(trust.pinned());
+
+    // Refused by the pinned issuers, the CertStore verifies the next handshake
+    TEST_ASSERT_TRUE(trust.connectionFailed(notTrusted));
+    TEST_ASSERT_FALSE(trust.pinned());
+    TEST_ASSERT_FALSE(trust.connectionFailed(notTrusted));
+
+    // Without pinned issuers there is nothing to fall back from
+    iop::TrustSelector unpinned;
+    TEST_ASSERT_FALSE(unpinned.connectionFailed(notTrusted));
+    TEST_ASSERT_FALSE(unpinned.pinned());
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(sameAsLinear);
+    RUN_TEST(cacheHitRate);
+    RUN_TEST(cacheEviction);
+    RUN_TEST(cacheInvalidation);
+    RUN_TEST(pinnedFallback);
+    UNITY_END();
+    return 0;
+}
@@ -0,0 +1,208 @@
+#include "api.hpp"
+#include "codec.hpp"
+
+#include <unity.h>
+#include <cmath>
+
+// Desktop round-trip tests of the event batch codec
+
+constexpr static uint16_t batchSize = 32;
+
+static auto makeEvent(const float airTemperature, const float airHumidity,
+                      const float airHeatIndex, const float soilResistivity,
+                      const float soilTemperature) -> Event {
+    Event event;
+    event.set((Reading){Measure::AIR_TEMPERATURE_CELSIUS, 0, airTemperature});
+    event.set((Reading){Measure::AIR_HUMIDITY_PERCENTAGE, 0, airHumidity});
+    event.set((Reading){Measure::AIR_HEAT_INDEX_CELSIUS, 0, airHeatIndex});
+    event.set((Reading){Measure::SOIL_RESISTIVITY_RAW, 0, soilResistivity});
+    event.set((Reading){Measure::SOIL_TEMPERATURE_CELSIUS, 0, soilTemperature});
+    return event;
+}
+
+// Slow drift, like a real day of measurements
+static auto batch() -> std::vector<Event> {
+    std::vector<Event> events;
+    for (uint16_t index = 0; index < batchSize; ++index) {
+        events.push_back(makeEvent(
+            23.4F + static_cast<float>(index % 5) * 0.1F,
+            61.2F - static_cast<float>(index) * 0.1F,
+            24.1F + static_cast<float>(index % 3) * 0.1F,
+            static_cast<float>(712 + index % 4),
+            19.8F));
+    }
+    return events;
+}
+
+static auto resolutionOf(const EventResolution &res, const Measure measure) -> float {
+    switch (measure) {
+    case Measure::AIR_TEMPERATURE_CELSIUS: return res.airTemperatureCelsius;
+    case Measure::AIR_HUMIDITY_PERCENTAGE: return res.airHumidityPercentage;
+    case Measure::AIR_HEAT_INDEX_CELSIUS: return res.airHeatIndexCelsius;
+    case Measure::SOIL_RESISTIVITY_RAW: return res.soilResistivityRaw;
+    case Measure::SOIL_TEMPERATURE_CELSIUS: return res.soilTemperatureCelsius;
+    }
+    return 0;
+}
+
+static void assertClose(const std::vector<Event> &expected, const std::vector<Event> &actual, const EventResolution &res) {
+    TEST_ASSERT_EQUAL(expected.size(), actual.size());
+    for (size_t index = 0; index < expected.size(); ++index) {
+        TEST_ASSERT_EQUAL(expected[index].size(), actual[index].size());
+        for (uint8_t reading = 0; reading < expected[index].size(); ++reading) {
+            const auto exp = expected[index].at(reading);
+            const auto act = actual[index].at(reading);
+            TEST_ASSERT(exp.measure == act.measure);
+            TEST_ASSERT_EQUAL(exp.sensor, act.sensor);
+            TEST_ASSERT_FLOAT_WITHIN(resolutionOf(res, exp.measure), exp.value, act.value);
+        }
+    }
+}
+
+void roundTrip() {
+    const EventCodec codec;
+    const auto events = batch();
+    const auto encoded = codec.encode(events);
+    const auto decoded = EventCodec::decode(encoded.data(), encoded.size());
+    TEST_ASSERT(decoded.has_value());
+    assertClose(events, *decoded, codec.resolution());
+}
+
+void roundTripCoarse() {
+    auto resolution = EventCodec::defaultResolution();
+    resolution.airTemperatureCelsius = 0.5F;
+    resolution.soilResistivityRaw = 8;
+    const EventCodec codec(resolution);
+    const auto events = batch();
+    const auto encoded = codec.encode(events);
+    const auto decoded = EventCodec::decode(encoded.data(), encoded.size());
+    TEST_ASSERT(decoded.has_value());
+    assertClose(events, *decoded, codec.resolution());
+}
+
+void variableReadings() {
+    std::vector<Event> events;
+    Event first;
+    first.set((Reading){Measure::SOIL_TEMPERATURE_CELSIUS, 0, 19.8F});
+    first.set((Reading){Measure::SOIL_TEMPERATURE_CELSIUS, 1, 21.3F});
+    events.push_back(first);
+
+    Event second;
+    second.set((Reading){Measure::AIR_HUMIDITY_PERCENTAGE, 0, 60.0F});
+    second.set((Reading){Measure::SOIL_TEMPERATURE_CELSIUS, 1, 21.4F});
+    events.push_back(second);
+    events.push_back(Event());
+
+    const EventCodec codec;
+    const auto encoded = codec.encode(events);
+    const auto decoded = EventCodec::decode(encoded.data(), encoded.size());
+    TEST_ASSERT(decoded.has_value());
+    assertClose(events, *decoded, codec.resolution());
+    TEST_ASSERT(!(*decoded)[1].find(Measure::SOIL_TEMPERATURE_CELSIUS, 0).has_value());
+}
+
+void extremes() {
+    const auto nan = std::numeric_limits<float>::quiet_NaN();
+    std::vector<Event> events;
+    events.push_back(makeEvent(nan, -40.0F, 1e30F, 0, -1e30F));
+    events.push_back(makeEvent(85.0F, nan, -1e30F, UINT16_MAX, nan));
+    events.push_back(makeEvent(-40.0F, 100.0F, 0.0F, 0, 0.0F));
+
+    const auto encoded = EventCodec().encode(events);
+    const auto decoded = EventCodec::decode(encoded.data(), encoded.size());
+    TEST_ASSERT(decoded.has_value());
+    TEST_ASSERT_EQUAL(3, decoded->size());
+    TEST_ASSERT(std::isnan(*(*decoded)[0].find(Measure::AIR_TEMPERATURE_CELSIUS, 0)));
+    TEST_ASSERT(std::isnan(*(*decoded)[1].find(Measure::AIR_HUMIDITY_PERCENTAGE, 0)));
+    TEST_ASSERT(std::isnan(*(*decoded)[1].find(Measure::SOIL_TEMPERATURE_CELSIUS, 0)));
+    TEST_ASSERT_EQUAL(UINT16_MAX, *(*decoded)[1].find(Measure::SOIL_RESISTIVITY_RAW, 0));
+    TEST_ASSERT_FLOAT_WITHIN(0.1F, 85.0F, *(*decoded)[1].find(Measure::AIR_TEMPERATURE_CELSIUS, 0));
+    TEST_ASSERT_FLOAT_WITHIN(0.1F, 100.0F, *(*decoded)[2].find(Measure::AIR_HUMIDITY_PERCENTAGE, 0));
+}
+
+void empty() {
+    const auto encoded = EventCodec().encode({});
+    const auto decoded = EventCodec::decode(encoded.data(), encoded.size());
+    TEST_ASSERT(decoded.has_value());
+    TEST_ASSERT_EQUAL(0, decoded->size());
+}
+
+void malformed() {
+    const auto encoded = EventCodec().encode(batch());
+    for (size_t length = 0; length < encoded.size(); ++length)
+        TEST_ASSERT(!EventCodec::decode(encoded.data(), length).has_value());
+
+    auto versioned = encoded;
+    versioned[0] = EventCodec::version + 1;
+    TEST_ASSERT(!EventCodec::decode(versioned.data(), versioned.size()).has_value());
+}
+
+static void writeVarint(std::vector<uint8_t> &out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+// Header of a batch of `count` events, with the default resolution
+static auto header(const uint8_t count) -> std::vector<uint8_t> {
+    std::vector<uint8_t> frame = {EventCodec::version, count};
+    for (uint8_t index = 0; index < measureVariants; ++index)
+        writeVarint(frame, 100);
+    return frame;
+}
+
+void overflow() {
+    // Deltas past 64 bits
+    auto frame = header(1);
+    frame.push_back(1);
+    frame.push_back(0x00);
+    writeVarint(frame, UINT64_MAX);
+    TEST_ASSERT(!EventCodec::decode(frame.data(), frame.size()).has_value());
+
+    // Values past the 32 bits the encoder quantizes to, accumulated by deltas
+    frame = header(2);
+    frame.push_back(1);
+    frame.push_back(0x00);
+    writeVarint(frame, static_cast<uint64_t>(INT32_MAX) << 1);
+    frame.push_back(1);
+    frame.push_back(0x00);
+    writeVarint(frame, 2);
+    TEST_ASSERT(!EventCodec::decode(frame.data(), frame.size()).has_value());
+
+    // But the biggest value is fine
+    frame.resize(frame.size() - 3);
+    frame[1] = 1;
+    TEST_ASSERT(EventCodec::decode(frame.data(), frame.size()).has_value());
+}
+
+void size() {
+    const auto events = batch();
+    size_t capacity = JSON_ARRAY_SIZE(batchSize);
+    for (const auto &event: events)
+        capacity += Api::eventJsonSize(event);
+    DynamicJsonDocument doc(capacity);
+    auto array = doc.to<JsonArray>();
+    for (const auto &event: events)
+        Api::fillEvent(array.createNestedObject(), event);
+
+    const auto msgpack = measureMsgPack(doc);
+    const auto delta = EventCodec().encode(events).size();
+    TEST_ASSERT(msgpack < measureJson(doc));
+    TEST_ASSERT(delta * 5 <= msgpack);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(roundTrip);
+    RUN_TEST(roundTripCoarse);
+    RUN_TEST(variableReadings);
+    RUN_TEST(extremes);
+    RUN_TEST(empty);
+    RUN_TEST(malformed);
+    RUN_TEST(overflow);
+    RUN_TEST(size);
+    UNITY_END();
+    return 0;
+}
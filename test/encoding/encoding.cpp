@@ -0,0 +1,34 @@
+#include "api.hpp"
+
+#include <unity.h>
+
+// Desktop tests of the request body wire formats. Their speed is measured by
+// the benchmark target
+
+static auto makeEvent() -> Event {
+    Event event;
+    event.set((Reading){Measure::AIR_TEMPERATURE_CELSIUS, 0, 23.4F});
+    event.set((Reading){Measure::AIR_HUMIDITY_PERCENTAGE, 0, 61.2F});
+    event.set((Reading){Measure::AIR_HEAT_INDEX_CELSIUS, 0, 24.1F});
+    event.set((Reading){Measure::SOIL_RESISTIVITY_RAW, 0, 712});
+    event.set((Reading){Measure::SOIL_TEMPERATURE_CELSIUS, 0, 19.8F});
+    return event;
+}
+
+static const Event event = makeEvent();
+
+void sizes() {
+    StaticJsonDocument<256> doc;
+    Api::fillEvent(doc.to<JsonObject>(), event);
+
+    const auto json = measureJson(doc);
+    const auto msgpack = measureMsgPack(doc);
+    TEST_ASSERT(msgpack < json);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(sizes);
+    UNITY_END();
+    return 0;
+}
@@ -27,10 +27,98 @@ void wifiConfig() {
   TEST_ASSERT(!flash.readWifiConfig().has_value());
 }
 
+void eventQueue() {
+  const Flash flash(iop::LogLevel::WARN);
+  flash.setup();
+  flash.removeEvents(std::vector<bool>(flash.peekEvents(UINT16_MAX).size(), true));
+  TEST_ASSERT(flash.peekEvents(1).empty());
+
+  Event event;
+  for (uint16_t index = 0; index < 4; ++index) {
+    event.set((Reading){Measure::SOIL_RESISTIVITY_RAW, 0, static_cast<float>(index)});
+    flash.enqueueEvent(event.storage);
+  }
+  TEST_ASSERT_EQUAL(4, flash.queuedEvents());
+
+  const auto events = flash.peekEvents(3);
+  TEST_ASSERT_EQUAL(3, events.size());
+  for (uint16_t index = 0; index < 3; ++index)
+    TEST_ASSERT_EQUAL(index, *events[index].find(Measure::SOIL_RESISTIVITY_RAW, 0));
+
+  // Only the second one failed, it must remain the oldest
+  flash.removeEvents({true, false, true});
+  TEST_ASSERT_EQUAL(2, flash.queuedEvents());
+  const auto remaining = flash.peekEvents(4);
+  TEST_ASSERT_EQUAL(2, remaining.size());
+  TEST_ASSERT_EQUAL(1, *remaining[0].find(Measure::SOIL_RESISTIVITY_RAW, 0));
+  TEST_ASSERT_EQUAL(3, *remaining[1].find(Measure::SOIL_RESISTIVITY_RAW, 0));
+
+  flash.removeEvents({true, true});
+  TEST_ASSERT_EQUAL(0, flash.queuedEvents());
+}
+
+void eventQueueSurvivesReboot() {
+  const Flash flash(iop::LogLevel::WARN);
+  flash.setup();
+  flash.removeEvents(std::vector<bool>(flash.peekEvents(UINT16_MAX).size(), true));
+
+  Event event;
+  for (uint16_t index = 0; index < 3; ++index) {
+    event.set((Reading){Measure::SOIL_RESISTIVITY_RAW, 0, static_cast<float>(index)});
+    flash.enqueueEvent(event.storage);
+  }
+  TEST_ASSERT_EQUAL(3, flash.queuedEvents());
+  TEST_ASSERT_EQUAL(1, flash.peekEvents(1).size());
+  flash.removeEvents({true});
+
+  // Removals are persisted right away, delivered events aren't resent
+  flash.setup();
+  TEST_ASSERT_EQUAL(2, flash.queuedEvents());
+  const auto events = flash.peekEvents(4);
+  TEST_ASSERT_EQUAL(2, events.size());
+  TEST_ASSERT_EQUAL(1, *events[0].find(Measure::SOIL_RESISTIVITY_RAW, 0));
+  TEST_ASSERT_EQUAL(2, *events[1].find(Measure::SOIL_RESISTIVITY_RAW, 0));
+
+  // Appended after the ones that survived
+  event.set((Reading){Measure::SOIL_RESISTIVITY_RAW, 0, 3});
+  flash.enqueueEvent(event.storage);
+  TEST_ASSERT_EQUAL(3, *flash.peekEvents(4).back().find(Measure::SOIL_RESISTIVITY_RAW, 0));
+  flash.removeEvents({true, true, true});
+  TEST_ASSERT_EQUAL(0, flash.queuedEvents());
+}
+
+void eventQueueOverflow() {
+  const Flash flash(iop::LogLevel::WARN);
+  flash.setup();
+  flash.removeEvents(std::vector<bool>(flash.peekEvents(UINT16_MAX).size(), true));
+
+  // Fills every sector, plus one event. The oldest sector is dropped
+  Event event;
+  uint16_t enqueued = 0;
+  while (flash.queuedEvents() == enqueued) {
+    event.set((Reading){Measure::SOIL_RESISTIVITY_RAW, 0, static_cast<float>(enqueued)});
+    flash.enqueueEvent(event.storage);
+    enqueued++;
+  }
+  TEST_ASSERT_TRUE(flash.queuedEvents() > 0);
+
+  // The newest are kept, in order
+  const auto dropped = enqueued - flash.queuedEvents();
+  const auto events = flash.peekEvents(UINT16_MAX);
+  TEST_ASSERT_EQUAL(flash.queuedEvents(), events.size());
+  for (size_t index = 0; index < events.size(); ++index)
+    TEST_ASSERT_EQUAL(dropped + index, *events[index].find(Measure::SOIL_RESISTIVITY_RAW, 0));
+  flash.removeEvents(std::vector<bool>(events.size(), true));
+  TEST_ASSERT_EQUAL(0, flash.queuedEvents());
+}
+
 int main(int argc, char** argv) {
     UNITY_BEGIN();
     RUN_TEST(authToken);
     RUN_TEST(wifiConfig);
+    RUN_TEST(eventQueue);
+    RUN_TEST(eventQueueSurvivesReboot);
+    RUN_TEST(eventQueueOverflow);
     UNITY_END();
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,59 @@
+#include "core/header_block.hpp"
+#include "core/log.hpp"
+
+#include <unity.h>
+#include <string>
+
+// Desktop tests of the per request header block
+
+static const std::string md5 = "0123456789abcdef0123456789abcdef";
+static const std::string mac = "AA:BB:CC:DD:EE:FF";
+
+static auto telemetryAt(const uint32_t index) -> iop::Telemetry {
+    return {3000 + index % 512, 40000 - index % 4096, 20000 + index % 1024, 3300, index * 180};
+}
+
+void layout() {
+    iop::HeaderBlock block;
+    block.setup(md5, mac);
+    const auto view = block.update({1, 2, 3, 4, 0xDEADBEEF});
+    const std::string expected = "VERSION: " + md5 + "\r\nMAC_ADDRESS: " + mac + "\r\n"
+                                 "TELEMETRY: 00000001000000020000000300000004deadbeef\r\n";
+    TEST_ASSERT_EQUAL_STRING(expected.c_str(), std::string(view).c_str());
+}
+
+void fixedWidth() {
+    iop::HeaderBlock block;
+    block.setup(md5, mac);
+    const auto length = block.view().length();
+    TEST_ASSERT_EQUAL(length, block.update({0, 0, 0, 0, 0}).length());
+    TEST_ASSERT_EQUAL(length, block.update({UINT32_MAX, UINT32_MAX, UINT32_MAX, UINT32_MAX, UINT32_MAX}).length());
+}
+
+void roundTrip() {
+    iop::HeaderBlock block;
+    block.setup(md5, mac);
+    const iop::Telemetry telemetry = {2816, 41234, 20480, 3021, 86400000};
+    const auto view = block.update(telemetry);
+
+    const auto start = view.find("TELEMETRY: ") + 11;
+    const auto parsed = iop::HeaderBlock::parseTelemetry(view.substr(start, iop::HeaderBlock::telemetryLength));
+    TEST_ASSERT_TRUE(parsed.has_value());
+    TEST_ASSERT_EQUAL(telemetry.freeStack, parsed->freeStack);
+    TEST_ASSERT_EQUAL(telemetry.freeHeap, parsed->freeHeap);
+    TEST_ASSERT_EQUAL(telemetry.biggestFreeBlock, parsed->biggestFreeBlock);
+    TEST_ASSERT_EQUAL(telemetry.vcc, parsed->vcc);
+    TEST_ASSERT_EQUAL(telemetry.timeRunning, parsed->timeRunning);
+
+    TEST_ASSERT_FALSE(iop::HeaderBlock::parseTelemetry("00").has_value());
+    TEST_ASSERT_FALSE(iop::HeaderBlock::parseTelemetry(std::string(40, 'z')).has_value());
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(layout);
+    RUN_TEST(fixedWidth);
+    RUN_TEST(roundTrip);
+    UNITY_END();
+    return 0;
+}
@@ -0,0 +1,227 @@
+#include "core/http_parser.hpp"
+#include "core/log.hpp"
+
+#include <unity.h>
+#include <string>
+#include <vector>
+
+// Desktop tests of the incremental HTTP parser. Every response of the corpus
+// is parsed split at every byte, then mutated at random (deterministically)
+// to make sure broken servers can't crash us
+
+struct Sample {
+    std::string raw;
+    uint16_t status;
+    std::string body;
+    bool keepAlive;
+    std::string latestVersion;
+};
+
+static auto corpus() -> std::vector<Sample> {
+    return {
+        {"HTTP/1.1 200 OK\r\nContent-Length: 5\r\nLATEST_VERSION: abc\r\n\r\nhello", 200, "hello", true, "abc"},
+        {"HTTP/1.1 200 OK\r\ncontent-length:0\r\n\r\n", 200, "", true, ""},
+        {"HTTP/1.1 403 Forbidden\r\nConnection: close\r\nContent-Length: 2\r\n\r\nno", 403, "no", false, ""},
+        {"HTTP/1.0 200 OK\r\nContent-Length: 3\r\n\r\nold", 200, "old", false, ""},
+        {"HTTP/1.0 200 OK\r\nConnection: keep-alive\r\nContent-Length: 3\r\n\r\nold", 200, "old", true, ""},
+        {"HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\nLatest_Version:  def \r\n\r\n"
+         "4\r\nWiki\r\n5;ext=1\r\npedia\r\nE\r\n in\r\n\r\nchunks.\r\n0\r\nExpires: never\r\n\r\n",
+         200, "Wikipedia in\r\n\r\nchunks.", true, "def"},
+        {"HTTP/1.1 100 Continue\r\n\r\nHTTP/1.1 500 Internal Server Error\r\nContent-Length: 4\r\n\r\noops", 500, "oops", true, ""},
+        {"HTTP/1.1 204 No Content\r\nContent-Length: 10\r\n\r\n", 204, "", true, ""},
+        {"HTTP/1.1 200 OK\nContent-Length: 2\n\nlf", 200, "lf", true, ""},
+    };
+}
+
+static auto parse(const std::string &raw, const std::vector<size_t> &splits, std::string &body) -> iop::HttpParser {
+    iop::HttpParser parser([&body](std::string_view piece) { body.append(piece); return true; });
+    parser.collect("LATEST_VERSION");
+
+    size_t start = 0;
+    for (const auto split: splits) {
+        const auto consumed = parser.feed(std::string_view(raw).substr(start, split - start));
+        TEST_ASSERT(consumed <= split - start);
+        start = split;
+    }
+    parser.feed(std::string_view(raw).substr(start));
+    return parser;
+}
+
+static void check(const Sample &sample, const iop::HttpParser &parser, const std::string &body) {
+    TEST_ASSERT_TRUE(parser.done());
+    TEST_ASSERT_EQUAL(sample.status, parser.status());
+    TEST_ASSERT_EQUAL(sample.keepAlive, parser.keepAlive());
+    TEST_ASSERT_EQUAL_STRING(sample.body.c_str(), body.c_str());
+    TEST_ASSERT_EQUAL(sample.body.length(), parser.bodyLength());
+    const auto latest = parser.header("latest_version");
+    TEST_ASSERT_EQUAL_STRING(sample.latestVersion.c_str(), std::string(latest.value_or("")).c_str());
+}
+
+void wholeInput() {
+    for (const auto &sample: corpus()) {
+        std::string body;
+        const auto parser = parse(sample.raw, {}, body);
+        check(sample, parser, body);
+    }
+}
+
+void everySplit() {
+    for (const auto &sample: corpus()) {
+        for (size_t split = 0; split <= sample.raw.length(); ++split) {
+            std::string body;
+            const auto parser = parse(sample.raw, {split}, body);
+            check(sample, parser, body);
+        }
+    }
+}
+
+void byteByByte() {
+    for (const auto &sample: corpus()) {
+        std::vector<size_t> splits;
+        for (size_t split = 1; split < sample.raw.length(); ++split)
+            splits.push_back(split);
+        std::string body;
+        const auto parser = parse(sample.raw, splits, body);
+        check(sample, parser, body);
+    }
+}
+
+void untilClose() {
+    std::string body;
+    iop::HttpParser parser([&body](std::string_view piece) { body.append(piece); return true; });
+    parser.feed("HTTP/1.1 200 OK\r\n\r\nuntil ");
+    parser.feed("the end");
+    TEST_ASSERT_FALSE(parser.done());
+    parser.finish();
+    TEST_ASSERT_TRUE(parser.done());
+    TEST_ASSERT_FALSE(parser.keepAlive());
+    TEST_ASSERT_EQUAL_STRING("until the end", body.c_str());
+}
+
+void keepAlive() {
+    const std::string first = "HTTP/1.1 200 OK\r\nContent-Length: 1\r\n\r\na";
+    const std::string second = "HTTP/1.1 200 OK\r\nContent-Length: 1\r\n\r\nb";
+    const auto both = first + second;
+
+    std::string body;
+    iop::HttpParser parser([&body](std::string_view piece) { body.append(piece); return true; });
+    const auto consumed = parser.feed(both);
+    TEST_ASSERT_EQUAL(first.length(), consumed);
+    TEST_ASSERT_TRUE(parser.done());
+
+    parser.reset();
+    TEST_ASSERT_EQUAL(second.length(), parser.feed(std::string_view(both).substr(consumed)));
+    TEST_ASSERT_TRUE(parser.done());
+    TEST_ASSERT_EQUAL_STRING("ab", body.c_str());
+}
+
+void headersFirst() {
+    const std::string raw = "HTTP/1.1 200 OK\r\nContent-Length: 4\r\n\r\nbody";
+    std::string body;
+    iop::HttpParser parser(nullptr);
+    const auto consumed = parser.feedHeaders(raw);
+    TEST_ASSERT_TRUE(parser.headersDone());
+    TEST_ASSERT_EQUAL(raw.length() - 4, consumed);
+    TEST_ASSERT_EQUAL(4, *parser.contentLength());
+
+    // Sink is chosen after the headers
+    parser.setSink([&body](std::string_view piece) { body.append(piece); return true; });
+    parser.feed(std::string_view(raw).substr(consumed));
+    TEST_ASSERT_TRUE(parser.done());
+    TEST_ASSERT_EQUAL_STRING("body", body.c_str());
+}
+
+void malformed() {
+    const std::vector<std::string> inputs = {
+        "HTTP/2 200 OK\r\n\r\n",
+        "HTTP/1.1 2x0 OK\r\n\r\n",
+        "HTTP/1.1 200 OK\r\nNo colon\r\n\r\n",
+        "HTTP/1.1 200 OK\r\n folded: header\r\n\r\n",
+        "HTTP/1.1 200 OK\r\nContent-Length: 1\r\nContent-Length: 2\r\n\r\n",
+        "HTTP/1.1 200 OK\r\nContent-Length: -1\r\n\r\n",
+        "HTTP/1.1 200 OK\r\nContent-Length: 99999999999999999999999\r\n\r\n",
+        "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\nzz\r\n",
+        "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n1\r\nab\r\n",
+        "HTTP/1.1 200 OK\r\nX: " + std::string(iop::HttpParser::maxLineLength, 'a') + "\r\n\r\n",
+    };
+    for (const auto &input: inputs) {
+        iop::HttpParser parser(nullptr);
+        parser.feed(input);
+        TEST_ASSERT_TRUE(parser.failed());
+    }
+
+    // Sink aborts
+    iop::HttpParser parser([](std::string_view piece) { return piece.length() < 2; });
+    parser.feed("HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nhello");
+    TEST_ASSERT_TRUE(parser.failed());
+
+    // Connection closed before the end
+    iop::HttpParser truncated(nullptr);
+    truncated.feed("HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nhel");
+    truncated.finish();
+    TEST_ASSERT_TRUE(truncated.failed());
+}
+
+// Deterministic mutations of the corpus, fed in random sized pieces
+void fuzz() {
+    uint32_t state = 0x1234567;
+    const auto random = [&state]() {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    };
+
+    const auto samples = corpus();
+    for (uint32_t iteration = 0; iteration < 20000; ++iteration) {
+        auto input = samples[random() % samples.size()].raw;
+        const auto mutations = 1 + random() % 4;
+        for (uint32_t mutation = 0; mutation < mutations && !input.empty(); ++mutation) {
+            const auto position = random() % input.length();
+            switch (random() % 4) {
+            case 0:
+                input[position] = static_cast<char>(random());
+                break;
+            case 1:
+                input.erase(position, 1 + random() % 8);
+                break;
+            case 2:
+                input.insert(position, 1 + random() % 8, static_cast<char>(random()));
+                break;
+            case 3:
+                input.resize(position);
+                break;
+            }
+        }
+
+        size_t bodyLength = 0;
+        iop::HttpParser parser([&bodyLength](std::string_view piece) { bodyLength += piece.length(); return true; });
+        size_t offset = 0;
+        while (offset < input.length()) {
+            const auto size = std::min<size_t>(1 + random() % 16, input.length() - offset);
+            const auto consumed = parser.feed(std::string_view(input).substr(offset, size));
+            TEST_ASSERT(consumed <= size);
+            if (parser.done() || parser.failed())
+                break;
+            offset += size;
+        }
+        parser.finish();
+        TEST_ASSERT_TRUE(parser.done() || parser.failed());
+        TEST_ASSERT(bodyLength <= input.length());
+        TEST_ASSERT_EQUAL(bodyLength, parser.bodyLength());
+    }
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(wholeInput);
+    RUN_TEST(everySplit);
+    RUN_TEST(byteByByte);
+    RUN_TEST(untilClose);
+    RUN_TEST(keepAlive);
+    RUN_TEST(headersFirst);
+    RUN_TEST(malformed);
+    RUN_TEST(fuzz);
+    UNITY_END();
+    return 0;
+}
@@ -0,0 +1,171 @@
+#include "core/log_binary.hpp"
+#include "core/log.hpp"
+
+#include <unity.h>
+#include <array>
+#include <string>
+#include <vector>
+
+// Desktop tests of the binary log encoding: frames decode back to the text
+// the default hook prints, and how much smaller they are
+
+static auto cobsDecode(const uint8_t *frame, const size_t size) -> std::vector<uint8_t> {
+    std::vector<uint8_t> out;
+    size_t index = 0;
+    // Last byte is the terminator
+    while (index < size - 1) {
+        const auto code = frame[index];
+        TEST_ASSERT_TRUE(code > 0 && index + code <= size - 1);
+        out.insert(out.end(), frame + index + 1, frame + index + code);
+        index += code;
+        if (index < size - 1)
+            out.push_back(0);
+    }
+    return out;
+}
+
+static auto varint(const std::vector<uint8_t> &data, size_t &index) -> uint64_t {
+    uint64_t value = 0;
+    uint8_t shift = 0;
+    while (data.at(index) >= 0x80) {
+        value |= static_cast<uint64_t>(data.at(index++) & 0x7F) << shift;
+        shift += 7;
+    }
+    value |= static_cast<uint64_t>(data.at(index++)) << shift;
+    return value;
+}
+
+static auto unzigzag(const uint64_t value) -> int64_t {
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+static auto levelName(const uint8_t level) -> std::string {
+    const char *names[] = {"TRACE", "DEBUG", "INFO", "WARN", "ERROR", "CRIT", "NO_LOG"};
+    return names[level];
+}
+
+// Like `build/decodeLogs.py`, but the strings are in this process
+static auto decode(const uint8_t *frame, const size_t size) -> std::string {
+    TEST_ASSERT_EQUAL(0, frame[size - 1]);
+    for (size_t index = 0; index + 1 < size; ++index)
+        TEST_ASSERT_TRUE(frame[index] != 0);
+
+    const auto data = cobsDecode(frame, size);
+    size_t index = 0;
+    const auto header = data.at(index++);
+    TEST_ASSERT_EQUAL(iop::BinaryLog::version, header >> 4);
+
+    std::string text;
+    const auto level = static_cast<uint8_t>(header & 0xF);
+    if (level != iop::BinaryLog::pieceLevel)
+        text = "[" + levelName(level) + "] " + (iop::BinaryLog::anchor() + unzigzag(varint(data, index))) + ": ";
+
+    while (index < data.size()) {
+        switch (static_cast<iop::BinaryLog::Tag>(data.at(index++))) {
+        case iop::BinaryLog::Tag::INTERNED:
+            text += iop::BinaryLog::anchor() + unzigzag(varint(data, index));
+            break;
+        case iop::BinaryLog::Tag::STRING: {
+            const auto length = varint(data, index);
+            text += std::string(data.begin() + static_cast<ssize_t>(index), data.begin() + static_cast<ssize_t>(index + length));
+            index += length;
+            break;
+        }
+        case iop::BinaryLog::Tag::UNSIGNED:
+            text += std::to_string(varint(data, index));
+            break;
+        case iop::BinaryLog::Tag::SIGNED:
+            text += std::to_string(unzigzag(varint(data, index)));
+            break;
+        default:
+            TEST_FAIL();
+        }
+    }
+    return level != iop::BinaryLog::pieceLevel ? text + "\n" : text;
+}
+
+static auto encode(const iop::LogLevel level, const iop::StaticString target, const std::vector<iop::LogPart> &parts,
+                   std::array<uint8_t, iop::BinaryLog::maxFrameSize> &frame) -> size_t {
+    const auto header = static_cast<uint8_t>(iop::BinaryLog::version << 4 | static_cast<uint8_t>(level));
+    return iop::BinaryLog::encode(header, &target, parts.data(), parts.size(), frame.data());
+}
+
+// What the default hook prints
+static auto text(const iop::LogLevel level, const iop::StaticString target, const std::vector<iop::LogPart> &parts) -> std::string {
+    const char *names[] = {"TRACE", "DEBUG", "INFO", "WARN", "ERROR", "CRIT", "NO_LOG"};
+    auto line = std::string("[") + names[static_cast<uint8_t>(level)] + "] " + target.asCharPtr() + ": ";
+    for (const auto &part: parts) {
+        if (part.isNumber()) {
+            std::array<char, iop::LogPart::maxNumberLength> number;
+            line += std::string(number.data(), part.format(number.data()));
+        } else {
+            line += std::string(part.data, part.length);
+        }
+    }
+    return line + "\n";
+}
+
+void roundTrip() {
+    std::array<uint8_t, iop::BinaryLog::maxFrameSize> frame;
+    const std::string token("8f14e45fceea167a5a36dedd4bea2543");
+    const std::vector<std::vector<iop::LogPart>> messages = {
+        {F("Response code ("), 200, F("): "), F("OK")},
+        {F("Zeros "), 0, F(", "), 0U, F(" and negatives "), -1, F(" "), INT32_MIN, F(" "), UINT32_MAX},
+        {F("Token: "), token},
+        {std::string_view("")},
+    };
+    for (const auto &parts: messages) {
+        const auto size = encode(iop::LogLevel::WARN, F("API"), parts, frame);
+        TEST_ASSERT_EQUAL_STRING(text(iop::LogLevel::WARN, F("API"), parts).c_str(), decode(frame.data(), size).c_str());
+    }
+
+    // Pieces printed outside of loggers
+    const iop::LogPart piece(F("[TRACE] TRACER: Entering new scope\n"));
+    const auto header = static_cast<uint8_t>(iop::BinaryLog::version << 4 | iop::BinaryLog::pieceLevel);
+    const auto size = iop::BinaryLog::encode(header, nullptr, &piece, 1, frame.data());
+    TEST_ASSERT_EQUAL_STRING("[TRACE] TRACER: Entering new scope\n", decode(frame.data(), size).c_str());
+}
+
+void truncates() {
+    std::array<uint8_t, iop::BinaryLog::maxFrameSize> frame;
+    const std::string payload(1000, 'x');
+    const std::vector<iop::LogPart> parts = {F("Payload: "), payload, F(" never seen")};
+    const auto size = encode(iop::LogLevel::DEBUG, F("API"), parts, frame);
+    TEST_ASSERT_EQUAL(iop::BinaryLog::maxFrameSize, size);
+
+    const auto decoded = decode(frame.data(), size);
+    TEST_ASSERT_TRUE(decoded.find("[DEBUG] API: Payload: xxx") == 0);
+    TEST_ASSERT_TRUE(decoded.find("never") == decoded.npos);
+}
+
+void smaller() {
+    std::array<uint8_t, iop::BinaryLog::maxFrameSize> frame;
+    const std::string path("/v1/event");
+    // Common lines of a measurement cycle
+    const std::vector<std::vector<iop::LogPart>> messages = {
+        {F("POST to "), F("https://iop-monitor-server.tk:4001"), path, F(", data length: "), 128U},
+        {F("Connections opened: "), 3U, F(", requests sent: "), 57U},
+        {F("Response code ("), 200, F("): "), F("OK")},
+        {F("Kept alive connection was closed by the server, reconnecting")},
+        {F("Measurement taken, next in "), 180000U, F("ms")},
+        {F("Server doesn't support Max Fragment Length Negotiation, using 16KB buffers")},
+    };
+
+    size_t textBytes = 0;
+    size_t binaryBytes = 0;
+    for (const auto &parts: messages) {
+        textBytes += text(iop::LogLevel::INFO, F("NETWORK"), parts).length();
+        binaryBytes += encode(iop::LogLevel::INFO, F("NETWORK"), parts, frame);
+    }
+
+    TEST_ASSERT_TRUE(binaryBytes * 3 < textBytes);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(roundTrip);
+    RUN_TEST(truncates);
+    RUN_TEST(smaller);
+    UNITY_END();
+    return 0;
+}
@@ -0,0 +1,158 @@
+#include "core/log_ring.hpp"
+#include "core/log.hpp"
+
+#include <unity.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Desktop tests of the log buffer: records in order, partial writes like a
+// full UART FIFO, overruns, and producers racing each other and the drain
+
+static std::string output;
+
+static auto collect(const std::string_view data) -> size_t {
+    output += data;
+    return data.length();
+}
+
+// Like the UART FIFO: a few bytes at a time, sometimes none
+static uint32_t calls = 0;
+static auto trickle(const std::string_view data) -> size_t {
+    if (calls++ % 3 == 0)
+        return 0;
+    const auto length = std::min<size_t>(data.length(), 7);
+    output += data.substr(0, length);
+    return length;
+}
+
+void inOrder() {
+    static iop::LogRing ring;
+    output.clear();
+    TEST_ASSERT_TRUE(ring.isEmpty());
+
+    const std::string message("message");
+    const iop::LogPart parts[] = {F("[INFO] "), std::string_view("target: "), message, "\n"};
+    TEST_ASSERT_TRUE(ring.push(parts, 4));
+    TEST_ASSERT_TRUE(ring.push("second\n"));
+    TEST_ASSERT_TRUE(ring.push(""));
+    TEST_ASSERT_FALSE(ring.isEmpty());
+
+    TEST_ASSERT_EQUAL(30, ring.drain(collect));
+    TEST_ASSERT_EQUAL_STRING("[INFO] target: message\nsecond\n", output.c_str());
+    TEST_ASSERT_TRUE(ring.isEmpty());
+    TEST_ASSERT_EQUAL(0, ring.drain(collect));
+}
+
+void wrapsAround() {
+    static iop::LogRing ring;
+    output.clear();
+    calls = 0;
+
+    std::string expected;
+    for (uint32_t index = 0; index < 5000; ++index) {
+        // Odd lengths, so records cross the end of the buffer
+        const auto message = std::to_string(index) + std::string(index % 37, 'x') + "\n";
+        while (!ring.push(message))
+            ring.drain(trickle);
+        expected += message;
+        if (index % 5 == 0)
+            ring.drain(trickle);
+    }
+    while (!ring.isEmpty())
+        ring.drain(trickle);
+
+    TEST_ASSERT_TRUE(output == expected);
+}
+
+void overrun() {
+    static iop::LogRing ring;
+    output.clear();
+
+    const std::string message(100, 'a');
+    uint32_t pushed = 0;
+    while (ring.push(message))
+        pushed++;
+    // Each record takes whole slots
+    TEST_ASSERT_EQUAL(iop::LogRing::capacity / 112, pushed);
+    TEST_ASSERT_EQUAL(1, ring.dropped());
+    TEST_ASSERT_FALSE(ring.push(message));
+    TEST_ASSERT_EQUAL(2, ring.dropped());
+
+    // Never fits
+    TEST_ASSERT_FALSE(ring.push(std::string(iop::LogRing::capacity + 1, 'b')));
+    TEST_ASSERT_EQUAL(3, ring.dropped());
+
+    // Old messages are kept whole, new ones fit once they are written
+    ring.drain(collect);
+    TEST_ASSERT_EQUAL(pushed * message.length(), output.length());
+    TEST_ASSERT_TRUE(ring.push(message));
+    TEST_ASSERT_TRUE(ring.push(std::string(iop::LogRing::capacity - 112, 'c')));
+}
+
+constexpr static uint32_t producers = 4;
+constexpr static uint32_t messages = 20000;
+
+void concurrent() {
+    static iop::LogRing ring;
+    output.clear();
+
+    std::atomic<bool> done(false);
+    std::thread consumer([&] {
+        while (!done.load())
+            ring.drain(collect);
+    });
+
+    std::vector<std::thread> threads;
+    for (uint32_t id = 0; id < producers; ++id) {
+        threads.emplace_back([id] {
+            const auto prefix = std::string("T") + std::to_string(id) + ":";
+            for (uint32_t seq = 0; seq < messages; ++seq) {
+                const auto number = std::to_string(seq);
+                const std::string dots(seq % 50, '.');
+                const iop::LogPart parts[] = {prefix, dots, number, "\n"};
+                ring.push(parts, 4);
+            }
+        });
+    }
+    for (auto &thread: threads)
+        thread.join();
+    done.store(true);
+    consumer.join();
+    ring.drain(collect);
+
+    // Every line is whole, and each producer's are in order
+    std::vector<int64_t> last(producers, -1);
+    uint32_t lines = 0;
+    size_t start = 0;
+    while (start < output.length()) {
+        const auto end = output.find('\n', start);
+        TEST_ASSERT_TRUE(end != output.npos);
+        const auto line = output.substr(start, end - start);
+        start = end + 1;
+        lines++;
+
+        TEST_ASSERT_TRUE(line.length() > 3 && line[0] == 'T' && line[2] == ':');
+        const auto id = static_cast<uint32_t>(line[1] - '0');
+        TEST_ASSERT_TRUE(id < producers);
+        const auto dots = line.find_first_not_of('.', 3);
+        const auto seq = std::stoll(line.substr(dots));
+        TEST_ASSERT_EQUAL(seq % 50, dots - 3);
+        TEST_ASSERT_TRUE(seq > last[id]);
+        last[id] = seq;
+    }
+    TEST_ASSERT_EQUAL(producers * messages, lines + ring.dropped());
+    TEST_ASSERT_TRUE(lines > producers);
+
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(inOrder);
+    RUN_TEST(wrapsAround);
+    RUN_TEST(overrun);
+    RUN_TEST(concurrent);
+    UNITY_END();
+    return 0;
+}
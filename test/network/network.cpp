@@ -0,0 +1,190 @@
+#include "core/network.hpp"
+#include "driver/thread.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <unity.h>
+#include <atomic>
+#include <cstring>
+#include <string>
+#include <thread>
+
+// Drives asynchronous requests against a local server that fails on demand,
+// per path: `/ok` answers, `/flaky` closes the connection without answering
+// the first two times, `/down` always answers 500 and `/slow` takes too long
+
+constexpr static uint16_t port = 8083;
+const static iop::StaticString serverUri(reinterpret_cast<const __FlashStringHelper *>("http://127.0.0.1:8083"));
+
+constexpr static iop::RetryPolicy policy = {
+    .attempts = 3,
+    .baseDelay = 10,
+    .maxDelay = 40,
+    .failureThreshold = 3,
+    .openFor = 200,
+};
+
+static std::atomic<uint32_t> served(0);
+static std::atomic<uint32_t> flakyFailures(0);
+
+/// Returns false if the connection must be closed, without answering
+static auto respond(const int fd, const std::string &path) -> bool {
+    if (path == "/flaky" && flakyFailures.fetch_add(1) < 2)
+        return false;
+
+    std::string response = "HTTP/1.1 200 OK\r\nContent-Length: 4\r\n\r\ndone";
+    if (path == "/down")
+        response = "HTTP/1.1 500 Internal Server Error\r\nContent-Length: 0\r\n\r\n";
+    if (path == "/slow")
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    send(fd, response.data(), response.length(), MSG_NOSIGNAL);
+    return true;
+}
+
+/// Serves one connection at a time, the client never opens more
+static void serve(const int listener) {
+    while (true) {
+        const int fd = accept(listener, nullptr, nullptr);
+        if (fd < 0)
+            return;
+
+        std::string buffer;
+        char data[512];
+        while (true) {
+            const auto end = buffer.find("\r\n\r\n");
+            if (end == buffer.npos) {
+                const auto size = recv(fd, data, sizeof(data), 0);
+                if (size <= 0)
+                    break;
+                buffer.append(data, static_cast<size_t>(size));
+                continue;
+            }
+
+            const auto lengthStart = buffer.find("Content-Length: ") + strlen("Content-Length: ");
+            const auto total = end + 4 + std::stoul(buffer.substr(lengthStart));
+            while (buffer.length() < total) {
+                const auto size = recv(fd, data, sizeof(data), 0);
+                if (size <= 0)
+                    break;
+                buffer.append(data, static_cast<size_t>(size));
+            }
+            const auto pathStart = buffer.find(' ') + 1;
+            const auto path = buffer.substr(pathStart, buffer.find(' ', pathStart) - pathStart);
+            buffer.erase(0, total);
+            served++;
+
+            if (!respond(fd, path))
+                break;
+        }
+        close(fd);
+    }
+}
+
+static auto listenLocally() -> int {
+    const int listener = socket(AF_INET, SOCK_STREAM, 0);
+    const int reuse = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    TEST_ASSERT_EQUAL(0, bind(listener, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)));
+    TEST_ASSERT_EQUAL(0, listen(listener, 4));
+    return listener;
+}
+
+/// Polls the request until it's finished, like the event loop does
+static auto post(const iop::StaticString path, iop::PayloadBuffer &payload,
+                 const iop::RequestDeadlines deadlines = iop::Network::defaultDeadlines) -> iop::NetworkStatus {
+    // Every scenario starts in a new connection
+    iop::Network::wifiClient().stop();
+
+    const iop::Network network(serverUri, iop::LogLevel::WARN);
+    auto request = network.httpPostAsync(std::string_view("token"), path, iop::BodyStream::fromView("{}"),
+                                         iop::ContentType::JSON, payload.sink(), deadlines);
+    std::optional<iop::NetworkStatus> status;
+    while (!(status = request.poll()).has_value())
+        driver::thisThread.sleep(1);
+    TEST_ASSERT_FALSE(iop::Network::isBusy());
+    return iop::unwrap_ref(status, IOP_CTX());
+}
+
+void answered() {
+    std::array<char, 16> buffer;
+    iop::PayloadBuffer payload(buffer);
+    TEST_ASSERT_EQUAL(iop::NetworkStatus::OK, post(F("/ok"), payload));
+    TEST_ASSERT_EQUAL_STRING_LEN("done", buffer.data(), 4);
+    TEST_ASSERT_EQUAL(4, payload.length());
+}
+
+void retriedAfterClose() {
+    std::array<char, 16> buffer;
+    iop::PayloadBuffer payload(buffer);
+    const auto retries = iop::Network::stats().retries;
+    const auto before = served.load();
+
+    // Closed twice without an answer, the third attempt succeeds
+    TEST_ASSERT_EQUAL(iop::NetworkStatus::OK, post(F("/flaky"), payload));
+    TEST_ASSERT_EQUAL(2, iop::Network::stats().retries - retries);
+    TEST_ASSERT_EQUAL(3, served.load() - before);
+    TEST_ASSERT_EQUAL_STRING_LEN("done", buffer.data(), 4);
+    TEST_ASSERT_EQUAL(iop::CircuitState::CLOSED, iop::Network::circuitState(F("/flaky")));
+}
+
+void circuitOpens() {
+    std::array<char, 16> buffer;
+    iop::PayloadBuffer payload(buffer);
+    const auto before = served.load();
+    const auto shortCircuits = iop::Network::stats().shortCircuits;
+
+    // Every attempt fails, which trips the breaker
+    TEST_ASSERT_EQUAL(iop::NetworkStatus::BROKEN_SERVER, post(F("/down"), payload));
+    TEST_ASSERT_EQUAL(policy.attempts, served.load() - before);
+    TEST_ASSERT_EQUAL(iop::CircuitState::OPEN, iop::Network::circuitState(F("/down")));
+
+    // Refused without reaching the server, other endpoints are unaffected
+    TEST_ASSERT_EQUAL(iop::NetworkStatus::CONNECTION_ISSUES, post(F("/down"), payload));
+    TEST_ASSERT_EQUAL(policy.attempts, served.load() - before);
+    TEST_ASSERT_EQUAL(1, iop::Network::stats().shortCircuits - shortCircuits);
+    TEST_ASSERT_EQUAL(iop::NetworkStatus::OK, post(F("/ok"), payload));
+
+    // A single probe is let through once it's been open long enough
+    driver::thisThread.sleep(policy.openFor + 10);
+    const auto probed = served.load();
+    TEST_ASSERT_EQUAL(iop::NetworkStatus::BROKEN_SERVER, post(F("/down"), payload));
+    TEST_ASSERT_EQUAL(1, served.load() - probed);
+}
+
+void timesOut() {
+    std::array<char, 16> buffer;
+    iop::PayloadBuffer payload(buffer);
+
+    auto deadlines = iop::Network::defaultDeadlines;
+    deadlines.headers = 100;
+    const auto retries = iop::Network::stats().retries;
+
+    // The server is stuck, every attempt times out waiting for the headers
+    TEST_ASSERT_EQUAL(iop::NetworkStatus::CONNECTION_ISSUES, post(F("/slow"), payload, deadlines));
+    TEST_ASSERT_EQUAL(policy.attempts - 1, iop::Network::stats().retries - retries);
+    TEST_ASSERT_EQUAL(0, payload.length());
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    iop::Log(iop::LogLevel::WARN, F("NETWORK")).setup(iop::LogLevel::WARN);
+    iop::Network::setRetryPolicy(policy);
+
+    const auto listener = listenLocally();
+    std::thread(serve, listener).detach();
+
+    RUN_TEST(answered);
+    RUN_TEST(retriedAfterClose);
+    RUN_TEST(circuitOpens);
+    RUN_TEST(timesOut);
+
+    shutdown(listener, SHUT_RDWR);
+    close(listener);
+    return UNITY_END();
+}
@@ -0,0 +1,161 @@
+#include "policy.hpp"
+
+#include <unity.h>
+#include <cmath>
+#include <functional>
+#include <limits>
+
+// Desktop replay of day long traces through the upload policy, checks the
+// upload volume saved and the error of reconstructing the series by holding
+// the last uploaded value
+
+constexpr static iop::esp_time sampleInterval = 30 * 1000;
+constexpr static iop::esp_time fixedInterval = 180 * 1000;
+constexpr static iop::esp_time twoDays = 48 * 60 * 60 * 1000;
+constexpr static float pi = 3.14159265F;
+
+static const PolicyConfig policyConfig = {
+    .minInterval = fixedInterval,
+    .maxInterval = 15 * 60 * 1000,
+    .heartbeat = 60 * 60 * 1000,
+    .deadbands = {0.3F, 2.0F, 0.3F, 15.0F, 0.2F},
+};
+
+using Trace = std::function<float(iop::esp_time)>;
+
+// Deterministic sensor noise, in [-amplitude, amplitude]
+static auto noise(const iop::esp_time time, const float amplitude) -> float {
+    auto state = static_cast<uint32_t>(time / sampleInterval) * 1103515245U + 12345U;
+    state ^= state >> 16;
+    return (static_cast<float>(state % 2001) / 1000.0F - 1.0F) * amplitude;
+}
+
+// Soil barely follows the sun, and quantizes to 1/16 celsius at 12 bits
+static auto soilTemperature(const iop::esp_time time) -> float {
+    const auto hours = static_cast<float>(time) / 3600000.0F;
+    const auto value = 19.5F + 1.5F * std::sin(2 * pi * (hours - 9) / 24) + noise(time, 0.05F);
+    return std::round(value * 16) / 16;
+}
+
+// Humidity jumps when the field is irrigated, at 6am each day
+static auto airHumidity(const iop::esp_time time) -> float {
+    const auto hours = std::fmod(static_cast<float>(time) / 3600000.0F, 24.0F);
+    const auto irrigation = hours >= 6 && hours < 7 ? 25.0F * (7 - hours) : 0;
+    return 60 - 15 * std::sin(2 * pi * (hours - 9) / 24) + irrigation + noise(time, 0.5F);
+}
+
+struct Replay {
+    uint32_t uploads;
+    uint32_t fixedUploads;
+    float maxError;
+    float rmsError;
+};
+
+static auto replay(const Measure measure, const Trace &trace) -> Replay {
+    UploadPolicy policy(policyConfig);
+    Aggregator aggregator;
+    Replay result = {0, static_cast<uint32_t>(twoDays / fixedInterval), 0, 0};
+
+    auto held = std::numeric_limits<float>::quiet_NaN();
+    iop::esp_time nextMeasurement = policy.interval();
+    double squaredErrors = 0;
+    uint32_t samples = 0;
+
+    for (iop::esp_time now = 0; now < twoDays; now += sampleInterval) {
+        const auto value = trace(now);
+        aggregator.add((Reading){measure, 0, value});
+
+        if (!std::isnan(held)) {
+            const auto error = std::abs(value - held);
+            result.maxError = std::max(result.maxError, error);
+            squaredErrors += static_cast<double>(error) * error;
+            samples++;
+        }
+
+        if (nextMeasurement <= now) {
+            const auto summary = aggregator.take();
+            if (policy.evaluate(summary, now)) {
+                result.uploads++;
+                held = summary.readings.front().mean;
+            }
+            nextMeasurement = now + policy.interval();
+        }
+    }
+
+    result.rmsError = static_cast<float>(std::sqrt(squaredErrors / samples));
+    return result;
+}
+
+void soilTemperatureTrace() {
+    const auto result = replay(Measure::SOIL_TEMPERATURE_CELSIUS, soilTemperature);
+    const auto deadband = policyConfig.deadbands[static_cast<uint8_t>(Measure::SOIL_TEMPERATURE_CELSIUS)];
+    TEST_ASSERT_LESS_THAN(result.fixedUploads / 4, result.uploads);
+    // Heartbeat bounds the silence
+    TEST_ASSERT_GREATER_OR_EQUAL(48, result.uploads);
+    TEST_ASSERT_LESS_THAN_FLOAT(deadband, result.rmsError);
+    TEST_ASSERT_LESS_THAN_FLOAT(3 * deadband, result.maxError);
+}
+
+void airHumidityTrace() {
+    const auto result = replay(Measure::AIR_HUMIDITY_PERCENTAGE, airHumidity);
+    const auto deadband = policyConfig.deadbands[static_cast<uint8_t>(Measure::AIR_HUMIDITY_PERCENTAGE)];
+    TEST_ASSERT_LESS_THAN(result.fixedUploads / 4, result.uploads);
+    // A step is only seen when the window closes, so while stretched it's
+    // late by up to the longest window
+    TEST_ASSERT_LESS_THAN_FLOAT(1.5F * deadband, result.rmsError);
+}
+
+void adaptsInterval() {
+    UploadPolicy policy(policyConfig);
+    Summary summary;
+    summary.readings.push_back((ReadingSummary){Measure::SOIL_TEMPERATURE_CELSIUS, 0, 20, 20, 20, 0, 1});
+
+    iop::esp_time now = 0;
+    TEST_ASSERT_TRUE(policy.evaluate(summary, now));
+    TEST_ASSERT_EQUAL(policyConfig.minInterval, policy.interval());
+
+    // Stable readings stretch the window, without uploading
+    for (uint8_t index = 0; index < 4; ++index) {
+        now += policy.interval();
+        TEST_ASSERT_FALSE(policy.evaluate(summary, now));
+    }
+    TEST_ASSERT_EQUAL(policyConfig.maxInterval, policy.interval());
+
+    // Fast change shrinks it and is uploaded
+    summary.readings.front().mean = 21;
+    now += policy.interval();
+    TEST_ASSERT_TRUE(policy.evaluate(summary, now));
+    TEST_ASSERT_EQUAL(policyConfig.maxInterval / 2, policy.interval());
+}
+
+void failuresAreUploaded() {
+    UploadPolicy policy(policyConfig);
+    Summary summary;
+    summary.readings.push_back((ReadingSummary){Measure::SOIL_TEMPERATURE_CELSIUS, 0, 20, 20, 20, 0, 1});
+    TEST_ASSERT_TRUE(policy.evaluate(summary, 0));
+
+    const auto nan = std::numeric_limits<float>::quiet_NaN();
+    summary.readings.front() = (ReadingSummary){Measure::SOIL_TEMPERATURE_CELSIUS, 0, nan, nan, nan, 0, 0};
+    TEST_ASSERT_TRUE(policy.evaluate(summary, fixedInterval));
+    TEST_ASSERT_FALSE(policy.evaluate(summary, 2 * fixedInterval));
+}
+
+void heartbeat() {
+    UploadPolicy policy(policyConfig);
+    Summary summary;
+    summary.readings.push_back((ReadingSummary){Measure::AIR_HUMIDITY_PERCENTAGE, 0, 50, 50, 50, 0, 1});
+    TEST_ASSERT_TRUE(policy.evaluate(summary, 0));
+    TEST_ASSERT_FALSE(policy.evaluate(summary, policyConfig.heartbeat - 1));
+    TEST_ASSERT_TRUE(policy.evaluate(summary, policyConfig.heartbeat));
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(adaptsInterval);
+    RUN_TEST(failuresAreUploaded);
+    RUN_TEST(heartbeat);
+    RUN_TEST(soilTemperatureTrace);
+    RUN_TEST(airHumidityTrace);
+    UNITY_END();
+    return 0;
+}
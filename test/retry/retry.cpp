@@ -0,0 +1,200 @@
+#include "core/retry.hpp"
+#include "core/log.hpp"
+
+#include <unity.h>
+#include <algorithm>
+#include <vector>
+
+// Desktop tests of the retry scheduler, and a simulation of a fleet whose
+// server goes down for a while: retrying in lockstep against backoff with
+// jitter and a circuit breaker
+
+constexpr static iop::RetryPolicy policy = {
+    .attempts = 3,
+    .baseDelay = 1000,
+    .maxDelay = 30 * 1000,
+    .failureThreshold = 5,
+    .openFor = 30 * 1000,
+};
+
+void backoffBounds() {
+    iop::Random random(42);
+    for (uint8_t retry = 0; retry < 40; ++retry) {
+        const auto cap = std::min<iop::esp_time>(policy.maxDelay, policy.baseDelay << std::min<uint8_t>(retry, 20));
+        iop::esp_time biggest = 0;
+        for (uint32_t index = 0; index < 1000; ++index) {
+            const auto delay = iop::backoffDelay(policy, retry, random);
+            TEST_ASSERT_TRUE(delay <= cap);
+            biggest = std::max(biggest, delay);
+        }
+        // Full jitter draws from the whole range, not just around the cap
+        TEST_ASSERT_TRUE(biggest > cap / 2);
+    }
+}
+
+void seedsSpread() {
+    // Devices seeded differently don't draw the same delays
+    std::vector<iop::esp_time> delays;
+    for (uint32_t seed = 1; seed <= 100; ++seed) {
+        iop::Random random(seed * 2654435761U);
+        delays.push_back(iop::backoffDelay(policy, 5, random));
+    }
+    std::sort(delays.begin(), delays.end());
+    const auto distinct = std::unique(delays.begin(), delays.end()) - delays.begin();
+    TEST_ASSERT_TRUE(distinct > 90);
+
+    iop::Random zero(0);
+    TEST_ASSERT_TRUE(zero.next() != 0);
+}
+
+void circuitBreaker() {
+    iop::CircuitBreaker breaker;
+    TEST_ASSERT_TRUE(breaker.state() == iop::CircuitState::CLOSED);
+
+    for (uint8_t index = 0; index + 1 < policy.failureThreshold; ++index)
+        breaker.failure(policy, 1000);
+    TEST_ASSERT_TRUE(breaker.allow(policy, 1000));
+    // Successes reset the count
+    breaker.success();
+    for (uint8_t index = 0; index + 1 < policy.failureThreshold; ++index)
+        breaker.failure(policy, 1000);
+    TEST_ASSERT_TRUE(breaker.state() == iop::CircuitState::CLOSED);
+
+    breaker.failure(policy, 1000);
+    TEST_ASSERT_TRUE(breaker.state() == iop::CircuitState::OPEN);
+    TEST_ASSERT_FALSE(breaker.allow(policy, 1000 + policy.openFor - 1));
+
+    // A single probe goes through, its failure opens the circuit again
+    TEST_ASSERT_TRUE(breaker.allow(policy, 1000 + policy.openFor));
+    TEST_ASSERT_TRUE(breaker.state() == iop::CircuitState::HALF_OPEN);
+    TEST_ASSERT_FALSE(breaker.allow(policy, 1000 + policy.openFor + 1));
+    breaker.failure(policy, 2000 + policy.openFor);
+    TEST_ASSERT_TRUE(breaker.state() == iop::CircuitState::OPEN);
+
+    // Its success closes it
+    TEST_ASSERT_TRUE(breaker.allow(policy, 2000 + 2 * policy.openFor));
+    breaker.success();
+    TEST_ASSERT_TRUE(breaker.state() == iop::CircuitState::CLOSED);
+    TEST_ASSERT_TRUE(breaker.allow(policy, 2000 + 2 * policy.openFor));
+}
+
+void retryAfter() {
+    constexpr iop::esp_time max = 60 * 60 * 1000;
+    TEST_ASSERT_EQUAL(120000, *iop::parseRetryAfter("120", max));
+    TEST_ASSERT_EQUAL(0, *iop::parseRetryAfter(" 0 ", max));
+    TEST_ASSERT_EQUAL(max, *iop::parseRetryAfter("86400", max));
+    TEST_ASSERT_EQUAL(max, *iop::parseRetryAfter("99999999999999999999999", max));
+    // HTTP-dates aren't understood
+    TEST_ASSERT_FALSE(iop::parseRetryAfter("Wed, 21 Oct 2015 07:28:00 GMT", max).has_value());
+    TEST_ASSERT_FALSE(iop::parseRetryAfter("", max).has_value());
+    TEST_ASSERT_FALSE(iop::parseRetryAfter("-1", max).has_value());
+}
+
+void deferral() {
+    iop::CircuitBreaker breaker;
+    breaker.defer(1000, 5000);
+    TEST_ASSERT_TRUE(breaker.state() == iop::CircuitState::OPEN);
+    TEST_ASSERT_FALSE(breaker.allow(policy, 5999));
+    // Shorter than `openFor`, the server knows best
+    TEST_ASSERT_TRUE(breaker.allow(policy, 6000));
+
+    // A failed probe falls back to the policy
+    breaker.failure(policy, 6000);
+    TEST_ASSERT_FALSE(breaker.allow(policy, 11000));
+    TEST_ASSERT_TRUE(breaker.allow(policy, 6000 + policy.openFor));
+    breaker.success();
+
+    // Even a closed circuit is deferred
+    breaker.defer(0, 0);
+    TEST_ASSERT_TRUE(breaker.state() == iop::CircuitState::OPEN);
+    TEST_ASSERT_TRUE(breaker.allow(policy, 1));
+}
+
+constexpr static uint32_t devices = 1000;
+constexpr static iop::esp_time tick = 100;
+constexpr static iop::esp_time outage = 60 * 1000;
+constexpr static iop::esp_time horizon = 5 * 60 * 1000;
+constexpr static iop::esp_time fixedInterval = 5 * 1000;
+
+struct Load {
+    uint32_t duringOutage;
+    /// Once the server is back, the herd hits it
+    uint32_t peakPerSecond;
+    iop::esp_time recoveredAt;
+};
+
+struct Device {
+    iop::Random random;
+    iop::CircuitBreaker breaker;
+    uint8_t failures;
+    iop::esp_time nextAttempt;
+    bool done;
+};
+
+// Every device failed at once when the server went down (at 0), the server
+// answers again after `outage`. Requests hitting the server are counted
+static auto simulate(const bool jittered) -> Load {
+    std::vector<Device> fleet;
+    fleet.reserve(devices);
+    for (uint32_t index = 0; index < devices; ++index)
+        fleet.push_back({iop::Random(index * 2654435761U + 1), iop::CircuitBreaker(), 0, 0, false});
+
+    Load load = {0, 0, 0};
+    uint32_t second = 0;
+    uint32_t recovered = 0;
+    for (iop::esp_time now = 0; now < horizon && recovered < devices; now += tick) {
+        for (auto &device: fleet) {
+            if (device.done || now < device.nextAttempt)
+                continue;
+            if (jittered && !device.breaker.allow(policy, now)) {
+                device.nextAttempt = now + tick;
+                continue;
+            }
+
+            second++;
+            if (now >= outage) {
+                device.done = true;
+                device.breaker.success();
+                recovered++;
+                continue;
+            }
+            load.duringOutage++;
+            device.breaker.failure(policy, now);
+            device.nextAttempt = now + (jittered ? 1 + iop::backoffDelay(policy, device.failures, device.random) : fixedInterval);
+            if (device.failures < UINT8_MAX)
+                device.failures++;
+        }
+        if ((now + tick) % 1000 == 0) {
+            if (now >= outage)
+                load.peakPerSecond = std::max(load.peakPerSecond, second);
+            second = 0;
+        }
+        load.recoveredAt = now;
+    }
+    load.peakPerSecond = std::max(load.peakPerSecond, second);
+    TEST_ASSERT_EQUAL(devices, recovered);
+    return load;
+}
+
+void fleetRecovery() {
+    const auto lockstep = simulate(false);
+    const auto jittered = simulate(true);
+
+    TEST_ASSERT_EQUAL(devices, lockstep.peakPerSecond);
+    TEST_ASSERT_TRUE(jittered.peakPerSecond * 4 < lockstep.peakPerSecond);
+    TEST_ASSERT_TRUE(jittered.duringOutage < lockstep.duringOutage);
+    // Spreading the load doesn't delay the recovery much
+    TEST_ASSERT_TRUE(jittered.recoveredAt < outage + policy.openFor + policy.maxDelay);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(backoffBounds);
+    RUN_TEST(seedsSpread);
+    RUN_TEST(circuitBreaker);
+    RUN_TEST(retryAfter);
+    RUN_TEST(deferral);
+    RUN_TEST(fleetRecovery);
+    UNITY_END();
+    return 0;
+}
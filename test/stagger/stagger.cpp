@@ -0,0 +1,112 @@
+#include "policy.hpp"
+#include "core/log.hpp"
+#include "core/string.hpp"
+
+#include <unity.h>
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Desktop simulation of a fleet that boots together (ex: after a power cut),
+// checks the request rate at the server with and without staggering
+
+constexpr static uint32_t devices = 1000;
+constexpr static iop::esp_time interval = 180 * 1000;
+constexpr static iop::esp_time hour = 60 * 60 * 1000;
+// Devices don't boot at the exact same millisecond
+constexpr static iop::esp_time bootSpread = 3 * 1000;
+
+static auto macOf(const uint32_t index) -> std::string {
+    std::array<char, 18> mac;
+    snprintf(mac.data(), mac.size(), "5C:CF:7F:%02X:%02X:%02X", (index >> 16) & 0xFF, (index >> 8) & 0xFF, index & 0xFF);
+    return std::string(mac.data(), 17);
+}
+
+static auto bootOf(const uint32_t index) -> iop::esp_time {
+    return (index * 2654435761U) % bootSpread;
+}
+
+struct Rate {
+    uint32_t peak;
+    uint32_t busySeconds;
+};
+
+// Requests per second at the server, from one upload per window
+static auto simulate(const bool staggered) -> Rate {
+    std::vector<uint32_t> perSecond(hour / 1000 + 1, 0);
+    for (uint32_t index = 0; index < devices; ++index) {
+        const Stagger stagger(iop::hashString(macOf(index)));
+        const auto boot = bootOf(index);
+
+        // Uptime of the device
+        iop::esp_time now = 0;
+        while (boot + now < hour) {
+            now = staggered ? stagger.next(now, interval) : now + interval;
+            if (boot + now < hour)
+                perSecond[(boot + now) / 1000]++;
+        }
+    }
+
+    Rate rate = {0, 0};
+    for (const auto requests: perSecond) {
+        rate.peak = std::max(rate.peak, requests);
+        if (requests > 0)
+            rate.busySeconds++;
+    }
+    return rate;
+}
+
+void fleetRate() {
+    const auto unstaggered = simulate(false);
+    const auto staggered = simulate(true);
+
+    TEST_ASSERT_TRUE(unstaggered.peak > 250);
+    TEST_ASSERT_TRUE(staggered.peak * 20 < unstaggered.peak);
+    TEST_ASSERT_TRUE(staggered.busySeconds > unstaggered.busySeconds * 20);
+}
+
+void windows() {
+    const Stagger stagger(iop::hashString(macOf(42)));
+    const auto phase = stagger.phase(interval);
+    TEST_ASSERT_TRUE(phase < interval);
+
+    // Every window ends at the phase, and is at most `interval` long
+    iop::esp_time now = 0;
+    for (uint32_t window = 0; window < 100; ++window) {
+        const auto next = stagger.next(now, interval);
+        TEST_ASSERT_TRUE(next > now);
+        TEST_ASSERT_TRUE(next - now <= interval);
+        TEST_ASSERT_EQUAL(phase, next % interval);
+        // The loop is a bit late
+        now = next + 7;
+    }
+    TEST_ASSERT_EQUAL(phase, stagger.next(phase, interval) - interval);
+
+    // The phase follows the interval, when the policy changes it
+    TEST_ASSERT_TRUE(stagger.phase(interval / 2) < interval / 2);
+    TEST_ASSERT_EQUAL(10, stagger.next(10, 0));
+}
+
+void reconnect() {
+    // The whole site reconnects at once, queues are drained spread out
+    std::vector<uint32_t> perSecond(Stagger::reconnectSpread / 1000 + 1, 0);
+    for (uint32_t index = 0; index < devices; ++index) {
+        Stagger stagger(iop::hashString(macOf(index)));
+        const auto drain = stagger.afterReconnect(5000);
+        TEST_ASSERT_TRUE(drain >= 5000 && drain <= 5000 + Stagger::reconnectSpread);
+        perSecond[(drain - 5000) / 1000]++;
+    }
+
+    const auto peak = *std::max_element(perSecond.begin(), perSecond.end());
+    TEST_ASSERT_TRUE(peak < 50);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(windows);
+    RUN_TEST(fleetRate);
+    RUN_TEST(reconnect);
+    UNITY_END();
+    return 0;
+}
@@ -0,0 +1,70 @@
+#include "core/tls_session.hpp"
+#include "driver/device.hpp"
+
+#include <unity.h>
+#include <array>
+#include <cstring>
+
+// Desktop tests of the TLS session kept in RTC memory. The handshakes
+// themselves need BearSSL, that only builds for the device
+
+static auto params(const uint8_t seed) -> std::array<uint8_t, 88> {
+    std::array<uint8_t, 88> data;
+    for (size_t index = 0; index < data.size(); ++index)
+        data[index] = static_cast<uint8_t>(seed + index * 7);
+    return data;
+}
+
+void roundTrip() {
+    iop::TlsSessionStore::clear();
+    std::array<uint8_t, 88> loaded = {0};
+    TEST_ASSERT_FALSE(iop::TlsSessionStore::load("iop-monitor-server.tk", loaded.data(), loaded.size()));
+
+    const auto stored = params(3);
+    iop::TlsSessionStore::store("iop-monitor-server.tk", stored.data(), stored.size());
+    TEST_ASSERT_TRUE(iop::TlsSessionStore::load("iop-monitor-server.tk", loaded.data(), loaded.size()));
+    TEST_ASSERT_EQUAL_MEMORY(stored.data(), loaded.data(), stored.size());
+
+    // Replaced by the next handshake
+    const auto next = params(9);
+    iop::TlsSessionStore::store("iop-monitor-server.tk", next.data(), next.size());
+    TEST_ASSERT_TRUE(iop::TlsSessionStore::load("iop-monitor-server.tk", loaded.data(), loaded.size()));
+    TEST_ASSERT_EQUAL_MEMORY(next.data(), loaded.data(), next.size());
+}
+
+void otherHost() {
+    const auto stored = params(5);
+    iop::TlsSessionStore::store("iop-monitor-server.tk", stored.data(), stored.size());
+
+    std::array<uint8_t, 88> loaded = {0};
+    TEST_ASSERT_FALSE(iop::TlsSessionStore::load("example.com", loaded.data(), loaded.size()));
+    // Other BearSSL version, other layout
+    TEST_ASSERT_FALSE(iop::TlsSessionStore::load("iop-monitor-server.tk", loaded.data(), loaded.size() - 4));
+
+    std::array<uint8_t, iop::TlsSessionStore::capacity + 4> big = {0};
+    iop::TlsSessionStore::store("iop-monitor-server.tk", big.data(), big.size());
+    TEST_ASSERT_TRUE(iop::TlsSessionStore::load("iop-monitor-server.tk", loaded.data(), loaded.size()));
+}
+
+void corrupted() {
+    const auto stored = params(7);
+    iop::TlsSessionStore::store("iop-monitor-server.tk", stored.data(), stored.size());
+
+    // Garbage in RTC memory, like after a cold boot
+    std::array<uint32_t, 4> block = {0};
+    TEST_ASSERT_TRUE(driver::device.rtcRead(iop::TlsSessionStore::rtcOffset + 4, block.data(), sizeof(block)));
+    block[1] ^= 0x10;
+    TEST_ASSERT_TRUE(driver::device.rtcWrite(iop::TlsSessionStore::rtcOffset + 4, block.data(), sizeof(block)));
+
+    std::array<uint8_t, 88> loaded = {0};
+    TEST_ASSERT_FALSE(iop::TlsSessionStore::load("iop-monitor-server.tk", loaded.data(), loaded.size()));
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(roundTrip);
+    RUN_TEST(otherHost);
+    RUN_TEST(corrupted);
+    UNITY_END();
+    return 0;
+}